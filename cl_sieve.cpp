@@ -9,11 +9,14 @@
 
 	Search limits:  P up to 2^64 and N up to 2^31
 
-	Using OpenMP for multithreaded factor verification.
+	Using OpenMP for multithreaded factor verification and the CPU backend.
 
 */
 
 #include <unistd.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 #include <cinttypes>
 #include <math.h>
 #include <omp.h>
@@ -22,6 +25,7 @@
 #include "boinc_opencl.h"
 #include "simpleCL.h"
 
+#include "common.h"
 #include "check.h"
 #include "clearn.h"
 #include "clearresult.h"
@@ -32,15 +36,22 @@
 #include "verifyslow.h"
 #include "verify.h"
 #include "verifyresult.h"
+#include "compact.h"
 
 #include "primesieve.h"
 #include "putil.h"
 #include "cl_sieve.h"
+#include "cpu_sieve.h"
 #include "verifyprime.h"
+#include "verifysimd.h"
+#include "tunedb.h"
+#include "survivors.h"
 
 #define RESULTS_FILENAME "factors.txt"
 #define STATE_FILENAME_A "stateA.ckp"
 #define STATE_FILENAME_B "stateB.ckp"
+// largest presieve bound tried when the bound is not given on the command line
+#define PRESIEVE_MAX 8000
 
 void handle_trickle_up(workStatus & st){
 	if(boinc_is_standalone()) return;
@@ -74,32 +85,89 @@ FILE *my_fopen(const char * filename, const char * mode){
 }
 
 
+// results and checkpoint files.  job j of a batch writes factors_j.txt, stateA_j.ckp and stateB_j.ckp,
+// job 0 is a single search
+static uint32_t batchJob = 0;
+static char resultsFile[32] = RESULTS_FILENAME;
+static char stateFileA[32] = STATE_FILENAME_A;
+static char stateFileB[32] = STATE_FILENAME_B;
+
+void setJobFiles( uint32_t job ){
+	batchJob = job;
+	if(job == 0){
+		snprintf(resultsFile, sizeof(resultsFile), "%s", RESULTS_FILENAME);
+		snprintf(stateFileA, sizeof(stateFileA), "%s", STATE_FILENAME_A);
+		snprintf(stateFileB, sizeof(stateFileB), "%s", STATE_FILENAME_B);
+	}
+	else{
+		snprintf(resultsFile, sizeof(resultsFile), "factors_%u.txt", job);
+		snprintf(stateFileA, sizeof(stateFileA), "stateA_%u.ckp", job);
+		snprintf(stateFileB, sizeof(stateFileB), "stateB_%u.ckp", job);
+	}
+}
+
+
 void cleanup( progData & pd, searchData & sd, workStatus & st ){
 	sclReleaseMemObject(pd.d_factor);
 	sclReleaseMemObject(pd.d_sum);
-	sclReleaseMemObject(pd.d_primes);
+	for(int b = 0; b < 2; ++b){
+		sclReleaseMemObject(pd.d_primebuf[b]);
+		sclReleaseMemObject(pd.d_segcount[b]);
+		if(pd.computedone[b] != NULL){
+			clReleaseEvent(pd.computedone[b]);
+		}
+	}
+	if(pd.primequeue != NULL){
+		clReleaseCommandQueue(pd.primequeue);
+	}
 	sclReleaseMemObject(pd.d_primecount);
+	sclReleaseMemObject(pd.d_sieveprimes);
 	sclReleaseClSoft(pd.check);
 	sclReleaseClSoft(pd.clearn);
 	sclReleaseClSoft(pd.clearresult);
         sclReleaseClSoft(pd.iterate);
         sclReleaseClSoft(pd.setup);
         sclReleaseClSoft(pd.getsegprimes);
-        sclReleaseClSoft(pd.addsmallprimes);
+	if(st.pmin < 114){
+	        sclReleaseClSoft(pd.addsmallprimes);
+	}
 	sclReleaseClSoft(pd.verifyreduce);
 	sclReleaseClSoft(pd.verifyresult);
-	if(st.factorial){
+	if(st.factorial && !st.primorial){
 		sclReleaseMemObject(pd.d_primeproducts);
 		sclReleaseMemObject(pd.d_powers);
 	}
-	if(st.primorial){
-		sclReleaseMemObject(pd.d_primeproducts);
+	if(st.factorial && !st.compositorial){
+		sclReleaseClSoft(pd.reflect);
+	}
+	if(st.primorial && !st.compositorial){
+		sclReleaseMemObject(pd.d_primproducts);
 		sclReleaseMemObject(pd.d_smallprimes);
 	}
-	if(st.compositorial){
+	if(st.primorial && st.compositorial){
+		sclReleaseMemObject(pd.d_primproducts);
+	}
+	if(sd.compinv){
+		sclReleaseMemObject(pd.d_primproducts);
+		sclReleaseMemObject(pd.d_smallprimes);
+	}
+	else if(st.compositorial){
 		sclReleaseMemObject(pd.d_compproducts);
 		sclReleaseMemObject(pd.d_smallprimes);
 	}
+	if(sd.retire){
+		sclReleaseMemObject(pd.d_compact);
+		sclReleaseMemObject(pd.d_holes);
+		sclReleaseClSoft(pd.compactclear);
+		sclReleaseClSoft(pd.compactcount);
+		sclReleaseClSoft(pd.compactholes);
+		sclReleaseClSoft(pd.compactmove);
+	}
+	if(survivorsActive()){
+		sclReleaseMemObject(pd.d_alive);
+		sclReleaseMemObject(pd.d_left);
+	}
+	clReleaseProgram(pd.program);
 }
 
 
@@ -111,12 +179,12 @@ void write_state( workStatus & st, searchData & sd ){
 	st.state_sum = st.pmin+st.pmax+st.p+st.checksum+st.primecount+st.factorcount+st.last_trickle+st.nmin+st.nmax;
 
         if (sd.write_state_a_next){
-		if ((out = my_fopen(STATE_FILENAME_A,"wb")) == NULL)
-			fprintf(stderr,"Cannot open %s !!!\n",STATE_FILENAME_A);
+		if ((out = my_fopen(stateFileA,"wb")) == NULL)
+			fprintf(stderr,"Cannot open %s !!!\n",stateFileA);
 	}
 	else{
-                if ((out = my_fopen(STATE_FILENAME_B,"wb")) == NULL)
-                        fprintf(stderr,"Cannot open %s !!!\n",STATE_FILENAME_B);
+                if ((out = my_fopen(stateFileB,"wb")) == NULL)
+                        fprintf(stderr,"Cannot open %s !!!\n",stateFileB);
         }
 
 	if(out != NULL){
@@ -144,27 +212,27 @@ int read_state( workStatus & st, searchData & sd ){
 	workStatus stat_a, stat_b;
 
         // Attempt to read state file A
-	if ((in = my_fopen(STATE_FILENAME_A,"rb")) == NULL){
+	if ((in = my_fopen(stateFileA,"rb")) == NULL){
 		good_state_a = false;
         }
 	else{
 		if( fread(&stat_a, sizeof(workStatus), 1, in) != 1 ){
-			fprintf(stderr,"Cannot parse %s !!!\n",STATE_FILENAME_A);
-			printf("Cannot parse %s !!!\n",STATE_FILENAME_A);
+			fprintf(stderr,"Cannot parse %s !!!\n",stateFileA);
+			printf("Cannot parse %s !!!\n",stateFileA);
 			good_state_a = false;
 		}
 		else if(stat_a.pmin != st.pmin || stat_a.pmax != st.pmax || stat_a.nmin != st.nmin || stat_a.nmax != st.nmax
 			|| stat_a.factorial != st.factorial || stat_a.primorial != st.primorial || stat_a.compositorial != st.compositorial){
-			fprintf(stderr,"Invalid checkpoint file %s !!!\n",STATE_FILENAME_A);
-			printf("Invalid checkpoint file %s !!!\n",STATE_FILENAME_A);
+			fprintf(stderr,"Invalid checkpoint file %s !!!\n",stateFileA);
+			printf("Invalid checkpoint file %s !!!\n",stateFileA);
 			good_state_a = false;
 		}
 		else{
 			uint64_t state_sum = stat_a.pmin+stat_a.pmax+stat_a.p+stat_a.checksum+stat_a.primecount+stat_a.factorcount
 						+stat_a.last_trickle+stat_a.nmin+stat_a.nmax;
 			if(state_sum != stat_a.state_sum){
-				fprintf(stderr,"Checksum error in %s !!!\n",STATE_FILENAME_A);
-				printf("Checksum error in %s !!!\n",STATE_FILENAME_A);
+				fprintf(stderr,"Checksum error in %s !!!\n",stateFileA);
+				printf("Checksum error in %s !!!\n",stateFileA);
 				good_state_a = false;
 			}
 		}
@@ -172,27 +240,27 @@ int read_state( workStatus & st, searchData & sd ){
 	}
 
         // Attempt to read state file B
-	if ((in = my_fopen(STATE_FILENAME_B,"rb")) == NULL){
+	if ((in = my_fopen(stateFileB,"rb")) == NULL){
 		good_state_b = false;
         }
 	else{
 		if( fread(&stat_b, sizeof(workStatus), 1, in) != 1 ){
-			fprintf(stderr,"Cannot parse %s !!!\n",STATE_FILENAME_B);
-			printf("Cannot parse %s !!!\n",STATE_FILENAME_B);
+			fprintf(stderr,"Cannot parse %s !!!\n",stateFileB);
+			printf("Cannot parse %s !!!\n",stateFileB);
 			good_state_b = false;
 		}
 		else if(stat_b.pmin != st.pmin || stat_b.pmax != st.pmax || stat_b.nmin != st.nmin || stat_b.nmax != st.nmax
 			|| stat_b.factorial != st.factorial || stat_b.primorial != st.primorial || stat_b.compositorial != st.compositorial){
-			fprintf(stderr,"Invalid checkpoint file %s !!!\n",STATE_FILENAME_B);
-			printf("Invalid checkpoint file %s !!!\n",STATE_FILENAME_B);
+			fprintf(stderr,"Invalid checkpoint file %s !!!\n",stateFileB);
+			printf("Invalid checkpoint file %s !!!\n",stateFileB);
 			good_state_b = false;
 		}
 		else{
 			uint64_t state_sum = stat_b.pmin+stat_b.pmax+stat_b.p+stat_b.checksum+stat_b.primecount+stat_b.factorcount
 						+stat_b.last_trickle+stat_b.nmin+stat_b.nmax;
 			if(state_sum != stat_b.state_sum){
-				fprintf(stderr,"Checksum error in %s !!!\n",STATE_FILENAME_B);
-				printf("Checksum error in %s !!!\n",STATE_FILENAME_B);
+				fprintf(stderr,"Checksum error in %s !!!\n",stateFileB);
+				printf("Checksum error in %s !!!\n",stateFileB);
 				good_state_b = false;
 			}
 		}
@@ -214,7 +282,7 @@ int read_state( workStatus & st, searchData & sd ){
 		memcpy(&st, &stat_a, sizeof(workStatus));
 		sd.write_state_a_next = false;
 		if(boinc_is_standalone()){
-			printf("Resuming from checkpoint in %s\n",STATE_FILENAME_A);
+			printf("Resuming from checkpoint in %s\n",stateFileA);
 		}
 		return 1;
 	}
@@ -223,7 +291,7 @@ int read_state( workStatus & st, searchData & sd ){
 		memcpy(&st, &stat_b, sizeof(workStatus));
 		sd.write_state_a_next = true;
 		if(boinc_is_standalone()){
-			printf("Resuming from checkpoint in %s\n",STATE_FILENAME_B);
+			printf("Resuming from checkpoint in %s\n",stateFileB);
 		}
 		return 1;
         }
@@ -243,29 +311,73 @@ void checkpoint( workStatus & st, searchData & sd ){
 }
 
 
-// sleep CPU thread while waiting on the specified event to complete in the command queue
-// using critical sections to prevent BOINC from shutting down the program while kernels are running on the GPU
-void waitOnEvent(sclHard hardware, cl_event event){
+// completion of an event, signalled from the OpenCL callback thread
+typedef struct {
+#ifdef _WIN32
+	HANDLE done;
+#else
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	bool complete;
+#endif
+}eventSignal;
+
+
+void CL_CALLBACK eventComplete(cl_event event, cl_int status, void * data){
+
+	eventSignal * sig = (eventSignal *)data;
+
+#ifdef _WIN32
+	SetEvent(sig->done);
+#else
+	pthread_mutex_lock(&sig->lock);
+	sig->complete = true;
+	pthread_cond_signal(&sig->done);
+	pthread_mutex_unlock(&sig->lock);
+#endif
+}
+
+
+// block until the event completes, then release it.  returns the execution time of the event's command in ms
+// the thread sleeps until the driver calls eventComplete.  if the callback can't be registered the event is polled every 1ms
+double waitComplete(cl_event event){
 
 	cl_int err;
 	cl_int info;
+	bool signalled = false;
+	cl_ulong time_start = 0, time_end = 0;
+	eventSignal sig;
+
 #ifdef _WIN32
+	sig.done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(sig.done != NULL){
+		if(clSetEventCallback(event, CL_COMPLETE, eventComplete, &sig) == CL_SUCCESS){
+			WaitForSingleObject(sig.done, INFINITE);
+			signalled = true;
+		}
+		CloseHandle(sig.done);
+	}
 #else
+	pthread_mutex_init(&sig.lock, NULL);
+	pthread_cond_init(&sig.done, NULL);
+	sig.complete = false;
+	if(clSetEventCallback(event, CL_COMPLETE, eventComplete, &sig) == CL_SUCCESS){
+		pthread_mutex_lock(&sig.lock);
+		while(!sig.complete){
+			pthread_cond_wait(&sig.done, &sig.lock);
+		}
+		pthread_mutex_unlock(&sig.lock);
+		signalled = true;
+	}
+	pthread_cond_destroy(&sig.done);
+	pthread_mutex_destroy(&sig.lock);
+
 	struct timespec sleep_time;
 	sleep_time.tv_sec = 0;
 	sleep_time.tv_nsec = 1000000;	// 1ms
 #endif
 
-	boinc_begin_critical_section();
-
-	err = clFlush(hardware.queue);
-	if ( err != CL_SUCCESS ) {
-		printf( "ERROR: clFlush\n" );
-		fprintf(stderr, "ERROR: clFlush\n" );
-		sclPrintErrorFlags( err );
-       	}
-
-	while(true){
+	while(!signalled){
 
 #ifdef _WIN32
 		Sleep(1);
@@ -281,35 +393,75 @@ void waitOnEvent(sclHard hardware, cl_event event){
 	       	}
 
 		if(info == CL_COMPLETE){
-			err = clReleaseEvent(event);
-			if ( err != CL_SUCCESS ) {
-				printf( "ERROR: clReleaseEvent\n" );
-				fprintf(stderr, "ERROR: clReleaseEvent\n" );
-				sclPrintErrorFlags( err );
-		       	}
+			break;
+		}
+	}
 
-			boinc_end_critical_section();
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+	clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
 
-			return;
-		}
+	err = clReleaseEvent(event);
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clReleaseEvent\n" );
+		fprintf(stderr, "ERROR: clReleaseEvent\n" );
+		sclPrintErrorFlags( err );
+       	}
+
+	return (time_end > time_start) ? (time_end - time_start) / 1000000.0 : 0.0;
+}
+
+
+// BOINC's critical section calls aren't thread safe.  the device threads share one critical section,
+// it is held while any of them waits on its queue.
+static uint32_t criticalcount = 0;
+
+void beginDeviceCritical(){
+	#pragma omp critical(boinc)
+	{
+		if(criticalcount++ == 0) boinc_begin_critical_section();
+	}
+}
+
+void endDeviceCritical(){
+	#pragma omp critical(boinc)
+	{
+		if(--criticalcount == 0) boinc_end_critical_section();
 	}
 }
 
 
+// sleep CPU thread while waiting on the specified event to complete in the command queue
+// using critical sections to prevent BOINC from shutting down the program while kernels are running on the GPU
+// returns the kernel time of the event in ms
+double waitOnEvent(sclHard hardware, cl_event event){
+
+	cl_int err;
+	double ms;
+
+	beginDeviceCritical();
+
+	err = clFlush(hardware.queue);
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clFlush\n" );
+		fprintf(stderr, "ERROR: clFlush\n" );
+		sclPrintErrorFlags( err );
+       	}
+
+	ms = waitComplete(event);
+
+	endDeviceCritical();
+
+	return ms;
+}
+
+
 // queue a marker and sleep CPU thread until marker has been reached in the command queue
 void sleepCPU(sclHard hardware){
 
 	cl_event kernelsDone;
 	cl_int err;
-	cl_int info;
-#ifdef _WIN32
-#else
-	struct timespec sleep_time;
-	sleep_time.tv_sec = 0;
-	sleep_time.tv_nsec = 1000000;	// 1ms
-#endif
 
-	boinc_begin_critical_section();
+	beginDeviceCritical();
 
 	// OpenCL v2.0
 /*
@@ -334,34 +486,9 @@ void sleepCPU(sclHard hardware){
 		sclPrintErrorFlags( err );
        	}
 
-	while(true){
-
-#ifdef _WIN32
-		Sleep(1);
-#else
-		nanosleep(&sleep_time,NULL);
-#endif
-
-		err = clGetEventInfo(kernelsDone, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &info, NULL);
-		if ( err != CL_SUCCESS ) {
-			printf( "ERROR: clGetEventInfo\n" );
-			fprintf(stderr, "ERROR: clGetEventInfo\n" );
-			sclPrintErrorFlags( err );
-	       	}
-
-		if(info == CL_COMPLETE){
-			err = clReleaseEvent(kernelsDone);
-			if ( err != CL_SUCCESS ) {
-				printf( "ERROR: clReleaseEvent\n" );
-				fprintf(stderr, "ERROR: clReleaseEvent\n" );
-				sclPrintErrorFlags( err );
-		       	}
-
-			boinc_end_critical_section();
+	waitComplete(kernelsDone);
 
-			return;
-		}
-	}
+	endDeviceCritical();
 }
 
 
@@ -442,12 +569,175 @@ int factorcompare(const void *a, const void *b) {
 		if(nB < nA){
 			return 1;
 		}
+		// same p and n, order by type and sign so the order of the kernel's atomic appends doesn't matter
+		if(nB == nA && (factB->type < factA->type || (factB->type == factA->type && factB->nc < factA->nc))){
+			return 1;
+		}
 	}
 	return -1;
 }
 
 
-void getResults( progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint64_t * h_checksum, uint32_t * h_primecount, uint32_t * verifylist, size_t verifylistsize ){
+// sort, verify, and write factors to the results file.  factors of 2-PRPs are discarded
+void reportFactors( workStatus & st, factor * h_factor, uint32_t numfactors, verifyList & vl ){
+	// sort results by prime size if needed
+	if(numfactors > 1){
+		if(boinc_is_standalone()){
+			printf("sorting factors\n");
+		}
+		qsort(h_factor, numfactors, sizeof(factor), factorcompare);
+	}
+	// verify all factors on CPU using slow test, one factor per SIMD lane
+	if(boinc_is_standalone()){
+		printf("Verifying factors on CPU using %s...\n", simdName());
+	}
+
+	double last = 0.0;
+	uint32_t tested = 0;
+	uint32_t numbatches = (numfactors + VERIFY_BATCH - 1) / VERIFY_BATCH;
+	#pragma omp parallel for
+	for(uint32_t b=0; b<numbatches; ++b){
+		uint64_t fp[VERIFY_BATCH];
+		uint32_t fn[VERIFY_BATCH];
+		int32_t fc[VERIFY_BATCH], type[VERIFY_BATCH];
+		bool good[VERIFY_BATCH];
+		uint32_t first = b * VERIFY_BATCH;
+		uint32_t count = (numfactors - first < VERIFY_BATCH) ? numfactors - first : VERIFY_BATCH;
+		for(uint32_t j=0; j<count; ++j){
+			fp[j] = h_factor[first+j].p;
+			fn[j] = (h_factor[first+j].nc < 0) ? -h_factor[first+j].nc : h_factor[first+j].nc;
+			fc[j] = (h_factor[first+j].nc < 0) ? -1 : 1;
+			type[j] = h_factor[first+j].type;
+		}
+		verifyBatch( fp, fn, fc, type, count, vl.primes, vl.primesize, vl.composites, vl.compsize, good );
+		for(uint32_t j=0; j<count; ++j){
+			if( !good[j] ){
+				if(type[j] == FACTORIAL){
+					fprintf(stderr,"CPU factor verification failed!  %" PRIu64 " is not a factor of %u!%+d\n", fp[j], fn[j], fc[j]);
+					printf("\nCPU factor verification failed!  %" PRIu64 " is not a factor of %u!%+d\n", fp[j], fn[j], fc[j]);
+				}
+				else if(type[j] == PRIMORIAL){
+					fprintf(stderr,"CPU factor verification failed!  %" PRIu64 " is not a factor of %u#%+d\n", fp[j], fn[j], fc[j]);
+					printf("\nCPU factor verification failed!  %" PRIu64 " is not a factor of %u#%+d\n", fp[j], fn[j], fc[j]);
+				}
+				else if(type[j] == COMPOSITORIAL){
+					fprintf(stderr,"CPU factor verification failed!  %" PRIu64 " is not a factor of %u!/#%+d\n", fp[j], fn[j], fc[j]);
+					printf("\nCPU factor verification failed!  %" PRIu64 " is not a factor of %u!/#%+d\n", fp[j], fn[j], fc[j]);
+				}
+				exit(EXIT_FAILURE);
+			}
+		}
+		if(boinc_is_standalone()){
+			#pragma omp atomic
+			tested += count;
+			double done = (double)tested / (double)numfactors * 100.0;
+			if(done > last+0.1){
+				last = done;
+				printf("\r%.1f%%     ",done);
+				fflush(stdout);
+			}
+		}
+	}
+
+	// primality of each distinct p, gpu generates 2-PRPs.  factors are sorted, the same p are adjacent
+	uint64_t * distinctp = (uint64_t *)malloc(numfactors * sizeof(uint64_t));
+	if( distinctp == NULL ){
+		fprintf(stderr,"malloc error: distinctp\n");
+		exit(EXIT_FAILURE);
+	}
+	bool * prime = (bool *)malloc(numfactors * sizeof(bool));
+	if( prime == NULL ){
+		fprintf(stderr,"malloc error: prime\n");
+		exit(EXIT_FAILURE);
+	}
+	uint32_t distinct = 0;
+	for(uint32_t i=0; i<numfactors; ++i){
+		if( !distinct || distinctp[distinct-1] != h_factor[i].p ){
+			distinctp[distinct++] = h_factor[i].p;
+		}
+	}
+	uint32_t primebatches = (distinct + VERIFY_BATCH - 1) / VERIFY_BATCH;
+	#pragma omp parallel for
+	for(uint32_t b=0; b<primebatches; ++b){
+		uint32_t first = b * VERIFY_BATCH;
+		uint32_t count = (distinct - first < VERIFY_BATCH) ? distinct - first : VERIFY_BATCH;
+		isPrimeBatch( &distinctp[first], &prime[first], count );
+	}
+
+	fprintf(stderr,"Verified %u factors.\n", numfactors);
+	if(boinc_is_standalone()){
+		printf("\rVerified %u factors.\n", numfactors);
+	}
+	// write factors to file
+	FILE * resfile = my_fopen(resultsFile,"a");
+	if( resfile == NULL ){
+		fprintf(stderr,"Cannot open %s !!!\n",resultsFile);
+		exit(EXIT_FAILURE);
+	}
+	if(boinc_is_standalone()){
+		printf("writing factors to %s\n", resultsFile);
+	}
+	uint32_t eliminated = 0;
+	uint32_t d = 0;
+	for(uint32_t i=0; i<numfactors; ++i){
+		uint64_t fp = h_factor[i].p;
+		if( distinctp[d] != fp ) ++d;
+		uint32_t fn = (h_factor[i].nc < 0) ? -h_factor[i].nc : h_factor[i].nc; 
+		int32_t fc = (h_factor[i].nc < 0) ? -1 : 1;
+		int32_t type = h_factor[i].type;
+		// with --survivors only the smallest factor of a candidate that is left is reported
+		if( prime[d] && survivorsActive() && !survivorKill(h_factor[i].nc, type) ){
+			++eliminated;
+			continue;
+		}
+		if( prime[d] ){	// we only want prime factors
+			++st.factorcount;
+			if(type == FACTORIAL){
+				if( fprintf( resfile, "%" PRIu64 " | %u!%+d\n",fp,fn,fc) < 0 ){
+					fprintf(stderr,"Cannot write to %s !!!\n",resultsFile);
+					exit(EXIT_FAILURE);
+				}
+			}
+			else if(type == PRIMORIAL){
+				if( fprintf( resfile, "%" PRIu64 " | %u#%+d\n",fp,fn,fc) < 0 ){
+					fprintf(stderr,"Cannot write to %s !!!\n",resultsFile);
+					exit(EXIT_FAILURE);
+				}
+			}
+			else if(type == COMPOSITORIAL){
+				if( fprintf( resfile, "%" PRIu64 " | %u!/#%+d\n",fp,fn,fc) < 0 ){
+					fprintf(stderr,"Cannot write to %s !!!\n",resultsFile);
+					exit(EXIT_FAILURE);
+				}
+			}
+			// add the factor to checksum
+			st.checksum += fn + fc;
+		}
+		else{
+			fprintf(stderr,"discarded 2-PRP factor %" PRIu64 "\n", fp);
+			printf("discarded 2-PRP factor %" PRIu64 "\n", fp);
+		}	
+	}
+	fclose(resfile);
+	free(distinctp);
+	free(prime);
+	if(eliminated){
+		fprintf(stderr,"skipped %u factors of eliminated candidates\n", eliminated);
+		if(boinc_is_standalone()){
+			printf("skipped %u factors of eliminated candidates\n", eliminated);
+		}
+	}
+}
+
+
+// add the checksum and prime count of one device to st and read its factors into the pinned factor array.
+// returns the number of factors.
+uint32_t readResults( deviceData & dev, workStatus & st ){
+	progData & pd = dev.pd;
+	searchData & sd = dev.sd;
+	sclHard hardware = dev.hardware;
+	uint64_t * h_checksum = (uint64_t *)pd.h_sum.ptr;
+	uint32_t * h_primecount = (uint32_t *)pd.h_count.ptr;
 	// copy checksum and total prime count to host memory, non-blocking
 	sclReadNB(hardware, sd.numgroups*sizeof(uint64_t), pd.d_sum, h_checksum);
 	// copy prime count to host memory, blocking
@@ -464,12 +754,6 @@ void getResults( progData & pd, workStatus & st, searchData & sd, sclHard hardwa
 		printf("error: gpu prime array overflow\n");
 		exit(EXIT_FAILURE);
 	}
-	// flag set if there is a gpu overflow error
-	if(h_primecount[4] == 1){
-		fprintf(stderr,"error: getsegprimes kernel local memory overflow\n");
-		printf("error: getsegprimes kernel local memory overflow\n");
-		exit(EXIT_FAILURE);
-	}
 	// flag set if there is a gpu validation failure
 	if(h_primecount[5] == 1){
 		fprintf(stderr,"error: gpu validation failure\n");
@@ -478,118 +762,22 @@ void getResults( progData & pd, workStatus & st, searchData & sd, sclHard hardwa
 	}
 	uint32_t numfactors = h_primecount[2];
 	if(numfactors > 0){
-		if(boinc_is_standalone()){
-			printf("processing %u factors on CPU\n", numfactors);
-		}
 		if(numfactors > sd.numresults){
 			fprintf(stderr,"Error: number of results (%u) overflowed array.\n", numfactors);
 			exit(EXIT_FAILURE);
 		}
-		factor * h_factor = (factor *)malloc(numfactors * sizeof(factor));
-		if( h_factor == NULL ){
-			fprintf(stderr,"malloc error: h_factor\n");
-			exit(EXIT_FAILURE);
+		// the pinned factor array is kept between checkpoints, it grows when a checkpoint has more factors
+		if(numfactors > pd.h_factor.size / sizeof(factor)){
+			size_t count = 2 * (pd.h_factor.size / sizeof(factor));
+			if(count < numfactors) count = numfactors;
+			if(count > sd.numresults) count = sd.numresults;
+			sclFreePinned(hardware, pd.h_factor);
+			pd.h_factor = sclMallocPinned(hardware, count * sizeof(factor));
 		}
 		// copy factors to host memory, blocking
-		sclRead(hardware, numfactors * sizeof(factor), pd.d_factor, h_factor);
-		// sort results by prime size if needed
-		if(numfactors > 1){
-			if(boinc_is_standalone()){
-				printf("sorting factors\n");
-			}
-			qsort(h_factor, numfactors, sizeof(factor), factorcompare);
-		}
-		// verify all factors on CPU using slow test
-		if(boinc_is_standalone()){
-			printf("Verifying factors on CPU...\n");
-		}
-
-		double last = 0.0;
-		uint32_t tested = 0;
-		#pragma omp parallel for
-		for(uint32_t i=0; i<numfactors; ++i){
-			uint64_t fp = h_factor[i].p;
-			uint32_t fn = (h_factor[i].nc < 0) ? -h_factor[i].nc : h_factor[i].nc; 
-			int32_t fc = (h_factor[i].nc < 0) ? -1 : 1;
-			int32_t type = h_factor[i].type;
-			if( !verify( fp, fn, fc, type, verifylist, verifylistsize ) ){
-				if(type == FACTORIAL){
-					fprintf(stderr,"CPU factor verification failed!  %" PRIu64 " is not a factor of %u!%+d\n", fp, fn, fc);
-					printf("\nCPU factor verification failed!  %" PRIu64 " is not a factor of %u!%+d\n", fp, fn, fc);
-				}
-				else if(type == PRIMORIAL){
-					fprintf(stderr,"CPU factor verification failed!  %" PRIu64 " is not a factor of %u#%+d\n", fp, fn, fc);
-					printf("\nCPU factor verification failed!  %" PRIu64 " is not a factor of %u#%+d\n", fp, fn, fc);
-				}
-				else if(type == COMPOSITORIAL){
-					fprintf(stderr,"CPU factor verification failed!  %" PRIu64 " is not a factor of %u!/#%+d\n", fp, fn, fc);
-					printf("\nCPU factor verification failed!  %" PRIu64 " is not a factor of %u!/#%+d\n", fp, fn, fc);
-				}
-				exit(EXIT_FAILURE);
-			}
-			if(boinc_is_standalone()){
-				#pragma omp atomic
-				++tested;
-				double done = (double)(tested+1) / (double)numfactors * 100.0;
-				if(done > last+0.1){
-					last = done;
-					printf("\r%.1f%%     ",done);
-					fflush(stdout);
-				}
-			}
-		}
-
-		fprintf(stderr,"Verified %u factors.\n", numfactors);
-		if(boinc_is_standalone()){
-			printf("\rVerified %u factors.\n", numfactors);
-		}
-		// write factors to file
-		FILE * resfile = my_fopen(RESULTS_FILENAME,"a");
-		if( resfile == NULL ){
-			fprintf(stderr,"Cannot open %s !!!\n",RESULTS_FILENAME);
-			exit(EXIT_FAILURE);
-		}
-		if(boinc_is_standalone()){
-			printf("writing factors to %s\n", RESULTS_FILENAME);
-		}
-		uint64_t lastgoodp = 0;
-		for(uint32_t i=0; i<numfactors; ++i){
-			uint64_t fp = h_factor[i].p;
-			uint32_t fn = (h_factor[i].nc < 0) ? -h_factor[i].nc : h_factor[i].nc; 
-			int32_t fc = (h_factor[i].nc < 0) ? -1 : 1;
-			int32_t type = h_factor[i].type;
-			if( fp == lastgoodp || isPrime(fp) ){	// gpu generates 2-PRPs, we only want prime factors
-				lastgoodp = fp;
-				++st.factorcount;
-				if(type == FACTORIAL){
-					if( fprintf( resfile, "%" PRIu64 " | %u!%+d\n",fp,fn,fc) < 0 ){
-						fprintf(stderr,"Cannot write to %s !!!\n",RESULTS_FILENAME);
-						exit(EXIT_FAILURE);
-					}
-				}
-				else if(type == PRIMORIAL){
-					if( fprintf( resfile, "%" PRIu64 " | %u#%+d\n",fp,fn,fc) < 0 ){
-						fprintf(stderr,"Cannot write to %s !!!\n",RESULTS_FILENAME);
-						exit(EXIT_FAILURE);
-					}
-				}
-				else if(type == COMPOSITORIAL){
-					if( fprintf( resfile, "%" PRIu64 " | %u!/#%+d\n",fp,fn,fc) < 0 ){
-						fprintf(stderr,"Cannot write to %s !!!\n",RESULTS_FILENAME);
-						exit(EXIT_FAILURE);
-					}
-				}
-				// add the factor to checksum
-				st.checksum += fn + fc;
-			}
-			else{
-				fprintf(stderr,"discarded 2-PRP factor %" PRIu64 "\n", fp);
-				printf("discarded 2-PRP factor %" PRIu64 "\n", fp);
-			}	
-		}
-		fclose(resfile);
-		free(h_factor);
+		sclRead(hardware, numfactors * sizeof(factor), pd.d_factor, pd.h_factor.ptr);
 	}
+	return numfactors;
 }
 
 
@@ -606,7 +794,11 @@ void setupSearch(workStatus & st, searchData & sd){
 		fprintf(stderr, "-! or -# or -c argument is required\nuse -h for help\n");
 		exit(EXIT_FAILURE);
 	}
-	else if(st.factorial && st.compositorial && !st.primorial){
+	else if(z == 3){
+		printf("Sieving for factors of factorial, primorial and compositorial\n");
+		fprintf(stderr, "Sieving for factors of factorial, primorial and compositorial\n");
+	}
+	else if(st.factorial && st.compositorial){
 		printf("Sieving for factors of factorial and compositorial\n");
 		fprintf(stderr, "Sieving for factors of factorial and compositorial\n");
 	}
@@ -640,6 +832,13 @@ void setupSearch(workStatus & st, searchData & sd){
 		exit(EXIT_FAILURE);
 	}
 
+	// with every prime above nmin-1, a power table for nmin-1!/# replaces the compositorial product table.
+	// nmin-1! = nmin-1!/# * nmin-1#
+	sd.compinv = st.factorial && st.compositorial && !st.primorial && st.pmin > st.nmin-1;
+
+	// -! -c and -! -# -c keep more than one residue per prime
+	sd.combined = st.factorial && st.compositorial;
+
 	// increase result buffer at low P range
 	// it's still possible to overflow this with a fast GPU and large search range
 	if(st.pmin < 0xFFFFFFFF){
@@ -651,7 +850,11 @@ void setupSearch(workStatus & st, searchData & sd){
 		printf("Starting sieve at p: %" PRIu64 " n: %u\nStopping sieve at P: %" PRIu64 " N: %u\n", st.pmin, st.nmin, st.pmax, st.nmax);
 	}
 
-	// setup and iterate kernel size
+}
+
+
+// setup and iterate kernel size of a device, seeds for the first profile
+void setupKernelSize(searchData & sd){
 	if(sd.compute){
 		sd.sstep = 25 * sd.computeunits;
 		sd.nstep = 300 * sd.computeunits;
@@ -661,304 +864,937 @@ void setupSearch(workStatus & st, searchData & sd){
 		sd.nstep = 60 * sd.computeunits;
 	}
 
-
+	// target kernel queue depth is 1 second
+	sd.queuedepth = sd.compute ? 20 : 100;
 }
 
 
 
-void profileGPU(progData & pd, workStatus & st, searchData & sd, sclHard hardware){
-
-	// calculate approximate chunk size based on gpu's compute units
-	cl_int err = 0;
-
-	uint64_t calc_range = sd.computeunits * (uint64_t)350000;
+// arrays of primes and composites used during CPU factor verification
+verifyList buildVerifyList( workStatus & st ){
 
-	// limit kernel global size
-	if(calc_range > 4294900000){
-		calc_range = 4294900000;
+	verifyList vl = {};
+	if(st.primorial){
+		vl.primes = (uint32_t*)primesieve_generate_primes(103, st.nmax, &vl.primesize, UINT32_PRIMES);
+	}
+	if(st.compositorial){
+		size_t allprimesize;
+		uint32_t * allprime = (uint32_t*)primesieve_generate_primes(45, st.nmax, &allprimesize, UINT32_PRIMES);
+		vl.composites = (uint32_t *)malloc(st.nmax*sizeof(uint32_t));
+		if( vl.composites == NULL ){
+			fprintf(stderr,"malloc error: verifylist\n");
+			exit(EXIT_FAILURE);
+		}
+		uint32_t csize=0;
+		for(uint32_t i=0,n=45; n<st.nmax; ++n){
+			if(n == allprime[i]){
+				++i;
+				continue;
+			}
+			vl.composites[csize++] = n;
+		}
+		free(allprime);
+		vl.compsize = csize;
 	}
 
-	uint64_t start = st.p;
-	uint64_t stop = start + calc_range;
+	return vl;
+}
 
-	// check overflow at 2^64
-	if(stop < start){
-		stop = 0xFFFFFFFFFFFFFFFF;
-		calc_range = stop - start;
-	}
 
-	sclSetGlobalSize( pd.getsegprimes, (calc_range/60)+1 );
+void freeVerifyList( verifyList & vl ){
+	free(vl.primes);
+	free(vl.composites);
+	vl.primes = NULL;
+	vl.composites = NULL;
+}
 
-	// get a count of primes in the gpu worksize
-	uint64_t range_primes = (stop / log(stop)) - (start / log(start));
 
-	// calculate prime array size based on result
-	uint64_t mem_size = (uint64_t)(1.5 * (double)range_primes);
+// clear the result file, or resume from a checkpoint
+void startSearch( workStatus & st, searchData & sd ){
 
-	// kernels use uint for global id
-	if(mem_size > UINT32_MAX){
-		fprintf(stderr, "ERROR: mem_size too large.\n");
-                printf( "ERROR: mem_size too large.\n" );
-		exit(EXIT_FAILURE);
+	if( sd.test ){
+		// clear result file
+		FILE * temp_file = my_fopen(resultsFile,"w");
+		if (temp_file == NULL){
+			fprintf(stderr,"Cannot open %s !!!\n",resultsFile);
+			exit(EXIT_FAILURE);
+		}
+		fclose(temp_file);
+		// the survivors test case
+		survivorStart(st, resultsFile, false);
 	}
+	else{
+		// Resume from checkpoint if there is one
+		bool resumed = read_state( st, sd );
+		if( resumed ){
+			if(boinc_is_standalone()){
+				printf("Current p: %" PRIu64 "\n", st.p);
+			}
+			fprintf(stderr,"Resuming from checkpoint, current p: %" PRIu64 "\n", st.p);
 
-	// allocate temporary gpu prime array for profiling
-	cl_mem d_profileprime = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, mem_size*sizeof(cl_ulong8), NULL, &err );
-	if ( err != CL_SUCCESS ) {
-		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
-	        printf( "ERROR: clCreateBuffer failure.\n" );
-		exit(EXIT_FAILURE);
+			//trying to resume a finished workunit.  a finished job of a batch is skipped by the caller
+			if( st.p == st.pmax ){
+				if(batchJob){
+					if(boinc_is_standalone()){
+						printf("Job %u complete.\n", batchJob);
+					}
+					fprintf(stderr,"Job %u complete.\n", batchJob);
+					return;
+				}
+				if(boinc_is_standalone()){
+					printf("Workunit complete.\n");
+				}
+				fprintf(stderr,"Workunit complete.\n");
+				boinc_finish(EXIT_SUCCESS);
+			}
+		}
+		// starting from beginning
+		else{
+			// clear result file
+			FILE * temp_file = my_fopen(resultsFile,"w");
+			if (temp_file == NULL){
+				fprintf(stderr,"Cannot open %s !!!\n",resultsFile);
+				exit(EXIT_FAILURE);
+			}
+			fclose(temp_file);
+
+			// setup boinc trickle up
+			st.last_trickle = (uint64_t)time(NULL);
+		}
+
+		// candidates of --survivors, less the ones with a factor found before the checkpoint
+		survivorStart(st, resultsFile, resumed);
 	}
+}
 
-	int32_t wheelidx;
-	uint64_t kernel_start = start;
-	findWheelOffset(kernel_start, wheelidx);
 
-	// set static args
-	sclSetKernelArg(pd.getsegprimes, 0, sizeof(uint64_t), &kernel_start);
-	sclSetKernelArg(pd.getsegprimes, 1, sizeof(uint64_t), &stop);
-	sclSetKernelArg(pd.getsegprimes, 2, sizeof(int32_t), &wheelidx);
-	sclSetKernelArg(pd.getsegprimes, 3, sizeof(cl_mem), &d_profileprime);
-	sclSetKernelArg(pd.getsegprimes, 4, sizeof(cl_mem), &pd.d_primecount);
+// bytes per prime in the gpu prime array
+// combined modes keep 8 words per prime, the other modes store p, q and two words of state
+size_t primeSize( searchData & sd ){
+	if(sd.combined){
+		return sd.mont32 ? sizeof(cl_uint8) : sizeof(cl_ulong8);
+	}
+	return sd.mont32 ? sizeof(cl_uint4) : sizeof(cl_ulong4);
+}
 
-	// zero prime count
-	sclEnqueueKernel(hardware, pd.clearn);
 
-	// Benchmark the GPU
-	double kernel_ms = ProfilesclEnqueueKernel(hardware, pd.getsegprimes);
+// kernels for P < 2^32 have the same name with a 32 suffix
+sclSoft getKernel( cl_program program, const char * name, sclHard hardware, bool mont32 ){
+	if(mont32){
+		char name32[64];
+		snprintf(name32, sizeof(name32), "%s32", name);
+		return sclGetCLKernel(program, name32, hardware);
+	}
+	return sclGetCLKernel(program, name, hardware);
+}
 
-	// target runtime for prime generator kernel is 1.0 ms
-	double prof_multi = 1.0 / kernel_ms;
 
-	// update chunk size based on the profile
-	calc_range = (uint64_t)( (double)calc_range * prof_multi );
+// one program per run, the shared arithmetic followed by the kernel files this run needs.
+// build options select the kernels for the search type and prime size, see common.cl
+cl_program buildProgram( workStatus & st, searchData & sd, sclHard hardware ){
 
-	// limit kernel global size
-	if(calc_range > 4294900000){
-		calc_range = 4294900000;
+	const char * sources[12];
+	int count = 0;
+
+	sources[count++] = common_cl;
+	sources[count++] = clearn_cl;
+	sources[count++] = clearresult_cl;
+	// primes below 114 can't be generated with getsegprimes
+	if(st.pmin < 114){
+		sources[count++] = addsmallprimes_cl;
+	}
+	sources[count++] = getsegprimes_cl;
+	sources[count++] = setup_cl;
+	sources[count++] = iterate_cl;
+	sources[count++] = check_cl;
+	sources[count++] = verifyslow_cl;
+	sources[count++] = verify_cl;
+	sources[count++] = verifyresult_cl;
+	if(sd.retire){
+		sources[count++] = compact_cl;
 	}
 
-	// get a count of primes in the new gpu worksize
-	stop = start + calc_range;
+	size_t len = 1;
+	for(int i = 0; i < count; ++i){
+		len += strlen(sources[i]);
+	}
+	char * source = (char *)malloc(len);
+	if( source == NULL ){
+		fprintf(stderr,"malloc error: program source\n");
+		exit(EXIT_FAILURE);
+	}
+	source[0] = '\0';
+	for(int i = 0; i < count; ++i){
+		strcat(source, sources[i]);
+	}
 
-	// check overflow at 2^64
-	if(stop < start){
-		stop = 0xFFFFFFFFFFFFFFFF;
-		calc_range = stop - start;
+	// run constants, comparisons against them fold away in the setup and check kernels.  P_MIN is capped
+	// at nmax so every range with pmin above nmax gets the same options and the same cached binary
+	char options[256];
+	snprintf(options, sizeof(options), "-D START_N=%uU -D LAST_N=%uU -D P_MIN=%" PRIu64 "UL ",
+		st.nmin-1, st.nmax-1, (st.pmin < st.nmax) ? st.pmin : (uint64_t)st.nmax);
+	if(st.factorial){
+		strcat(options, "-D SEARCH_FACTORIAL=1 ");
+	}
+	if(st.primorial){
+		strcat(options, "-D SEARCH_PRIMORIAL=1 ");
+	}
+	if(st.compositorial){
+		strcat(options, "-D SEARCH_COMPOSITORIAL=1 ");
+	}
+	if(sd.compinv){
+		strcat(options, "-D COMPINV=1 ");
+	}
+	if(sd.mont32){
+		strcat(options, "-D MONT32=1 ");
+	}
+	if(st.pmax >= 0xFFFFFFFFFF000000){
+		strcat(options, "-D CKOVERFLOW=1 ");
+	}
+	if(survivorsActive()){
+		strcat(options, "-D SURVIVORS=1 ");
 	}
 
-	range_primes = (stop / log(stop)) - (start / log(start));
+	cl_program program = sclGetCLProgram(source, "pfcsieve", hardware, options);
 
-	// calculate prime array size based on result
-	mem_size = (uint64_t)( 1.5 * (double)range_primes );
-	// make it a multiple of check kernel's local size
-	mem_size = (mem_size / pd.check.local_size[0]) * pd.check.local_size[0];	
+	free(source);
 
-	if(mem_size > UINT32_MAX){
-		fprintf(stderr, "ERROR: mem_size too large.\n");
-                printf( "ERROR: mem_size too large.\n" );
+	return program;
+}
+
+
+// build the kernels that remove retired primes from the prime array
+void setupCompaction(progData & pd, workStatus & st, searchData & sd, sclHard hardware){
+
+	cl_int err = 0;
+
+	pd.compactclear = sclGetCLKernel(pd.program,"compact_clear",hardware);
+	pd.compactcount = sclGetCLKernel(pd.program,"compact_count",hardware);
+	pd.compactholes = sclGetCLKernel(pd.program,"compact_holes",hardware);
+	pd.compactmove = sclGetCLKernel(pd.program,"compact_move",hardware);
+
+	// kernel has __attribute__ ((reqd_work_group_size(256, 1, 1)))
+	if(pd.compactcount.local_size[0] != 256){
+		pd.compactcount.local_size[0] = 256;
+		fprintf(stderr, "Set compact_count kernel local size to 256\n");
+	}
+
+	// new prime count, hole and move positions, old prime count
+	pd.d_compact = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, 4*sizeof(cl_uint), NULL, &err );
+        if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+                printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+	pd.d_holes = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, sd.psize*sizeof(cl_uint), NULL, &err );
+        if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+                printf( "ERROR: clCreateBuffer failure.\n" );
 		exit(EXIT_FAILURE);
 	}
 
-	sd.range = calc_range;
-	sd.psize = mem_size;
+	sclSetGlobalSize( pd.compactclear, 64 );
+	sclSetGlobalSize( pd.compactcount, sd.psize );
+	sclSetGlobalSize( pd.compactholes, sd.psize );
+	sclSetGlobalSize( pd.compactmove, sd.psize );
 
-	// free temporary array
-	sclReleaseMemObject(d_profileprime);
+	sclSetKernelArg(pd.compactclear, 0, sizeof(cl_mem), &pd.d_compact);
+
+	sclSetKernelArg(pd.compactcount, 1, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.compactcount, 2, sizeof(cl_mem), &pd.d_sum);
+	sclSetKernelArg(pd.compactcount, 3, sizeof(cl_mem), &pd.d_compact);
+
+	sclSetKernelArg(pd.compactholes, 1, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.compactholes, 2, sizeof(cl_mem), &pd.d_sum);
+	sclSetKernelArg(pd.compactholes, 3, sizeof(cl_mem), &pd.d_compact);
+	sclSetKernelArg(pd.compactholes, 4, sizeof(cl_mem), &pd.d_holes);
+
+	sclSetKernelArg(pd.compactmove, 1, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.compactmove, 2, sizeof(cl_mem), &pd.d_compact);
+	sclSetKernelArg(pd.compactmove, 3, sizeof(cl_mem), &pd.d_holes);
 
 }
 
 
-void finalizeResults( workStatus & st ){
+// primes in the segment retire at n in [low, high).  compact the prime array when some of them
+// retired since the last compaction at n = lastn.  currn is the last n applied to the residues.
+void compactPrimes(progData & pd, sclHard hardware, uint64_t & lastn, uint64_t currn, uint64_t low, uint64_t high){
 
-	char line[256];
-	uint32_t lc = 0;
-	FILE * resfile;
+	if(currn <= lastn || currn < low || lastn >= high){
+		return;
+	}
 
-	if(st.factorcount){
-		// check result file has the same number of lines as the factor count
-		resfile = my_fopen(RESULTS_FILENAME,"r");
+	sclEnqueueKernel(hardware, pd.compactclear);
+	sclEnqueueKernel(hardware, pd.compactcount);
+	sclEnqueueKernel(hardware, pd.compactholes);
+	sclEnqueueKernel(hardware, pd.compactmove);
 
-		if(resfile == NULL){
-			fprintf(stderr,"Cannot open %s !!!\n",RESULTS_FILENAME);
-			exit(EXIT_FAILURE);
-		}
+	lastn = currn;
+}
 
-		while(fgets(line, sizeof(line), resfile) != NULL) {
-			++lc;
-		}
 
-		fclose(resfile);
+// primes from 127 to bound, sieved in local memory by the getsegprimes kernel
+uint32_t presieveCount(uint32_t bound){
+	return (bound < 127) ? 0 : (uint32_t)primesieve_count_primes(127, bound);
+}
 
-		if(lc < st.factorcount){
-			fprintf(stderr,"ERROR: Missing factors in %s !!!\n",RESULTS_FILENAME);
-			printf("ERROR: Missing factors in %s !!!\n",RESULTS_FILENAME);
-			exit(EXIT_FAILURE);
+// multiplicative order of 2 mod prime p
+uint32_t orderTwo(uint32_t p){
+	uint32_t ord = p-1;
+	uint32_t f = p-1;
+	for(uint32_t q = 2; q <= f; ++q){
+		if(f % q) continue;
+		while(f % q == 0) f /= q;
+		while(ord % q == 0){
+			// 2^(ord/q) mod p
+			uint64_t r = 1, b = 2;
+			for(uint32_t e = ord/q; e; e >>= 1){
+				if(e & 1) r = (r * b) % p;
+				b = (b * b) % p;
+			}
+			if(r != 1) break;
+			ord /= q;
 		}
 	}
+	return ord;
+}
 
-	// print checksum
-	resfile = my_fopen(RESULTS_FILENAME,"a");
 
-	if(resfile == NULL){
-		fprintf(stderr,"Cannot open %s !!!\n",RESULTS_FILENAME);
-		exit(EXIT_FAILURE);
-	}
+// size the getsegprimes local memory array from the expected count of numbers a work-group has left after the
+// presieve.  work-groups with more numbers than this stage them in waves.
+void setStaging(progData & pd, searchData & sd, uint32_t bound, uint64_t stop){
 
-	if(st.factorcount){
-		if( fprintf( resfile, "%016" PRIX64 "\n", st.checksum ) < 0 ){
-			fprintf(stderr,"Cannot write to %s !!!\n",RESULTS_FILENAME);
-			exit(EXIT_FAILURE);
-		}
-	}
-	else{
-		if( fprintf( resfile, "no factors\n%016" PRIX64 "\n", st.checksum ) < 0 ){
-			fprintf(stderr,"Cannot write to %s !!!\n",RESULTS_FILENAME);
-			exit(EXIT_FAILURE);
+	// primes above sqrt(stop) don't remove anything
+	uint64_t limit = (uint64_t)sqrt((double)stop);
+	if(limit < bound) bound = (uint32_t)limit;
+	if(bound < 113) bound = 113;
+
+	if(bound != pd.stagingbound){
+		// the mod 30 wheel leaves 8 of 30 numbers
+		double density = 8.0 / 30.0;
+		size_t size = 0;
+		uint32_t * sp = (uint32_t*)primesieve_generate_primes(7, bound, &size, UINT32_PRIMES);
+		for(size_t i = 0; i < size; ++i){
+			density *= 1.0 - 1.0 / (double)sp[i];
 		}
+		primesieve_free(sp);
+
+		// 15360 numbers per work-group, 10% margin, multiple of the work-group size
+		uint32_t staging = (uint32_t)(15360.0 * density * 1.1);
+		staging = ((staging / 256) + 1) * 256;
+		if(staging > 2048) staging = 2048;
+		pd.stagingbound = bound;
+		pd.staging = staging;
 	}
 
-	fclose(resfile);
+	size_t element = sd.mont32 ? sizeof(cl_uint) : sizeof(cl_ulong);
+	sclSetKernelArg(pd.getsegprimes, 7, pd.staging*element, NULL);
+	sclSetKernelArg(pd.getsegprimes, 8, sizeof(uint32_t), &pd.staging);
 }
 
-cl_uint2 getPower(uint32_t prime, uint32_t startN){
-	uint32_t totalpower = 0;
-	uint64_t currp = prime;
-	uint32_t q = startN / currp;
-	while(true){
-		totalpower += q;
-		currp = currp * prime;
-		if(currp > startN)break;
-		q = startN / currp;
-	}
-	uint32_t curBit = 0x80000000;
-	if(totalpower > 1){
-		curBit >>= ( __builtin_clz(totalpower) + 1 );
-	}
-	return (cl_uint2){totalpower, curBit};
-}
 
-// factorial power table
-void setupPowerTable(progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint32_t * h_primecount ){
+// feedback from a sampled launch of size work items, chunk sizes follow the kernel cost as it drifts during
+// the run.  a slow launch shrinks the step at once so the display stays responsive, a fast launch grows it
+// by at most 1.5x per sample.  launches within 10% of the target leave the step alone.
+void retuneStep(uint32_t & step, uint32_t size, double ms, double target){
 
-	cl_int err = 0;
-	uint32_t stride = 2560000;
-	uint32_t start_factorial = st.nmin-1;
+	if(ms <= 0.0){
+		return;
+	}
 
-	// generate primes for power table
-	size_t primelistsize;
-	uint32_t *smprime = (uint32_t*)primesieve_generate_primes(2, start_factorial, &primelistsize, UINT32_PRIMES);
-	uint64_t tablesize = primelistsize*8;	// cl_ulong or cl_uint2
-	cl_uint2 * smpower = (cl_uint2 *)malloc(tablesize);
-	if( smpower == NULL ){
-		fprintf(stderr,"malloc error: smpower\n");
-		exit(EXIT_FAILURE);
+	double ratio = target / ms;
+	if(ratio > 0.9 && ratio < 1.1){
+		return;
 	}
-	for(uint32_t i=0; i<primelistsize; ++i){
-		smpower[i] = getPower(smprime[i], start_factorial);
+	if(ratio > 1.0){
+		ratio = sqrt(ratio);
+		if(ratio > 1.5) ratio = 1.5;
 	}
-	cl_ulong * h_prime = (cl_ulong *)malloc(tablesize);
-	if( h_prime == NULL ){
-		fprintf(stderr,"malloc error: h_prime\n");
-		exit(EXIT_FAILURE);
+	else if(ratio < 0.5){
+		ratio = 0.5;
 	}
-	cl_uint2 * h_power = (cl_uint2 *)malloc(tablesize);
-	if( h_power == NULL ){
-		fprintf(stderr,"malloc error: h_power\n");
-		exit(EXIT_FAILURE);
+
+	uint32_t new_step = (uint32_t)( ratio * (double)size );
+	if(!new_step) new_step=1;
+	step = new_step;
+}
+
+
+// end of the segment of size range starting at p
+uint64_t segmentStop(workStatus & st, uint64_t range, uint64_t p){
+	uint64_t stop = p + range;
+	if(stop > st.pmax || stop < p){
+		// ck overflow
+		stop = st.pmax;
 	}
+	return stop;
+}
 
-	// compress the power table by combining primes with the same power
-	// skip prime = 2
-	h_prime[0] = smprime[0];
-	h_power[0] = smpower[0];
-	uint32_t m=1;
-	for(uint32_t i=1; i<primelistsize; ++m){
-		h_prime[m] = smprime[i];
-		h_power[m] = smpower[i];
-		for(++i; i<primelistsize && h_power[m].s0 == smpower[i].s0; ++i){
-			unsigned __int128 pp = (unsigned __int128)h_prime[m] * smprime[i];
-			if(pp > 0xFFFFFFFFFFFFFFFF) break;
-			h_prime[m] = pp;
-		}
+
+// segments alternate between two prime buffers.  the primes of the next segment are generated on the prime
+// queue while the compute queue runs setup and iterate on the current one.  events order the two queues:
+// a buffer is refilled once the compute queue finished the segment before, and is used once it is full.
+void generatePrimes(progData & pd, searchData & sd, sclHard hardware, uint64_t start, uint64_t stop, int b){
+
+	cl_int err;
+	sclHard primehw = hardware;
+	primehw.queue = pd.primequeue;
+
+	// clear prime count.  the prime queue is in order, the rest of the segment waits for this kernel
+	sclSetKernelArg(pd.clearn, 0, sizeof(cl_mem), &pd.d_segcount[b]);
+	if(pd.computedone[b] != NULL){
+		sclEnqueueKernelWait(primehw, pd.clearn, 1, &pd.computedone[b]);
+		clReleaseEvent(pd.computedone[b]);
+		pd.computedone[b] = NULL;
 	}
-	free(smprime);
-	free(smpower);
-	sd.powcount = m;
-	fprintf(stderr,"Compressed %u power table terms to %u\n",(uint32_t)primelistsize,m);
-	if(boinc_is_standalone()){
-		printf("Compressed %u power table terms to %u\n",(uint32_t)primelistsize,m);
+	else{
+		sclEnqueueKernel(primehw, pd.clearn);
 	}
 
-	// send read only prime/power tables to gpu
-	tablesize = (uint64_t)m*8;	// cl_ulong or cl_uint2
-	if( sd.maxmalloc < tablesize ){
-		fprintf(stderr, "ERROR: power table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
-                printf( "ERROR: power table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
-		exit(EXIT_FAILURE);
+	// add small primes that cannot be generated with getsegprimes kernel
+	if(start < 114){
+		uint64_t stop_sm = (stop > 114) ? 114 : stop;
+		sclSetKernelArg(pd.addsmallprimes, 0, sizeof(uint64_t), &start);
+		sclSetKernelArg(pd.addsmallprimes, 1, sizeof(uint64_t), &stop_sm);
+		sclSetKernelArg(pd.addsmallprimes, 2, sizeof(cl_mem), &pd.d_primebuf[b]);
+		sclSetKernelArg(pd.addsmallprimes, 3, sizeof(cl_mem), &pd.d_segcount[b]);
+		sclEnqueueKernel(primehw, pd.addsmallprimes);
+		start = stop_sm;
 	}
-	pd.d_primeproducts = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, tablesize, NULL, &err );
+
+	// get a segment of primes (2-PRPs).  very fast, target kernel time is 1ms
+	int32_t wheelidx;
+	uint64_t kernel_start = start;
+	findWheelOffset(kernel_start, wheelidx);
+
+	sclSetKernelArg(pd.getsegprimes, 0, sizeof(uint64_t), &kernel_start);
+	sclSetKernelArg(pd.getsegprimes, 1, sizeof(uint64_t), &stop);
+	sclSetKernelArg(pd.getsegprimes, 2, sizeof(int32_t), &wheelidx);
+	sclSetKernelArg(pd.getsegprimes, 3, sizeof(cl_mem), &pd.d_primebuf[b]);
+	sclSetKernelArg(pd.getsegprimes, 4, sizeof(cl_mem), &pd.d_segcount[b]);
+	setStaging(pd, sd, sd.presieve, stop);
+	sclEnqueueKernel(primehw, pd.getsegprimes);
+
+	err = clEnqueueMarker(pd.primequeue, &pd.primesready[b]);
 	if ( err != CL_SUCCESS ) {
-		fprintf(stderr, "ERROR: clCreateBuffer failure: primeproducts array\n");
-		printf( "ERROR: clCreateBuffer failure.\n" );
-		exit(EXIT_FAILURE);
+		printf( "ERROR: clEnqueueMarker\n");
+		fprintf(stderr, "ERROR: clEnqueueMarker\n");
+		sclPrintErrorFlags(err);
 	}
-	pd.d_powers = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, tablesize, NULL, &err );
+
+	err = clFlush(pd.primequeue);
 	if ( err != CL_SUCCESS ) {
-		fprintf(stderr, "ERROR: clCreateBuffer failure: Powers array.\n");
-		printf( "ERROR: clCreateBuffer failure.\n" );
-		exit(EXIT_FAILURE);
+		printf( "ERROR: clFlush\n" );
+		fprintf(stderr, "ERROR: clFlush\n" );
+		sclPrintErrorFlags( err );
 	}
-	sclWriteNB(hardware, tablesize, pd.d_primeproducts, h_prime);
-	sclWrite(hardware, tablesize, pd.d_powers, h_power);
-	free(h_prime);
-	free(h_power);
+}
 
-	// build kernels
-	pd.verifyslow = sclGetCLSoftware(verifyslow_cl,"factorial_verifyslow",hardware, NULL);
-	pd.verify = sclGetCLSoftware(verify_cl,"factorial_verify",hardware, NULL);
-	if(pd.verifyslow.local_size[0] != 256){
-		pd.verifyslow.local_size[0] = 256;
-		fprintf(stderr, "Set verifyslow kernel local size to 256\n");
+
+// point the search kernels at prime buffer b
+void bindPrimes(progData & pd, workStatus & st, searchData & sd, int b){
+
+	pd.d_primes = pd.d_primebuf[b];
+	sclSetKernelArg(pd.setup, 0, sizeof(cl_mem), &pd.d_primes);
+	if(st.factorial && !st.compositorial){
+		sclSetKernelArg(pd.reflect, 0, sizeof(cl_mem), &pd.d_primes);
 	}
-	if(pd.verify.local_size[0] != 256){
-		pd.verify.local_size[0] = 256;
-		fprintf(stderr, "Set verify kernel local size to 256\n");
+	sclSetKernelArg(pd.iterate, 0, sizeof(cl_mem), &pd.d_primes);
+	sclSetKernelArg(pd.check, 0, sizeof(cl_mem), &pd.d_primes);
+	if(sd.retire){
+		sclSetKernelArg(pd.compactcount, 0, sizeof(cl_mem), &pd.d_primes);
+		sclSetKernelArg(pd.compactholes, 0, sizeof(cl_mem), &pd.d_primes);
+		sclSetKernelArg(pd.compactmove, 0, sizeof(cl_mem), &pd.d_primes);
 	}
+}
 
-	// verify the new power table
-	sclSetGlobalSize( pd.verifyslow, stride );
-	sclSetGlobalSize( pd.verify, stride );
-	uint32_t ver_groups = stride / 256;				// 10000
-	sclSetGlobalSize( pd.verifyreduce, ver_groups );
-	uint32_t red_groups = (ver_groups / 256)+1;			// 40
-	sclSetGlobalSize( pd.verifyresult, red_groups );
-	cl_mem d_verify = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, ver_groups*sizeof(cl_ulong4), NULL, &err );
-        if ( err != CL_SUCCESS ) {
-		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
-                printf( "ERROR: clCreateBuffer failure.\n" );
-		exit(EXIT_FAILURE);
-	}
 
-	sclSetKernelArg(pd.verifyslow, 0, sizeof(cl_mem), &d_verify);
-	sclSetKernelArg(pd.verifyslow, 1, sizeof(uint32_t), &start_factorial);
+// wait for prime buffer b on the compute queue and point the search kernels at it
+void usePrimes(progData & pd, workStatus & st, searchData & sd, sclHard hardware, int b){
 
-	sclSetKernelArg(pd.verify, 0, sizeof(cl_mem), &pd.d_primeproducts);
-	sclSetKernelArg(pd.verify, 1, sizeof(cl_mem), &pd.d_powers);
-	sclSetKernelArg(pd.verify, 2, sizeof(cl_mem), &d_verify);
-	sclSetKernelArg(pd.verify, 3, sizeof(uint32_t), &sd.powcount);
+	// the search kernels and compaction keep the segment's prime count in d_primecount[0].
+	// the copy waits for the prime queue, the compute queue is in order so the search waits for the copy.
+	cl_int err = clEnqueueCopyBuffer(hardware.queue, pd.d_segcount[b], pd.d_primecount, 0, 0, sizeof(cl_uint), 1, &pd.primesready[b], NULL);
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clEnqueueCopyBuffer\n" );
+		fprintf(stderr, "ERROR: clEnqueueCopyBuffer\n" );
+		sclPrintErrorFlags( err );
+	}
+	clReleaseEvent(pd.primesready[b]);
+	pd.primesready[b] = NULL;
 
-	sclSetKernelArg(pd.verifyreduce, 0, sizeof(cl_mem), &d_verify);
-	sclSetKernelArg(pd.verifyreduce, 1, sizeof(uint32_t), &ver_groups);
+	bindPrimes(pd, st, sd, b);
+}
 
-	sclSetKernelArg(pd.verifyresult, 0, sizeof(cl_mem), &d_verify);
-	sclSetKernelArg(pd.verifyresult, 1, sizeof(cl_mem), &pd.d_primecount);
-	sclSetKernelArg(pd.verifyresult, 2, sizeof(uint32_t), &red_groups);
 
-	sclEnqueueKernel(hardware, pd.verifyslow);
-	sclEnqueueKernel(hardware, pd.verify);
-	sclEnqueueKernel(hardware, pd.verifyreduce);
-	sclEnqueueKernel(hardware, pd.verifyresult);
+// copy prime buffer b of the batch job that generates the primes into this job's buffer b.  the setup
+// kernels keep residues in the prime array, so each job searches its own copy.  a single mode job
+// only takes p and q from the generator's combined layout, setup overwrites the other two words.
+// the generator searches each segment after the jobs copying from it, it waits for and releases the event.
+void copyPrimes(deviceData & dev, workStatus & st, int b){
+
+	cl_int err;
+	progData & pd = dev.pd;
+	progData & gen = dev.source->pd;
+	sclHard hardware = dev.hardware;
+
+	// the first copy waits for the generator's prime queue, the segment count copy and the search follow it in order
+	const size_t gensize = primeSize(dev.source->sd);
+	const size_t size = primeSize(dev.sd);
+	if(gensize == size){
+		err = clEnqueueCopyBuffer(hardware.queue, gen.d_primebuf[b], pd.d_primebuf[b], 0, 0, dev.sd.psize*size, 1, &gen.primesready[b], NULL);
+	}
+	else{
+		const size_t origin[3] = {0, 0, 0};
+		const size_t region[3] = {size/2, dev.sd.psize, 1};
+		err = clEnqueueCopyBufferRect(hardware.queue, gen.d_primebuf[b], pd.d_primebuf[b], origin, origin, region,
+			gensize, 0, size, 0, 1, &gen.primesready[b], NULL);
+	}
+	if ( err == CL_SUCCESS ) {
+		err = clEnqueueCopyBuffer(hardware.queue, gen.d_segcount[b], pd.d_primecount, 0, 0, sizeof(cl_uint), 0, NULL, NULL);
+	}
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clEnqueueCopyBuffer\n" );
+		fprintf(stderr, "ERROR: clEnqueueCopyBuffer\n" );
+		sclPrintErrorFlags( err );
+	}
+
+	bindPrimes(pd, st, dev.sd, b);
+}
+
+
+// compute queue is done with prime buffer b once the check kernel has run
+void releasePrimes(progData & pd, sclHard hardware, int b){
+
+	cl_int err = clEnqueueMarker(hardware.queue, &pd.computedone[b]);
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clEnqueueMarker\n");
+		fprintf(stderr, "ERROR: clEnqueueMarker\n");
+		sclPrintErrorFlags(err);
+	}
+}
+
+
+void setupPresieve(progData & pd, searchData & sd, sclHard hardware){
+
+	cl_int err = 0;
+	size_t size = 0;
+
+	uint32_t * h_sieveprimes = NULL;
+	uint32_t bound = sd.presieve ? sd.presieve : PRESIEVE_MAX;
+	if(bound >= 127){
+		h_sieveprimes = (uint32_t*)primesieve_generate_primes(127, bound, &size, UINT32_PRIMES);
+	}
+
+	pd.d_sieveprimes = clCreateBuffer(hardware.context, CL_MEM_READ_ONLY, (size ? size : 1)*sizeof(cl_uint2), NULL, &err);
+	if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure: d_sieveprimes array.\n");
+		printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+	if(size){
+		// prime and order of 2
+		cl_uint2 * h_presieve = (cl_uint2 *)malloc(size*sizeof(cl_uint2));
+		if( h_presieve == NULL ){
+			fprintf(stderr,"malloc error: h_presieve\n");
+			exit(EXIT_FAILURE);
+		}
+		for(size_t i = 0; i < size; ++i){
+			h_presieve[i].s[0] = h_sieveprimes[i];
+			h_presieve[i].s[1] = orderTwo(h_sieveprimes[i]);
+		}
+		sclWrite(hardware, size*sizeof(cl_uint2), pd.d_sieveprimes, h_presieve);
+		free(h_presieve);
+		primesieve_free(h_sieveprimes);
+	}
+	sd.sievecount = (uint32_t)size;
+}
+
+
+// prime array size for a segment of range at start, 1.5 times the estimated prime count as a multiple of
+// the check kernel's local size.  range is limited to the kernel global size and to 2^64.
+uint32_t primeArraySize(progData & pd, uint64_t start, uint64_t & range){
+
+	// limit kernel global size
+	if(range > 4294900000){
+		range = 4294900000;
+	}
+
+	uint64_t stop = start + range;
+
+	// check overflow at 2^64
+	if(stop < start){
+		stop = 0xFFFFFFFFFFFFFFFF;
+		range = stop - start;
+	}
+
+	uint64_t range_primes = (stop / log(stop)) - (start / log(start));
+
+	uint64_t mem_size = (uint64_t)( 1.5 * (double)range_primes );
+	mem_size = (mem_size / pd.check.local_size[0]) * pd.check.local_size[0];
+
+	if(mem_size > UINT32_MAX){
+		fprintf(stderr, "ERROR: mem_size too large.\n");
+                printf( "ERROR: mem_size too large.\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	return (uint32_t)mem_size;
+}
+
+
+void profileGPU(progData & pd, workStatus & st, searchData & sd, sclHard hardware, bool tuned){
+
+	sclSetKernelArg(pd.getsegprimes, 5, sizeof(cl_mem), &pd.d_sieveprimes);
+
+	// range and presieve bound from the tuning database.  the stored prime array size can be short
+	// at a lower p of the same bucket, it is checked against this run's p.
+	if(tuned){
+		uint64_t range = sd.range;
+		uint32_t psize = primeArraySize(pd, st.p, range);
+		sd.range = (uint32_t)range;
+		if(psize > sd.psize) sd.psize = psize;
+		sclSetKernelArg(pd.getsegprimes, 6, sizeof(uint32_t), &sd.sievecount);
+		fprintf(stderr,"Prime generator presieve bound: %u\n", sd.presieve);
+		if(boinc_is_standalone()){
+			printf("Prime generator presieve bound: %u\n", sd.presieve);
+		}
+		return;
+	}
+
+	// calculate approximate chunk size based on gpu's compute units
+	cl_int err = 0;
+
+	uint64_t calc_range = sd.computeunits * (uint64_t)350000;
+
+	// limit kernel global size
+	if(calc_range > 4294900000){
+		calc_range = 4294900000;
+	}
+
+	uint64_t start = st.p;
+	uint64_t stop = start + calc_range;
+
+	// check overflow at 2^64
+	if(stop < start){
+		stop = 0xFFFFFFFFFFFFFFFF;
+		calc_range = stop - start;
+	}
+
+	sclSetGlobalSize( pd.getsegprimes, (calc_range/60)+1 );
+
+	// get a count of primes in the gpu worksize
+	uint64_t range_primes = (stop / log(stop)) - (start / log(start));
+
+	// calculate prime array size based on result
+	uint64_t mem_size = (uint64_t)(1.5 * (double)range_primes);
+
+	// kernels use uint for global id
+	if(mem_size > UINT32_MAX){
+		fprintf(stderr, "ERROR: mem_size too large.\n");
+                printf( "ERROR: mem_size too large.\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	// allocate temporary gpu prime array for profiling
+	cl_mem d_profileprime = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, mem_size*primeSize(sd), NULL, &err );
+	if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+	        printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	int32_t wheelidx;
+	uint64_t kernel_start = start;
+	findWheelOffset(kernel_start, wheelidx);
+
+	// set static args
+	sclSetKernelArg(pd.getsegprimes, 0, sizeof(uint64_t), &kernel_start);
+	sclSetKernelArg(pd.getsegprimes, 1, sizeof(uint64_t), &stop);
+	sclSetKernelArg(pd.getsegprimes, 2, sizeof(int32_t), &wheelidx);
+	sclSetKernelArg(pd.getsegprimes, 3, sizeof(cl_mem), &d_profileprime);
+	sclSetKernelArg(pd.getsegprimes, 4, sizeof(cl_mem), &pd.d_primecount);
+
+	double kernel_ms;
+
+	if(sd.presieve){
+		sclSetKernelArg(pd.getsegprimes, 6, sizeof(uint32_t), &sd.sievecount);
+		setStaging(pd, sd, sd.presieve, stop);
+		sclEnqueueKernel(hardware, pd.clearn);
+		kernel_ms = ProfilesclEnqueueKernel(hardware, pd.getsegprimes);
+	}
+	else{
+		// time the same range at each presieve bound and keep the fastest.  a deeper presieve removes
+		// more PRP tests but costs more local memory atomics, the best bound depends on the device.
+		const uint32_t bounds[6] = {113, 500, 1000, 2000, 4000, 8000};
+		uint32_t sievecount = 0;
+
+		// warm up
+		sclSetKernelArg(pd.getsegprimes, 6, sizeof(uint32_t), &sievecount);
+		setStaging(pd, sd, 113, stop);
+		sclEnqueueKernel(hardware, pd.clearn);
+		ProfilesclEnqueueKernel(hardware, pd.getsegprimes);
+
+		kernel_ms = 0.0;
+		for(uint32_t i = 0; i < 6; ++i){
+			sievecount = presieveCount(bounds[i]);
+			sclSetKernelArg(pd.getsegprimes, 6, sizeof(uint32_t), &sievecount);
+			setStaging(pd, sd, bounds[i], stop);
+			sclEnqueueKernel(hardware, pd.clearn);
+			double ms = ProfilesclEnqueueKernel(hardware, pd.getsegprimes);
+			if(i == 0 || ms < kernel_ms){
+				kernel_ms = ms;
+				sd.presieve = bounds[i];
+				sd.sievecount = sievecount;
+			}
+		}
+		sclSetKernelArg(pd.getsegprimes, 6, sizeof(uint32_t), &sd.sievecount);
+	}
+
+	fprintf(stderr,"Prime generator presieve bound: %u\n", sd.presieve);
+	if(boinc_is_standalone()){
+		printf("Prime generator presieve bound: %u\n", sd.presieve);
+	}
+
+	// target runtime for prime generator kernel is 1.0 ms
+	double prof_multi = 1.0 / kernel_ms;
+
+	// update chunk size based on the profile
+	calc_range = (uint64_t)( (double)calc_range * prof_multi );
+
+	sd.psize = primeArraySize(pd, start, calc_range);
+	sd.range = calc_range;
+
+	// free temporary array
+	sclReleaseMemObject(d_profileprime);
+
+}
+
+
+void finalizeResults( workStatus & st ){
+
+	char line[256];
+	uint32_t lc = 0;
+	FILE * resfile;
+
+	if(st.factorcount){
+		// check result file has the same number of lines as the factor count
+		resfile = my_fopen(resultsFile,"r");
+
+		if(resfile == NULL){
+			fprintf(stderr,"Cannot open %s !!!\n",resultsFile);
+			exit(EXIT_FAILURE);
+		}
+
+		while(fgets(line, sizeof(line), resfile) != NULL) {
+			++lc;
+		}
+
+		fclose(resfile);
+
+		if(lc < st.factorcount){
+			fprintf(stderr,"ERROR: Missing factors in %s !!!\n",resultsFile);
+			printf("ERROR: Missing factors in %s !!!\n",resultsFile);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// print checksum
+	resfile = my_fopen(resultsFile,"a");
+
+	if(resfile == NULL){
+		fprintf(stderr,"Cannot open %s !!!\n",resultsFile);
+		exit(EXIT_FAILURE);
+	}
+
+	if(st.factorcount){
+		if( fprintf( resfile, "%016" PRIX64 "\n", st.checksum ) < 0 ){
+			fprintf(stderr,"Cannot write to %s !!!\n",resultsFile);
+			exit(EXIT_FAILURE);
+		}
+	}
+	else{
+		if( fprintf( resfile, "no factors\n%016" PRIX64 "\n", st.checksum ) < 0 ){
+			fprintf(stderr,"Cannot write to %s !!!\n",resultsFile);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	fclose(resfile);
+}
+
+// power of prime in startN!
+uint32_t getPower(uint32_t prime, uint32_t startN){
+	uint32_t totalpower = 0;
+	uint64_t currp = prime;
+	uint32_t q = startN / currp;
+	while(true){
+		totalpower += q;
+		currp = currp * prime;
+		if(currp > startN)break;
+		q = startN / currp;
+	}
+	return totalpower;
+}
+
+// compressed bit-sliced factorial power table for (nmin-1)!
+// (nmin-1)! is the product over bits b of P_b^(2^b), where P_b is the product of the primes with bit b set in their power.
+// terms are ordered from the highest bit down so the device evaluates the table with one squaring chain:
+// square the residue .s1 times, then multiply by the term.  .s0 = b
+// with composite set each power is one less, the table is for (nmin-1)!/#
+// returns the number of table terms
+uint32_t buildPowerTable( workStatus & st, cl_ulong ** table, cl_uint2 ** powers, bool composite ){
+
+	uint32_t start_factorial = st.nmin-1;
+
+	// generate primes for power table
+	size_t primelistsize;
+	uint32_t *smprime = (uint32_t*)primesieve_generate_primes(2, start_factorial, &primelistsize, UINT32_PRIMES);
+	uint32_t * smpower = (uint32_t *)malloc(primelistsize*sizeof(uint32_t));
+	if( smpower == NULL ){
+		fprintf(stderr,"malloc error: smpower\n");
+		exit(EXIT_FAILURE);
+	}
+	uint64_t maxterms = 1;
+	for(uint32_t i=0; i<primelistsize; ++i){
+		smpower[i] = getPower(smprime[i], start_factorial) - composite;
+		maxterms += __builtin_popcount(smpower[i]);
+	}
+	cl_ulong * h_prime = (cl_ulong *)malloc(maxterms*sizeof(cl_ulong));
+	if( h_prime == NULL ){
+		fprintf(stderr,"malloc error: h_prime\n");
+		exit(EXIT_FAILURE);
+	}
+	cl_uint2 * h_power = (cl_uint2 *)malloc(maxterms*sizeof(cl_uint2));
+	if( h_power == NULL ){
+		fprintf(stderr,"malloc error: h_power\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// 2 has the largest power
+	int32_t topbit = smpower[0] ? 31 - __builtin_clz(smpower[0]) : 0;
+	uint32_t m=0;
+	uint32_t squarings = 0;
+	for(int32_t b=topbit; b>=0; --b){
+		const uint32_t bit = 1u << b;
+		uint32_t i=0;
+		while(i<primelistsize){
+			// compress primes with this bit set into 64 bit products
+			for(; i<primelistsize && !(smpower[i] & bit); ++i);
+			if(i == primelistsize) break;
+			h_prime[m] = smprime[i];
+			for(++i; i<primelistsize; ++i){
+				if(!(smpower[i] & bit)) continue;
+				unsigned __int128 pp = (unsigned __int128)h_prime[m] * smprime[i];
+				if(pp > 0xFFFFFFFFFFFFFFFF) break;
+				h_prime[m] = pp;
+			}
+			h_power[m] = (cl_uint2){(uint32_t)b, squarings};
+			squarings = 0;
+			++m;
+		}
+		if(b) ++squarings;
+	}
+	// finish the squaring chain if bit 0 had no primes
+	if(squarings || !m){
+		h_prime[m] = 1;
+		h_power[m] = (cl_uint2){0, squarings};
+		++m;
+	}
+	free(smprime);
+	free(smpower);
+	fprintf(stderr,"Compressed %u power table primes to %u bit-sliced terms\n",(uint32_t)primelistsize,m);
+	if(boinc_is_standalone()){
+		printf("Compressed %u power table primes to %u bit-sliced terms\n",(uint32_t)primelistsize,m);
+	}
+
+	*table = h_prime;
+	*powers = h_power;
+
+	return m;
+}
+
+// factorial power table
+void setupPowerTable(progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint32_t * h_primecount ){
+
+	cl_int err = 0;
+	uint32_t stride = 2560000;
+	uint32_t start_factorial = st.nmin-1;
+
+	cl_ulong * h_prime;
+	cl_uint2 * h_power;
+	sd.powcount = buildPowerTable(st, &h_prime, &h_power, sd.compinv);
+	uint32_t m = sd.powcount;
+
+	// send read only prime/power tables to gpu
+	uint64_t tablesize = (uint64_t)m*8;	// cl_ulong or cl_uint2
+	if( sd.maxmalloc < tablesize ){
+		fprintf(stderr, "ERROR: power table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
+                printf( "ERROR: power table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
+		exit(EXIT_FAILURE);
+	}
+	pd.d_primeproducts = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, tablesize, NULL, &err );
+	if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure: primeproducts array\n");
+		printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+	pd.d_powers = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, tablesize, NULL, &err );
+	if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure: Powers array.\n");
+		printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+	sclWriteNB(hardware, tablesize, pd.d_primeproducts, h_prime);
+	sclWrite(hardware, tablesize, pd.d_powers, h_power);
+	free(h_prime);
+	free(h_power);
+
+	// table verification kernels
+	pd.verifyslow = sclGetCLKernel(pd.program,"factorial_verifyslow",hardware);
+	pd.verify = sclGetCLKernel(pd.program,"factorial_verify",hardware);
+	if(pd.verifyslow.local_size[0] != 256){
+		pd.verifyslow.local_size[0] = 256;
+		fprintf(stderr, "Set verifyslow kernel local size to 256\n");
+	}
+	if(pd.verify.local_size[0] != 256){
+		pd.verify.local_size[0] = 256;
+		fprintf(stderr, "Set verify kernel local size to 256\n");
+	}
+
+	// verify the new power table
+	sclSetGlobalSize( pd.verifyslow, stride );
+	sclSetGlobalSize( pd.verify, stride );
+	uint32_t ver_groups = stride / 256;				// 10000
+	sclSetGlobalSize( pd.verifyreduce, ver_groups );
+	uint32_t red_groups = (ver_groups / 256)+1;			// 40
+	sclSetGlobalSize( pd.verifyresult, red_groups );
+	cl_mem d_verify = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, ver_groups*sizeof(cl_ulong4), NULL, &err );
+        if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+                printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	sclSetKernelArg(pd.verifyslow, 0, sizeof(cl_mem), &d_verify);
+	sclSetKernelArg(pd.verifyslow, 1, sizeof(uint32_t), &start_factorial);
+
+	sclSetKernelArg(pd.verify, 0, sizeof(cl_mem), &pd.d_primeproducts);
+	sclSetKernelArg(pd.verify, 1, sizeof(cl_mem), &pd.d_powers);
+	sclSetKernelArg(pd.verify, 2, sizeof(cl_mem), &d_verify);
+	sclSetKernelArg(pd.verify, 3, sizeof(uint32_t), &sd.powcount);
+
+	sclSetKernelArg(pd.verifyreduce, 0, sizeof(cl_mem), &d_verify);
+	sclSetKernelArg(pd.verifyreduce, 1, sizeof(uint32_t), &ver_groups);
+
+	sclSetKernelArg(pd.verifyresult, 0, sizeof(cl_mem), &d_verify);
+	sclSetKernelArg(pd.verifyresult, 1, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.verifyresult, 2, sizeof(uint32_t), &red_groups);
+
+	sclEnqueueKernel(hardware, pd.verifyslow);
+	sclEnqueueKernel(hardware, pd.verify);
+	sclEnqueueKernel(hardware, pd.verifyreduce);
+	sclEnqueueKernel(hardware, pd.verifyresult);
 
 	// copy verification flag to host memory, blocking
 	sclRead(hardware, 6*sizeof(uint32_t), pd.d_primecount, h_primecount);
@@ -978,68 +1814,95 @@ void setupPowerTable(progData & pd, workStatus & st, searchData & sd, sclHard ha
 
 	sclSetKernelArg(pd.setup, 2, sizeof(cl_mem), &pd.d_primeproducts);
 	sclSetKernelArg(pd.setup, 5, sizeof(cl_mem), &pd.d_powers);
-	sclSetKernelArg(pd.setup, 6, sizeof(uint32_t), &start_factorial);
 
 	sd.nlimit = st.nmax;
 }
 
-// primorial product and prime tables
-void setupPrimeProducts(progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint32_t * h_primecount ){
+// compress a list of primes or composites into 128 bit products
+// returns the number of products
+uint32_t packProducts( const uint32_t * list, size_t listsize, cl_ulong2 * table ){
+	uint32_t m=0;
+	for(size_t i=0; i<listsize; ++m){
+		unsigned __int128 pp = list[i];
+		for(++i; i<listsize; ++i){
+			if(pp > ~((unsigned __int128)0) / list[i]) break;
+			pp *= list[i];
+		}
+		table[m] = (cl_ulong2){(uint64_t)pp, (uint64_t)(pp >> 64)};
+	}
+	return m;
+}
+
+// compressed primorial product table for (nmin-1)#
+// returns the number of products, smsize is set to the number of primes in the table
+uint32_t buildPrimeProducts( workStatus & st, cl_ulong2 ** table, size_t & smsize ){
 
-	cl_int err = 0;
-	uint32_t stride = 2560000;
 	uint32_t start_primorial = st.nmin-1;
-	uint32_t end_primorial = st.nmax-1;
-	uint64_t totalprimes = 0;
 
-	size_t smsize;
 	uint32_t * smprime = (uint32_t*)primesieve_generate_primes(2, start_primorial, &smsize, UINT32_PRIMES);
-	totalprimes+=smsize;
-
-	size_t itersize;
-	uint32_t * h_iterprime = (uint32_t*)primesieve_generate_primes(start_primorial+1, end_primorial, &itersize, UINT32_PRIMES);
-	totalprimes+=itersize;
-	sd.nlimit = itersize;
 
-	uint64_t tablesize = smsize*sizeof(cl_ulong);
-	cl_ulong * h_prime = (cl_ulong *)malloc(tablesize);
+	uint64_t tablesize = smsize*sizeof(cl_ulong2);
+	cl_ulong2 * h_prime = (cl_ulong2 *)malloc(tablesize);
 	if( h_prime == NULL ){
 		fprintf(stderr,"malloc error: h_prime\n");
 		exit(EXIT_FAILURE);
 	}
 
 	// compress the table by combining primes
-	uint32_t m=0;
-	for(uint32_t i=0; i<smsize; ++m){
-		h_prime[m] = smprime[i];
-		for(++i; i<smsize; ++i){
-			unsigned __int128 pp = (unsigned __int128)h_prime[m] * smprime[i];
-			if(pp > 0xFFFFFFFFFFFFFFFF) break;
-			h_prime[m] = pp;
-		}
-	}
+	uint32_t m = packProducts(smprime, smsize, h_prime);
 
 	free(smprime);
-	sd.prodcount = m;
 	fprintf(stderr,"Compressed %u primes to %u products\n",(uint32_t)smsize,m);
 	if(boinc_is_standalone()){
 		printf("Compressed %u primes to %u products\n",(uint32_t)smsize,m);
 	}
 
+	*table = h_prime;
+
+	return m;
+}
+
+// primorial product and prime tables.  combined setup with sd.compinv passes the compositorial prime list
+void setupPrimeProducts(progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint32_t * h_primecount, uint32_t * h_iterprime, uint32_t ipsize ){
+
+	cl_int err = 0;
+	uint32_t stride = 2560000;
+	uint32_t start_primorial = st.nmin-1;
+	uint32_t end_primorial = st.nmax-1;
+	uint64_t totalprimes = 0;
+
+	cl_ulong2 * h_prime;
+	size_t smsize;
+	sd.primprodcount = buildPrimeProducts(st, &h_prime, smsize);
+	uint32_t m = sd.primprodcount;
+	totalprimes+=smsize;
+
+	size_t itersize = ipsize;
+	uint32_t * iterprime = h_iterprime;
+	if(iterprime == NULL){
+		iterprime = (uint32_t*)primesieve_generate_primes(start_primorial+1, end_primorial, &itersize, UINT32_PRIMES);
+	}
+	// primes of the list that are in the primorial, the compositorial list extends past nmax
+	uint32_t primesize = 0;
+	while(primesize < itersize && iterprime[primesize] <= end_primorial){
+		++primesize;
+	}
+	totalprimes+=primesize;
+
 	// send prime product table to gpu
-	tablesize = (uint64_t)m*sizeof(cl_ulong);
+	uint64_t tablesize = (uint64_t)m*sizeof(cl_ulong2);
 	if( sd.maxmalloc < tablesize ){
 		fprintf(stderr, "ERROR: prime product table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
                 printf( "ERROR: prime product table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
 		exit(EXIT_FAILURE);
 	}
-	pd.d_primeproducts = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, tablesize, NULL, &err );
+	pd.d_primproducts = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, tablesize, NULL, &err );
 	if ( err != CL_SUCCESS ) {
 		fprintf(stderr, "ERROR: clCreateBuffer failure: primeproducts array\n");
 		printf( "ERROR: clCreateBuffer failure.\n" );
 		exit(EXIT_FAILURE);
 	}
-	sclWriteNB(hardware, tablesize, pd.d_primeproducts, h_prime);
+	sclWriteNB(hardware, tablesize, pd.d_primproducts, h_prime);
 
 	// send partial prime list to gpu
 	uint64_t itertablesize = (uint64_t)itersize*sizeof(cl_uint);
@@ -1054,11 +1917,11 @@ void setupPrimeProducts(progData & pd, workStatus & st, searchData & sd, sclHard
 		printf( "ERROR: clCreateBuffer failure.\n" );
 		exit(EXIT_FAILURE);
 	}
-	sclWriteNB(hardware, itertablesize, pd.d_smallprimes, h_iterprime);
+	sclWriteNB(hardware, itertablesize, pd.d_smallprimes, iterprime);
 
 	// verify product and partial prime tables
 	size_t fullprimelistsize;
-	uint32_t * fullprimelist = (uint32_t*)primesieve_generate_primes(2, st.nmax, &fullprimelistsize, UINT32_PRIMES);
+	uint32_t * fullprimelist = (uint32_t*)primesieve_generate_primes(2, end_primorial, &fullprimelistsize, UINT32_PRIMES);
 	if(fullprimelistsize != totalprimes){
 		fprintf(stderr, "ERROR: CPU sieve failure.\n");
                 printf( "ERROR: CPU sieve failure.\n" );
@@ -1073,12 +1936,14 @@ void setupPrimeProducts(progData & pd, workStatus & st, searchData & sd, sclHard
 	sclWrite(hardware, fullprimelistsize*sizeof(cl_uint), d_fullprimelist, fullprimelist);
 
 	free(h_prime);
-	free(h_iterprime);
+	if(h_iterprime == NULL){
+		free(iterprime);
+	}
 	free(fullprimelist);
 
-	// build kernels
-	pd.verifyslow = sclGetCLSoftware(verifyslow_cl,"primorial_verifyslow",hardware, NULL);
-	pd.verify = sclGetCLSoftware(verify_cl,"primorial_verify",hardware, NULL);
+	// table verification kernels
+	pd.verifyslow = sclGetCLKernel(pd.program,"primorial_verifyslow",hardware);
+	pd.verify = sclGetCLKernel(pd.program,"primorial_verify",hardware);
 	if(pd.verifyslow.local_size[0] != 256){
 		pd.verifyslow.local_size[0] = 256;
 		fprintf(stderr, "Set verifyslow kernel local size to 256\n");
@@ -1107,10 +1972,10 @@ void setupPrimeProducts(progData & pd, workStatus & st, searchData & sd, sclHard
 	sclSetKernelArg(pd.verifyslow, 2, sizeof(uint32_t), &fplsize);
 
 	sclSetKernelArg(pd.verify, 0, sizeof(cl_mem), &d_verify);
-	sclSetKernelArg(pd.verify, 1, sizeof(cl_mem), &pd.d_primeproducts);
+	sclSetKernelArg(pd.verify, 1, sizeof(cl_mem), &pd.d_primproducts);
 	sclSetKernelArg(pd.verify, 2, sizeof(cl_mem), &pd.d_smallprimes);
-	sclSetKernelArg(pd.verify, 3, sizeof(uint32_t), &sd.prodcount);
-	sclSetKernelArg(pd.verify, 4, sizeof(uint32_t), &sd.nlimit);
+	sclSetKernelArg(pd.verify, 3, sizeof(uint32_t), &sd.primprodcount);
+	sclSetKernelArg(pd.verify, 4, sizeof(uint32_t), &primesize);
 
 	sclSetKernelArg(pd.verifyreduce, 0, sizeof(cl_mem), &d_verify);
 	sclSetKernelArg(pd.verifyreduce, 1, sizeof(uint32_t), &ver_groups);
@@ -1141,17 +2006,31 @@ void setupPrimeProducts(progData & pd, workStatus & st, searchData & sd, sclHard
 	sclReleaseClSoft(pd.verifyslow);
 	sclReleaseClSoft(pd.verify);
 
-	sclSetKernelArg(pd.setup, 2, sizeof(cl_mem), &pd.d_primeproducts);
-
-	sclSetKernelArg(pd.iterate, 5, sizeof(cl_mem), &pd.d_smallprimes);
+	if(sd.compinv){
+		// primorial table replaces the compositorial table in combined_inv_setup
+		sclSetKernelArg(pd.setup, 6, sizeof(cl_mem), &pd.d_primproducts);
+		sclSetKernelArg(pd.iterate, 5, sizeof(cl_mem), &pd.d_smallprimes);
+		sd.nlimit = st.nmax;
+	}
+	else if(st.compositorial){
+		// tri-mode iterates over n with the compositorial prime list
+		sclReleaseMemObject(pd.d_smallprimes);
+		sclSetKernelArg(pd.setup, 2, sizeof(cl_mem), &pd.d_primproducts);
+		sclSetKernelArg(pd.setup, 6, sizeof(uint32_t), &sd.primprodcount);
+	}
+	else{
+		sclSetKernelArg(pd.setup, 2, sizeof(cl_mem), &pd.d_primproducts);
+		sclSetKernelArg(pd.setup, 5, sizeof(uint32_t), &sd.primprodcount);
+		sclSetKernelArg(pd.iterate, 5, sizeof(cl_mem), &pd.d_smallprimes);
+		sd.nlimit = primesize;
+	}
 
 }
 
-// compositorial product and prime tables
-void setupCompositeProducts(progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint32_t * h_primecount, uint32_t * h_iterprime, uint32_t ipsize ){
+// compressed compositorial product table for (nmin-1)!/#
+// returns the number of products
+uint32_t buildCompositeProducts( workStatus & st, cl_ulong2 ** table ){
 
-	cl_int err = 0;
-	uint32_t stride = 2560000;
 	uint32_t start_compositorial = st.nmin-1;
 
 	size_t smsize;
@@ -1174,34 +2053,40 @@ void setupCompositeProducts(progData & pd, workStatus & st, searchData & sd, scl
 
 	free(smprime);
 
-	uint64_t tablesize = csize*sizeof(cl_ulong);
-	cl_ulong * h_comp = (cl_ulong *)malloc(tablesize);
+	uint64_t tablesize = csize*sizeof(cl_ulong2);
+	cl_ulong2 * h_comp = (cl_ulong2 *)malloc(tablesize);
 	if( h_comp == NULL ){
 		fprintf(stderr,"malloc error: h_comp\n");
 		exit(EXIT_FAILURE);
 	}
 
 	// compress the table by combining composites
-	uint32_t m=0;
-	for(uint32_t i=0; i<csize; ++m){
-		h_comp[m] = composites[i];
-		for(++i; i<csize; ++i){
-			unsigned __int128 cc = (unsigned __int128)h_comp[m] * composites[i];
-			if(cc > 0xFFFFFFFFFFFFFFFF) break;
-			h_comp[m] = cc;
-		}
-	}
+	uint32_t m = packProducts(composites, csize, h_comp);
 
 	free(composites);
 
-	sd.prodcount = m;
 	fprintf(stderr,"Compressed %u composites to %u products\n",(uint32_t)csize,m);
 	if(boinc_is_standalone()){
 		printf("Compressed %u composites to %u products\n",(uint32_t)csize,m);
 	}
 
+	*table = h_comp;
+
+	return m;
+}
+
+// compositorial product and prime tables
+void setupCompositeProducts(progData & pd, workStatus & st, searchData & sd, sclHard hardware, uint32_t * h_primecount, uint32_t * h_iterprime, uint32_t ipsize ){
+
+	cl_int err = 0;
+	uint32_t stride = 2560000;
+
+	cl_ulong2 * h_comp;
+	sd.prodcount = buildCompositeProducts(st, &h_comp);
+	uint32_t m = sd.prodcount;
+
 	// send read only composite product table to gpu
-	tablesize = (uint64_t)m*sizeof(cl_ulong);
+	uint64_t tablesize = (uint64_t)m*sizeof(cl_ulong2);
 	if( sd.maxmalloc < tablesize ){
 		fprintf(stderr, "ERROR: composite product table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
                 printf( "ERROR: composite product table size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", tablesize, sd.maxmalloc);
@@ -1243,9 +2128,9 @@ void setupCompositeProducts(progData & pd, workStatus & st, searchData & sd, scl
 	free(h_comp);
 	free(fullprimelist);
 
-	// build kernels
-	pd.verifyslow = sclGetCLSoftware(verifyslow_cl,"compositorial_verifyslow",hardware, NULL);
-	pd.verify = sclGetCLSoftware(verify_cl,"compositorial_verify",hardware, NULL);
+	// table verification kernels
+	pd.verifyslow = sclGetCLKernel(pd.program,"compositorial_verifyslow",hardware);
+	pd.verify = sclGetCLKernel(pd.program,"compositorial_verify",hardware);
 	if(pd.verifyslow.local_size[0] != 256){
 		pd.verifyslow.local_size[0] = 256;
 		fprintf(stderr, "Set verifyslow kernel local size to 256\n");
@@ -1311,12 +2196,16 @@ void setupCompositeProducts(progData & pd, workStatus & st, searchData & sd, scl
 	sclReleaseClSoft(pd.verifyslow);
 	sclReleaseClSoft(pd.verify);
 
-	if(st.factorial && st.compositorial){
-		sclSetKernelArg(pd.setup, 7, sizeof(cl_mem), &pd.d_compproducts);
+	if(st.primorial){
+		sclSetKernelArg(pd.setup, 5, sizeof(cl_mem), &pd.d_compproducts);
+		sclSetKernelArg(pd.setup, 7, sizeof(uint32_t), &sd.prodcount);
+	}
+	else if(st.factorial){
+		sclSetKernelArg(pd.setup, 6, sizeof(cl_mem), &pd.d_compproducts);
 	}
 	else{
 		sclSetKernelArg(pd.setup, 2, sizeof(cl_mem), &pd.d_compproducts);
-		sclSetKernelArg(pd.setup, 5, sizeof(uint32_t), &start_compositorial);
+		sclSetKernelArg(pd.setup, 5, sizeof(uint32_t), &sd.prodcount);
 	}
 
 	sclSetKernelArg(pd.iterate, 5, sizeof(cl_mem), &pd.d_smallprimes);
@@ -1325,15 +2214,71 @@ void setupCompositeProducts(progData & pd, workStatus & st, searchData & sd, scl
 
 }
 
-void cl_sieve( sclHard hardware, workStatus & st, searchData & sd ){
+// the survivor bits follow the last argument of the iterate kernel
+uint32_t survivorArg( workStatus & st ){
+	if(st.compositorial){
+		return 7;
+	}
+	return st.primorial ? 6 : 5;
+}
+
+
+// copy the host's candidate bits to the device.  they include the factors found by the other devices and the CPU
+void writeSurvivors( progData & pd, sclHard hardware ){
+	size_t words;
+	uint32_t * map = survivorMap(words);
+	sclWrite(hardware, words*sizeof(uint32_t), pd.d_alive, map);
+	sclWrite(hardware, words*sizeof(uint32_t), pd.d_left, map);
+}
+
+
+// candidates left at the last checkpoint, see iterate.cl
+void setupSurvivors( progData & pd, workStatus & st, searchData & sd, sclHard hardware ){
 
-	progData pd = {};
-	bool first_iteration = true;
-	time_t boinc_last, ckpt_last, time_curr;
 	cl_int err = 0;
+	size_t words;
+	survivorMap(words);
+
+	uint64_t mapsize = (uint64_t)words*sizeof(cl_uint);
+	if( sd.maxmalloc < mapsize ){
+		fprintf(stderr, "ERROR: survivor bits size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", mapsize, sd.maxmalloc);
+		printf( "ERROR: survivor bits size is %" PRIu64 " bytes.  Device supports allocation up to %" PRIu64 " bytes.\n", mapsize, sd.maxmalloc);
+		exit(EXIT_FAILURE);
+	}
+	pd.d_alive = clCreateBuffer( hardware.context, CL_MEM_READ_ONLY, mapsize, NULL, &err );
+        if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure: d_alive array.\n");
+                printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+	pd.d_left = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, mapsize, NULL, &err );
+        if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure: d_left array.\n");
+                printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	writeSurvivors(pd, hardware);
+
+	sclSetKernelArg(pd.iterate, survivorArg(st), sizeof(cl_mem), &pd.d_alive);
+	sclSetKernelArg(pd.iterate, survivorArg(st)+1, sizeof(cl_mem), &pd.d_left);
+}
 
-	// setup kernel parameters
-	setupSearch(st,sd);
+
+// target kernel times in ms, a compute device has no display to keep responsive
+void setKernelTargets( deviceData & dev ){
+	dev.setup_ms = dev.sd.compute ? 50.0 : 20.0;
+	dev.iterate_ms = dev.sd.compute ? 50.0 : 10.0;
+}
+
+
+// program, kernels, buffers, kernel sizes and tables of one device
+void setupDevice( deviceData & dev, workStatus & st, uint32_t * h_iterprime, size_t itersize ){
+
+	progData & pd = dev.pd;
+	searchData & sd = dev.sd;
+	sclHard hardware = dev.hardware;
+	cl_int err = 0;
 
 	// device arrays
 	pd.d_primecount = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, 6*sizeof(cl_uint), NULL, &err );
@@ -1349,38 +2294,43 @@ void cl_sieve( sclHard hardware, workStatus & st, searchData & sd ){
 		exit(EXIT_FAILURE);
 	}
 
-        pd.clearn = sclGetCLSoftware(clearn_cl,"clearn",hardware, NULL);
-        pd.clearresult = sclGetCLSoftware(clearresult_cl,"clearresult",hardware, NULL);
-        pd.addsmallprimes = sclGetCLSoftware(addsmallprimes_cl,"addsmallprimes",hardware, NULL);
-	if(st.pmax < 0xFFFFFFFFFF000000){
-	        pd.getsegprimes = sclGetCLSoftware(getsegprimes_cl,"getsegprimes",hardware, NULL);
-	}
-	else{
-	       	pd.getsegprimes = sclGetCLSoftware(getsegprimes_cl,"getsegprimes",hardware, "-D CKOVERFLOW=1" );
+	pd.program = buildProgram(st, sd, hardware);
+
+        pd.clearn = sclGetCLKernel(pd.program,"clearn",hardware);
+        pd.clearresult = sclGetCLKernel(pd.program,"clearresult",hardware);
+	if(st.pmin < 114){
+	        pd.addsmallprimes = getKernel(pd.program,"addsmallprimes",hardware, sd.mont32);
 	}
+        pd.getsegprimes = getKernel(pd.program,"getsegprimes",hardware, sd.mont32);
 
-	if(st.factorial && st.compositorial){
-		pd.setup = sclGetCLSoftware(setup_cl,"combined_setup",hardware, NULL);
-		pd.iterate = sclGetCLSoftware(iterate_cl,"combined_iterate",hardware, NULL);
-		pd.check = sclGetCLSoftware(check_cl,"combined_check",hardware, NULL);
+	if(st.factorial && st.primorial && st.compositorial){
+		pd.setup = getKernel(pd.program,"combined3_setup",hardware, sd.mont32);
+		pd.iterate = getKernel(pd.program,"combined3_iterate",hardware, sd.mont32);
+		pd.check = getKernel(pd.program,"combined3_check",hardware, sd.mont32);
+	}
+	else if(st.factorial && st.compositorial){
+		pd.setup = getKernel(pd.program,sd.compinv ? "combined_inv_setup" : "combined_setup",hardware, sd.mont32);
+		pd.iterate = getKernel(pd.program,"combined_iterate",hardware, sd.mont32);
+		pd.check = getKernel(pd.program,"combined_check",hardware, sd.mont32);
 	}
 	else if(st.factorial){
-		pd.setup = sclGetCLSoftware(setup_cl,"factorial_setup",hardware, NULL);
-		pd.iterate = sclGetCLSoftware(iterate_cl,"factorial_iterate",hardware, NULL);
-		pd.check = sclGetCLSoftware(check_cl,"factorial_compositorial_check",hardware, NULL);
+		pd.setup = getKernel(pd.program,"factorial_setup",hardware, sd.mont32);
+		pd.reflect = getKernel(pd.program,"factorial_reflect",hardware, sd.mont32);
+		pd.iterate = getKernel(pd.program,"factorial_iterate",hardware, sd.mont32);
+		pd.check = getKernel(pd.program,"factorial_compositorial_check",hardware, sd.mont32);
 	}
 	else if(st.primorial){
-		pd.setup = sclGetCLSoftware(setup_cl,"primorial_setup",hardware, NULL);
-		pd.iterate = sclGetCLSoftware(iterate_cl,"primorial_iterate",hardware, NULL);
-		pd.check = sclGetCLSoftware(check_cl,"primorial_check",hardware, NULL);
+		pd.setup = getKernel(pd.program,"primorial_setup",hardware, sd.mont32);
+		pd.iterate = getKernel(pd.program,"primorial_iterate",hardware, sd.mont32);
+		pd.check = getKernel(pd.program,"primorial_check",hardware, sd.mont32);
 	}
 	else if(st.compositorial){
-		pd.setup = sclGetCLSoftware(setup_cl,"compositorial_setup",hardware, NULL);
-		pd.iterate = sclGetCLSoftware(iterate_cl,"compositorial_iterate",hardware, NULL);
-		pd.check = sclGetCLSoftware(check_cl,"factorial_compositorial_check",hardware, NULL);
+		pd.setup = getKernel(pd.program,"compositorial_setup",hardware, sd.mont32);
+		pd.iterate = getKernel(pd.program,"compositorial_iterate",hardware, sd.mont32);
+		pd.check = getKernel(pd.program,"factorial_compositorial_check",hardware, sd.mont32);
 	}
-	pd.verifyreduce = sclGetCLSoftware(verifyresult_cl,"verifyreduce",hardware, NULL);
-	pd.verifyresult = sclGetCLSoftware(verifyresult_cl,"verifyresult",hardware, NULL);
+	pd.verifyreduce = sclGetCLKernel(pd.program,"verifyreduce",hardware);
+	pd.verifyresult = sclGetCLKernel(pd.program,"verifyresult",hardware);
 
 	if(pd.verifyreduce.local_size[0] != 256){
 		pd.verifyreduce.local_size[0] = 256;
@@ -1402,361 +2352,953 @@ void cl_sieve( sclHard hardware, workStatus & st, searchData & sd ){
 		fprintf(stderr, "Set check kernel local size to 256\n");
 	}
 
+	// kernel sizes of an earlier run with this device and mode skip the profiles
+	dev.tuned = tuneLookup(hardware, st, sd, dev.tunekey, sizeof(dev.tunekey));
+
+	// kernel used in profileGPU, setup arg
+	sclSetKernelArg(pd.clearn, 0, sizeof(cl_mem), &pd.d_primecount);
+	sclSetGlobalSize( pd.clearn, 64 );
+
+	setupPresieve(pd,sd,hardware);
+
+	if(dev.source != NULL){
+		// a batch job searches the segments of the job that generates its primes
+		sd.range = dev.source->sd.range;
+		sd.psize = dev.source->sd.psize;
+	}
+	else{
+		profileGPU(pd,st,sd,hardware,dev.tuned);
+	}
+
+	// number of gpu workgroups, used to size the sum array on gpu
+	sd.numgroups = (sd.psize / pd.check.local_size[0]) + 1;
+
+	// pinned host arrays used for data transfer from gpu during checkpoints
+	pd.h_sum = sclMallocPinned(hardware, sd.numgroups*sizeof(uint64_t));
+	pd.h_count = sclMallocPinned(hardware, 6*sizeof(uint32_t));
+	uint32_t * h_primecount = (uint32_t *)pd.h_count.ptr;
+
+	sclSetGlobalSize( pd.getsegprimes, (sd.range/60)+1 );
+	sclSetGlobalSize( pd.setup, sd.psize );
+	sclSetGlobalSize( pd.iterate, sd.psize );
+	sclSetGlobalSize( pd.check, sd.psize );
+	sclSetGlobalSize( pd.clearresult, sd.numgroups );
+
+	for(int b = 0; b < 2; ++b){
+		pd.d_primebuf[b] = clCreateBuffer(hardware.context, CL_MEM_READ_WRITE, sd.psize*primeSize(sd), NULL, &err);
+	        if ( err != CL_SUCCESS ) {
+			fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+	                printf( "ERROR: clCreateBuffer failure.\n" );
+			exit(EXIT_FAILURE);
+		}
+		pd.d_segcount[b] = clCreateBuffer(hardware.context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	        if ( err != CL_SUCCESS ) {
+			fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+	                printf( "ERROR: clCreateBuffer failure.\n" );
+			exit(EXIT_FAILURE);
+		}
+	}
+	pd.d_primes = pd.d_primebuf[0];
+
+	// prime generation runs on its own queue so it overlaps the search kernels.  without a second queue
+	// the segments are generated in order on the compute queue.  a batch job that copies its primes has none
+	pd.primequeue = NULL;
+	if(dev.source == NULL){
+		pd.primequeue = clCreateCommandQueue(hardware.context, hardware.device, 0, &err);
+		if ( err != CL_SUCCESS ) {
+			clRetainCommandQueue(hardware.queue);
+			pd.primequeue = hardware.queue;
+			fprintf(stderr, "Prime generation shares the compute queue\n");
+		}
+	}
+        pd.d_sum = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, sd.numgroups*sizeof(cl_ulong), NULL, &err );
+        if ( err != CL_SUCCESS ) {
+		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
+                printf( "ERROR: clCreateBuffer failure.\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	// set static kernel args
+	sclSetKernelArg(pd.clearresult, 0, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.clearresult, 1, sizeof(cl_mem), &pd.d_sum);
+	sclSetKernelArg(pd.clearresult, 2, sizeof(uint32_t), &sd.numgroups);
+
+	if(st.pmin < 114){
+		sclSetGlobalSize( pd.addsmallprimes, 64 );
+	}
+
+	sclSetKernelArg(pd.setup, 1, sizeof(cl_mem), &pd.d_primecount);
+
+	if(st.factorial && !st.compositorial){
+		sclSetGlobalSize( pd.reflect, sd.psize );
+		sclSetKernelArg(pd.reflect, 1, sizeof(cl_mem), &pd.d_primecount);
+	}
+
+	sclSetKernelArg(pd.iterate, 1, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.iterate, 2, sizeof(cl_mem), &pd.d_factor);
+
+	if(survivorsActive()){
+		setupSurvivors(pd, st, sd, hardware);
+	}
+
+	sclSetKernelArg(pd.check, 1, sizeof(cl_mem), &pd.d_primecount);
+	sclSetKernelArg(pd.check, 2, sizeof(cl_mem), &pd.d_sum);
+
+	if(sd.retire){
+		setupCompaction(pd, st, sd, hardware);
+	}
+
+	sclEnqueueKernel(hardware, pd.clearresult);
+
+	// setup power and product tables once at program start
+	// tri-mode builds startN! from the primorial and compositorial residues
+	if(st.factorial && !st.primorial){
+		setupPowerTable(pd, st, sd, hardware, h_primecount);
+	}
+	if(st.primorial){
+		setupPrimeProducts(pd, st, sd, hardware, h_primecount, NULL, 0);
+	}
+	if(sd.compinv){
+		setupPrimeProducts(pd, st, sd, hardware, h_primecount, h_iterprime, itersize);
+	}
+	else if(st.compositorial){
+		setupCompositeProducts(pd, st, sd, hardware, h_primecount, h_iterprime, itersize);
+	}
+	if(st.factorial && st.compositorial && !st.primorial){
+		sclSetKernelArg(pd.setup, 7, sizeof(uint32_t), &sd.powcount);
+		sclSetKernelArg(pd.setup, 8, sizeof(uint32_t), sd.compinv ? &sd.primprodcount : &sd.prodcount);
+	}
+	sd.scount = (sd.powcount > sd.prodcount) ? sd.powcount : sd.prodcount;
+	if(sd.primprodcount > sd.scount) sd.scount = sd.primprodcount;
+
+	// the launch that starts each queue batch is sampled and retunes its step
+	setKernelTargets(dev);
+	dev.buf = 0;
+	dev.kernelq = 0;
+	dev.launchEvent = NULL;
+	dev.samplestep = NULL;
+}
+
+
+// wait for the queued kernels of the device, the last sampled launch retunes its step
+void drainDevice( deviceData & dev ){
+	if(dev.kernelq > 0){
+		double kernel_ms = waitOnEvent(dev.hardware, dev.launchEvent);
+		if(dev.samplestep != NULL) retuneStep(*dev.samplestep, dev.samplesize, kernel_ms, dev.sampletarget);
+		dev.kernelq = 0;
+	}
+	sleepCPU(dev.hardware);
+}
+
+
+// limit cl queue depth and sleep cpu.  the launch that starts each queue batch is sampled
+void queueKernel( deviceData & dev, sclSoft & kernel, uint32_t * step, uint32_t size, double target ){
+	if(dev.kernelq == 0){
+		dev.launchEvent = sclEnqueueKernelEvent(dev.hardware, kernel);
+		dev.samplestep = (size == *step) ? step : NULL;
+		dev.samplesize = size;
+		dev.sampletarget = target;
+	}
+	else{
+		sclEnqueueKernel(dev.hardware, kernel);
+	}
+	if(++dev.kernelq == (int)dev.sd.queuedepth){
+		double kernel_ms = waitOnEvent(dev.hardware, dev.launchEvent);
+		if(dev.samplestep != NULL) retuneStep(*dev.samplestep, dev.samplesize, kernel_ms, dev.sampletarget);
+		dev.kernelq = 0;
+	}
+}
+
+
+// profile one iterate launch of size n from nstart, size is clipped to the end of the search
+double profileIterate( deviceData & dev, workStatus & st, uint32_t * h_iterprime, uint32_t & nstart, uint32_t & nextprimepos, uint32_t & size ){
+	progData & pd = dev.pd;
+	if(st.compositorial){
+		while(h_iterprime[nextprimepos] < nstart){
+			++nextprimepos;
+		}
+		sclSetKernelArg(pd.iterate, 6, sizeof(uint32_t), &nextprimepos);
+	}
+	uint32_t nmax = nstart + size;
+	if(nmax > dev.sd.nlimit)nmax = dev.sd.nlimit;
+	size = nmax - nstart;
+	sclSetKernelArg(pd.iterate, 3, sizeof(uint32_t), &nstart);
+	sclSetKernelArg(pd.iterate, 4, sizeof(uint32_t), &nmax);
+	double kernel_ms = ProfilesclEnqueueKernel(dev.hardware, pd.iterate);
+	nstart = nmax;
+	return kernel_ms;
+}
+
+
+// search the segment [start, stop) whose primes are in the device's current buffer
+void searchSegment( deviceData & dev, workStatus & st, uint32_t * h_iterprime, uint64_t start, uint64_t stop ){
+
+	progData & pd = dev.pd;
+	searchData & sd = dev.sd;
+	sclHard hardware = dev.hardware;
+	double kernel_ms;
+
+	// range of n where primes in this segment retire
+	uint64_t retirelow = start, retirehigh = stop;
+	if(st.compositorial){
+		retirelow *= 2;
+		retirehigh *= 2;
+	}
+	uint64_t compactn = 0;
+
+	if(dev.source != NULL){
+		copyPrimes(dev, st, dev.buf);
+	}
+	else{
+		usePrimes(pd, st, sd, hardware, dev.buf);
+	}
+
+	uint32_t sstart = 0;
+	uint32_t smax;
+	uint32_t nstart = (st.factorial || st. compositorial) ? st.nmin : 0;
+	uint32_t nmax;
+	uint32_t nextprimepos = 0;
+
+	// by Wilson's theorem nmin-1! can be found from p-1-(nmin-1)! for each prime in the segment.
+	// use it when the largest of these is cheaper than the power table: one multiply per k
+	// instead of about two multiplies per table term.  p stays below 2*(nmin-1) so the kernel can give
+	// the 2-PRPs that are composite the same zero residue as the power table.
+	sclSoft setup = pd.setup;
+	uint32_t scount = sd.scount;
+	if(st.factorial && !st.primorial && !st.compositorial && stop-2 > st.nmin-1){
+		uint64_t maxm = stop-2-(st.nmin-1);
+		if(maxm < 2*(uint64_t)sd.powcount && maxm < st.nmin-1){
+			setup = pd.reflect;
+			scount = (uint32_t)maxm;
+			sclSetKernelArg(setup, 2, sizeof(uint32_t), &scount);
+		}
+	}
+
+	// profile setup kernel once at program start.  adjust work size to target kernel runtime.
+	if(!dev.profiled && !dev.tuned){
+		smax = sstart + sd.sstep;
+		if(smax > scount)smax = scount;
+		sclSetKernelArg(setup, 3, sizeof(uint32_t), &sstart);
+		sclSetKernelArg(setup, 4, sizeof(uint32_t), &smax);
+		kernel_ms = ProfilesclEnqueueKernel(hardware, setup);
+		sstart += sd.sstep;
+		double multi = dev.setup_ms/kernel_ms;	// target kernel time 50ms or 20ms, first iterations have large powers, avg kernel time is less
+		uint32_t new_sstep = (uint32_t)( multi * (double)sd.sstep );
+		if(!new_sstep) new_sstep=1;
+		sd.sstep = new_sstep;
+	}
+
+	// setup residue for nmin# / nmin! mod P
+	for(; sstart < scount; sstart = smax){
+		smax = sstart + sd.sstep;
+		if(smax > scount)smax = scount;
+		sclSetKernelArg(setup, 3, sizeof(uint32_t), &sstart);
+		sclSetKernelArg(setup, 4, sizeof(uint32_t), &smax);
+		queueKernel(dev, setup, &sd.sstep, smax - sstart, dev.setup_ms);
+	}
+
+	if(sd.retire){
+		compactPrimes(pd, hardware, compactn, st.nmin-1, retirelow, retirehigh);
+	}
+
+	// profile iterate kernel once at program start.  adjust work size to target kernel runtime.
+	if(!dev.profiled){
+		dev.profiled = true;
+		if(!dev.tuned){
+			uint32_t size = sd.nstep;
+			kernel_ms = profileIterate(dev, st, h_iterprime, nstart, nextprimepos, size);
+			double n_ms = kernel_ms / (double)size;
+
+			// time a launch at the compute target of 50ms and one at the display target of 10ms.  long kernels
+			// are only worth a less responsive display when they are measurably faster per n.  the vendor
+			// guess in main.cpp is kept when the range is too short to time both.
+			uint32_t longsize = (uint32_t)( 50.0 / n_ms ), shortsize = (uint32_t)( 10.0 / n_ms );
+			if(!longsize) longsize=1;
+			if(!shortsize) shortsize=1;
+			if(n_ms > 0.0 && nstart < sd.nlimit){
+				size = longsize;
+				double long_ms = profileIterate(dev, st, h_iterprime, nstart, nextprimepos, size) / (double)size;
+				if(size == longsize && nstart < sd.nlimit){
+					size = shortsize;
+					double short_ms = profileIterate(dev, st, h_iterprime, nstart, nextprimepos, size) / (double)size;
+					if(size == shortsize){
+						double setup_ms = dev.setup_ms;
+						sd.compute = (long_ms < 0.9 * short_ms);
+						setKernelTargets(dev);
+						uint32_t new_sstep = (uint32_t)( dev.setup_ms / setup_ms * (double)sd.sstep );
+						if(!new_sstep) new_sstep=1;
+						sd.sstep = new_sstep;
+						sd.queuedepth = sd.compute ? 20 : 100;
+						n_ms = sd.compute ? long_ms : short_ms;
+					}
+				}
+			}
+
+			uint32_t new_nstep = (uint32_t)( dev.iterate_ms / n_ms );	// target kernel time 50ms or 10ms
+			if(!new_nstep) new_nstep=1;
+			sd.nstep = new_nstep;
+			#pragma omp critical(tunedb)
+			tuneStore(dev.tunekey, sd);
+		}
+		fprintf(stderr,"c:%u u:%u t:%u r:%u p:%u s:%u n:%u\n", (uint32_t)sd.compute, sd.computeunits, sd.threadcount, sd.range, sd.psize, sd.sstep, sd.nstep);
+		if(boinc_is_standalone()){
+			printf("c:%u u:%u t:%u r:%u p:%u s:%u n:%u\n", (uint32_t)sd.compute, sd.computeunits, sd.threadcount, sd.range, sd.psize, sd.sstep, sd.nstep);
+		}
+	}
+
+	// iterate from nmin# / nmin! to nmax# / nmax-1! mod P
+	for(; nstart < sd.nlimit; nstart = nmax){
+		if(st.compositorial){
+			while(h_iterprime[nextprimepos] < nstart){
+				++nextprimepos;
+			}
+			sclSetKernelArg(pd.iterate, 6, sizeof(uint32_t), &nextprimepos);
+		}
+		nmax = nstart + sd.nstep;
+		if(nmax > sd.nlimit)nmax = sd.nlimit;
+		sclSetKernelArg(pd.iterate, 3, sizeof(uint32_t), &nstart);
+		sclSetKernelArg(pd.iterate, 4, sizeof(uint32_t), &nmax);
+		queueKernel(dev, pd.iterate, &sd.nstep, nmax - nstart, dev.iterate_ms);
+		if(sd.retire){
+			uint64_t currn = (st.primorial && !st.compositorial) ? h_iterprime[nmax-1] : nmax-1;
+			compactPrimes(pd, hardware, compactn, currn, retirelow, retirehigh);
+		}
+	}
+
+	// candidates with a prime factor in this segment are left out of the next ones
+	if(survivorsActive()){
+		size_t words;
+		survivorMap(words);
+		cl_int err = clEnqueueCopyBuffer(hardware.queue, pd.d_left, pd.d_alive, 0, 0, words*sizeof(cl_uint), 0, NULL, NULL);
+		if ( err != CL_SUCCESS ) {
+			printf( "ERROR: clEnqueueCopyBuffer\n" );
+			fprintf(stderr, "ERROR: clEnqueueCopyBuffer\n" );
+			sclPrintErrorFlags( err );
+		}
+	}
+
+	// checksum kernel
+	sclEnqueueKernel(hardware, pd.check);
+	if(dev.source == NULL){
+		releasePrimes(pd, hardware, dev.buf);
+	}
+}
+
+
+// next segment of worker w from the shared cursor.  a GPU takes a segment of its range.  the CPU takes no more
+// of the remaining P than it searches in the time the GPUs take for the rest, so both finish together.
+// rates are p claimed per second since the start of the checkpoint interval, kept from the last interval
+// until the first second of this one has passed.
+bool claimSegment( segmentQueue & sq, workStatus & st, uint32_t w, uint64_t range, uint64_t & start, uint64_t & stop ){
+
+	bool claimed = false;
+
+	#pragma omp critical(segment)
+	{
+		double elapsed = omp_get_wtime() - sq.start;
+		if(elapsed > 1.0){
+			sq.rate[w] = (double)sq.claimed[w] / elapsed;
+		}
+		if(sq.cursor < st.pmax){
+			if(w == sq.cpu){
+				double gpurate = 0;
+				for(uint32_t i = 0; i < sq.cpu; ++i){
+					gpurate += sq.rate[i];
+				}
+				if(sq.rate[w] > 0 && gpurate > 0){
+					double share = (double)(st.pmax - sq.cursor) * sq.rate[w] / (sq.rate[w] + gpurate);
+					if(share < (double)range){
+						range = (uint64_t)share;
+					}
+				}
+			}
+			if(range > 0){
+				start = sq.cursor;
+				stop = segmentStop(st, range, start);
+				sq.cursor = stop;
+				sq.claimed[w] += stop - start;
+				claimed = true;
+			}
+		}
+	}
+
+	return claimed;
+}
+
+
+// search segments of the device until P is done or the checkpoint is due.  the primes of the next segment
+// are generated while the current one is searched.  every claimed segment is searched before returning,
+// so the cursor is the checkpoint's p.  boinc_last is NULL on all but one device, that one reports progress.
+void sieveDevice( deviceData & dev, uint32_t w, workStatus & st, uint32_t * h_iterprime, segmentQueue & sq, time_t ckpt_due, time_t * boinc_last ){
+
+	uint64_t start, stop, nextstart, nextstop;
+	const double irsize = 1.0 / (double)(st.pmax-st.pmin);
+	time_t time_curr;
+
+	if(claimSegment(sq, st, w, dev.sd.range, start, stop)){
+
+		generatePrimes(dev.pd, dev.sd, dev.hardware, start, stop, dev.buf);
+
+		while(true){
+
+			time(&time_curr);
+			if( boinc_last != NULL && ((int)time_curr - (int)*boinc_last) > 1 ){
+				// update BOINC fraction done every 2 sec
+				uint64_t p;
+				#pragma omp critical(segment)
+				p = sq.cursor;
+	    			double fd = (double)(p-st.pmin)*irsize;
+				boinc_fraction_done(fd);
+				if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",fd*100.0);
+				*boinc_last = time_curr;
+			}
+
+			// queue the primes of the next segment, they are generated while this segment is searched
+			bool next = (time_curr < ckpt_due) && claimSegment(sq, st, w, dev.sd.range, nextstart, nextstop);
+			if(next){
+				generatePrimes(dev.pd, dev.sd, dev.hardware, nextstart, nextstop, dev.buf^1);
+			}
+
+			searchSegment(dev, st, h_iterprime, start, stop);
+			dev.buf ^= 1;
+
+			if(!next){
+				break;
+			}
+			start = nextstart;
+			stop = nextstop;
+		}
+	}
+
+	drainDevice(dev);
+}
+
+
+// search segments on the CPU threads until P is done or the checkpoint is due.  stops early when the factor
+// array is half full, the GPUs search the rest of the interval.
+void sieveCPU( cpuData * cd, searchData & sd, workStatus & st, segmentQueue & sq, time_t ckpt_due ){
+
+	uint64_t start, stop;
+	time_t time_curr;
+
+	// this thread's share of the CPU, the parallel regions of cpuSegment are nested in the device loop
+	omp_set_num_threads(sd.threadcount);
+
+	while(true){
+		time(&time_curr);
+		if(time_curr >= ckpt_due || cpuFactorsFull(cd) || !claimSegment(sq, st, sq.cpu, sd.range, start, stop)){
+			break;
+		}
+		cpuSegment(cd, st, sd, start, stop);
+	}
+}
+
+
+// results of every device and the CPU share at a checkpoint.  factors are merged and sorted before they are
+// verified and written, the results file doesn't depend on which device searched a segment.
+void getResults( deviceData * dev, uint32_t devcount, cpuData * cd, workStatus & st, verifyList & vl ){
+
+	uint32_t numfactors = 0, cpufactors = 0;
+	factor * h_cpufactor = NULL;
+
+	for(uint32_t d = 0; d < devcount; ++d){
+		numfactors += readResults(dev[d], st);
+	}
+	if(cd != NULL){
+		cpufactors = cpuResults(cd, st, &h_cpufactor);
+		numfactors += cpufactors;
+	}
+
+	if(numfactors > 0){
+		if(boinc_is_standalone()){
+			printf("processing %u factors on CPU\n", numfactors);
+		}
+		const bool merge = (devcount > 1 || cd != NULL);
+		factor * h_factor = (factor *)dev[0].pd.h_factor.ptr;
+		if(merge){
+			h_factor = (factor *)malloc(numfactors * sizeof(factor));
+			if( h_factor == NULL ){
+				fprintf(stderr,"malloc error: h_factor\n");
+				exit(EXIT_FAILURE);
+			}
+			uint32_t pos = 0;
+			for(uint32_t d = 0; d < devcount; ++d){
+				uint32_t count = ((uint32_t *)dev[d].pd.h_count.ptr)[2];
+				memcpy(&h_factor[pos], dev[d].pd.h_factor.ptr, count * sizeof(factor));
+				pos += count;
+			}
+			if(cpufactors > 0){
+				memcpy(&h_factor[pos], h_cpufactor, cpufactors * sizeof(factor));
+			}
+		}
+		reportFactors(st, h_factor, numfactors, vl);
+		if(merge){
+			free(h_factor);
+		}
+	}
+}
+
+
+// gpu contains one device, or every gpu of the platform with --alldevices.  P segments are handed out from
+// a shared cursor so a faster device searches more of them.  with --cputhreads the CPU is one more worker.
+void cl_sieve( gpuDevice * gpu, uint32_t gpucount, workStatus & st, searchData & sd ){
+
+	time_t boinc_last, time_curr;
+
+	// setup kernel parameters
+	setupSearch(st,sd);
+
+	// primes below 2^32 use the 32 bit kernels, residues are stored as uint
+	sd.mont32 = (st.pmax <= 0x100000000);
+	if(sd.mont32){
+		fprintf(stderr,"Using 32 bit kernels\n");
+		if(boinc_is_standalone()){
+			printf("Using 32 bit kernels\n");
+		}
+	}
+
+	// primes retire once p <= n, or 2p <= n for compositorial
+	sd.retire = st.compositorial ? (st.pmin < (st.nmax+1)/2) : (st.pmin < st.nmax);
+
+	startSearch(st, sd);
+
+	// arrays of primes and composites used during CPU factor verification
+	verifyList vl = buildVerifyList(st);
+
+	// array of primes from nmin to nmax+prime gap
+	uint32_t * h_iterprime = NULL;
+	size_t itersize = 0;
+	if(st.compositorial){
+		h_iterprime = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax+320, &itersize, UINT32_PRIMES);
+	}
+	else if(st.primorial && sd.retire){
+		// n of each primorial iteration, used to find retired primes
+		h_iterprime = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax-1, &itersize, UINT32_PRIMES);
+	}
+
+	deviceData * dev = new deviceData[gpucount]();
+
+	for(uint32_t d = 0; d < gpucount; ++d){
+		if(gpucount > 1){
+			fprintf(stderr,"Setting up GPU %u\n", d);
+			if(boinc_is_standalone()){
+				printf("Setting up GPU %u\n", d);
+			}
+		}
+		dev[d].hardware = gpu[d].hardware;
+		dev[d].sd = sd;
+		dev[d].sd.maxmalloc = gpu[d].maxmalloc;
+		dev[d].sd.computeunits = gpu[d].computeunits;
+		dev[d].sd.compute = gpu[d].compute;
+		setupKernelSize(dev[d].sd);
+		setupDevice(dev[d], st, h_iterprime, itersize);
+	}
+
+	// CPU share of the search, its tables are built like the CPU backend's
+	cpuData * cd = NULL;
+	searchData cpusd = sd;
+	if(sd.cputhreads){
+		cpusd.threadcount = sd.cputhreads;
+		cd = cpuSetup(st, cpusd);
+		// the CPU threads are a parallel region nested in the device loop
+		omp_set_max_active_levels(2);
+		fprintf(stderr,"Sieving part of P on CPU with %u threads\n", cpusd.threadcount);
+		if(boinc_is_standalone()){
+			printf("Sieving part of P on CPU with %u threads\n", cpusd.threadcount);
+		}
+	}
+	const uint32_t workers = gpucount + ((cd != NULL) ? 1 : 0);
+
+	segmentQueue sq = {};
+	sq.cursor = st.p;
+	sq.cpu = gpucount;
+	sq.claimed = new uint64_t[workers]();
+	sq.rate = new double[workers]();
+
+	fprintf(stderr,"Starting Sieve...\n");
+	if(boinc_is_standalone()){
+		printf("Starting Sieve...\n");
+	}
+
+	time(&boinc_last);
+	time_t totals, totalf;
+	if(boinc_is_standalone()){
+		time(&totals);
+	}
+
+	// main search loop, one pass per checkpoint
+	while(st.p < st.pmax){
+
+		// 1 minute checkpoint
+		time(&time_curr);
+		time_t ckpt_due = time_curr + 60;
 
-	if( sd.test ){
-		// clear result file
-		FILE * temp_file = my_fopen(RESULTS_FILENAME,"w");
-		if (temp_file == NULL){
-			fprintf(stderr,"Cannot open %s !!!\n",RESULTS_FILENAME);
-			exit(EXIT_FAILURE);
+		sq.start = omp_get_wtime();
+		for(uint32_t w = 0; w < workers; ++w){
+			sq.claimed[w] = 0;
 		}
-		fclose(temp_file);
-	}
-	else{
-		// Resume from checkpoint if there is one
-		if( read_state( st, sd ) ){
-			if(boinc_is_standalone()){
-				printf("Current p: %" PRIu64 "\n", st.p);
+
+		#pragma omp parallel for num_threads(workers) schedule(static,1)
+		for(uint32_t w = 0; w < workers; ++w){
+			if(w == sq.cpu){
+				sieveCPU(cd, cpusd, st, sq, ckpt_due);
 			}
-			fprintf(stderr,"Resuming from checkpoint, current p: %" PRIu64 "\n", st.p);
+			else{
+				sieveDevice(dev[w], w, st, h_iterprime, sq, ckpt_due, (w == 0) ? &boinc_last : NULL);
+			}
+		}
 
-			//trying to resume a finished workunit
-			if( st.p == st.pmax ){
-				if(boinc_is_standalone()){
-					printf("Workunit complete.\n");
+		st.p = sq.cursor;
+
+		if(st.p < st.pmax){
+			boinc_begin_critical_section();
+			getResults(dev, gpucount, cd, st, vl);
+			checkpoint(st, sd);
+			boinc_end_critical_section();
+			// clear result arrays
+			for(uint32_t d = 0; d < gpucount; ++d){
+				sclEnqueueKernel(dev[d].hardware, dev[d].pd.clearresult);
+				if(survivorsActive()){
+					writeSurvivors(dev[d].pd, dev[d].hardware);
 				}
-				fprintf(stderr,"Workunit complete.\n");
-				boinc_finish(EXIT_SUCCESS);
 			}
-		}
-		// starting from beginning
-		else{
-			// clear result file
-			FILE * temp_file = my_fopen(RESULTS_FILENAME,"w");
-			if (temp_file == NULL){
-				fprintf(stderr,"Cannot open %s !!!\n",RESULTS_FILENAME);
-				exit(EXIT_FAILURE);
+			if(cd != NULL && survivorsActive()){
+				cpuSurvivors(cd);
 			}
-			fclose(temp_file);
-
-			// setup boinc trickle up
-			st.last_trickle = (uint64_t)time(NULL);
 		}
 	}
 
-	// kernel used in profileGPU, setup arg
-	sclSetKernelArg(pd.clearn, 0, sizeof(cl_mem), &pd.d_primecount);
-	sclSetGlobalSize( pd.clearn, 64 );
+	// final checkpoint
+	boinc_begin_critical_section();
+	boinc_fraction_done(1.0);
+	if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",100.0);
+	getResults(dev, gpucount, cd, st, vl);
+	checkpoint(st, sd);
+	finalizeResults(st);
+	boinc_end_critical_section();
 
-	profileGPU(pd,st,sd,hardware);
+	fprintf(stderr,"Sieve complete.\nfactors %" PRIu64 ", prime count %" PRIu64 "\n", st.factorcount, st.primecount);
 
-	// number of gpu workgroups, used to size the sum array on gpu
-	sd.numgroups = (sd.psize / pd.check.local_size[0]) + 1;
+	if(boinc_is_standalone()){
+		time(&totalf);
+		printf("Sieve finished in %d sec.\n", (int)totalf - (int)totals);
+		printf("factors %" PRIu64 ", prime count %" PRIu64 ", checksum %016" PRIX64 "\n", st.factorcount, st.primecount, st.checksum);
+	}
 
-	// host arrays used for data transfer from gpu during checkpoints
-	uint64_t * h_checksum = (uint64_t *)malloc(sd.numgroups*sizeof(uint64_t));
-	if( h_checksum == NULL ){
-		fprintf(stderr,"malloc error: h_checksum\n");
-		exit(EXIT_FAILURE);
+	for(uint32_t d = 0; d < gpucount; ++d){
+		// keep the step sizes retuned during the run
+		tuneStore(dev[d].tunekey, dev[d].sd);
+		sclFreePinned(dev[d].hardware, dev[d].pd.h_sum);
+		sclFreePinned(dev[d].hardware, dev[d].pd.h_count);
+		sclFreePinned(dev[d].hardware, dev[d].pd.h_factor);
+		cleanup(dev[d].pd, dev[d].sd, st);
 	}
-	uint32_t * h_primecount = (uint32_t *)malloc(6*sizeof(uint32_t));
-	if( h_primecount == NULL ){
-		fprintf(stderr,"malloc error: h_primecount\n");
-		exit(EXIT_FAILURE);
+	delete [] dev;
+	if(cd != NULL){
+		cpuFree(cd);
 	}
+	delete [] sq.claimed;
+	delete [] sq.rate;
+	free(h_iterprime);
+	freeVerifyList(vl);
+	survivorFree();
+}
 
-	// array of primes or composites used during CPU factor verification
-	uint32_t *verifylist = NULL;
-	size_t verifylistsize = 0;
-	if(st.primorial){
-		verifylist = (uint32_t*)primesieve_generate_primes(103, st.nmax, &verifylistsize, UINT32_PRIMES);
+
+// end of the batch segment starting at p.  a job that resumed from a later checkpoint than the others starts
+// a segment, so every job searches whole segments from its own p.
+uint64_t batchStop( workStatus * job, bool * active, uint32_t jobcount, uint64_t range, uint64_t p ){
+	uint64_t stop = 0;
+	for(uint32_t j = 0; j < jobcount; ++j){
+		if(!active[j]){
+			continue;
+		}
+		if(!stop){
+			stop = segmentStop(job[j], range, p);
+		}
+		if(job[j].p > p && job[j].p < stop){
+			stop = job[j].p;
+		}
 	}
-	else if(st.compositorial){
-		size_t allprimesize;
-		uint32_t * allprime = (uint32_t*)primesieve_generate_primes(45, st.nmax, &allprimesize, UINT32_PRIMES);
-		verifylist = (uint32_t *)malloc(st.nmax*sizeof(uint32_t));
-		if( verifylist == NULL ){
-			fprintf(stderr,"malloc error: verifylist\n");
-			exit(EXIT_FAILURE);
+	return stop;
+}
+
+
+// search segments of every job of the batch until P is done or the checkpoint is due.  the primes of a
+// segment are generated once by job gen and copied by the other jobs before gen searches it.  a job whose
+// checkpoint is past the segment skips it.
+void sieveBatch( deviceData * dev, workStatus * job, bool * active, uint32_t jobcount, uint32_t gen, uint32_t ** h_iterprime,
+		uint64_t & cursor, time_t ckpt_due, time_t & boinc_last ){
+
+	deviceData & g = dev[gen];
+	const uint64_t pmin = job[gen].pmin, pmax = job[gen].pmax;
+	const double irsize = 1.0 / (double)(pmax-pmin);
+	time_t time_curr;
+
+	uint64_t start = cursor;
+	uint64_t stop = batchStop(job, active, jobcount, g.sd.range, start);
+	uint64_t nextstart, nextstop;
+	cursor = stop;
+
+	generatePrimes(g.pd, g.sd, g.hardware, start, stop, g.buf);
+
+	while(true){
+
+		time(&time_curr);
+		if( ((int)time_curr - (int)boinc_last) > 1 ){
+			// update BOINC fraction done every 2 sec
+    			double fd = (double)(start-pmin)*irsize;
+			boinc_fraction_done(fd);
+			if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",fd*100.0);
+			boinc_last = time_curr;
 		}
-		uint32_t csize=0;
-		for(uint32_t i=0,n=45; n<st.nmax; ++n){
-			if(n == allprime[i]){
-				++i;
-				continue;
+
+		// queue the primes of the next segment, they are generated while this segment is searched
+		bool next = (time_curr < ckpt_due) && (cursor < pmax);
+		if(next){
+			nextstart = cursor;
+			nextstop = batchStop(job, active, jobcount, g.sd.range, nextstart);
+			cursor = nextstop;
+			generatePrimes(g.pd, g.sd, g.hardware, nextstart, nextstop, g.buf^1);
+		}
+
+		for(uint32_t j = 0; j < jobcount; ++j){
+			if(active[j] && j != gen && job[j].p <= start){
+				dev[j].buf = g.buf;
+				searchSegment(dev[j], job[j], h_iterprime[j], start, stop);
 			}
-			verifylist[csize++] = n;
 		}
-		free(allprime);
-		verifylistsize = csize;
+		if(job[gen].p <= start){
+			searchSegment(g, job[gen], h_iterprime[gen], start, stop);
+		}
+		else{
+			// the generator's own checkpoint is past this segment, only hand its buffer back
+			usePrimes(g.pd, job[gen], g.sd, g.hardware, g.buf);
+			releasePrimes(g.pd, g.hardware, g.buf);
+		}
+		g.buf ^= 1;
+
+		if(!next){
+			break;
+		}
+		start = nextstart;
+		stop = nextstop;
 	}
 
-	// array of primes from nmin to nmax+prime gap
-	uint32_t * h_iterprime = NULL;
-	size_t itersize = 0;
-	if(st.compositorial){ 
-		h_iterprime = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax+320, &itersize, UINT32_PRIMES);
+	for(uint32_t j = 0; j < jobcount; ++j){
+		if(active[j]){
+			drainDevice(dev[j]);
+		}
 	}
+}
 
-	sclSetGlobalSize( pd.getsegprimes, (sd.range/60)+1 );
-	sclSetGlobalSize( pd.addsmallprimes, 64 );
-	sclSetGlobalSize( pd.setup, sd.psize );
-	sclSetGlobalSize( pd.iterate, sd.psize );
-	sclSetGlobalSize( pd.check, sd.psize );
-	sclSetGlobalSize( pd.clearresult, sd.numgroups );
 
-	pd.d_primes = clCreateBuffer(hardware.context, CL_MEM_READ_WRITE, sd.psize*sizeof(cl_ulong8), NULL, &err);
-        if ( err != CL_SUCCESS ) {
-		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
-                printf( "ERROR: clCreateBuffer failure.\n" );
-		exit(EXIT_FAILURE);
-	}
-        pd.d_sum = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE, sd.numgroups*sizeof(cl_ulong), NULL, &err );
-        if ( err != CL_SUCCESS ) {
-		fprintf(stderr, "ERROR: clCreateBuffer failure.\n");
-                printf( "ERROR: clCreateBuffer failure.\n" );
-		exit(EXIT_FAILURE);
+// results and checkpoint of each job of the batch, written to the job's own files
+void checkpointBatch( deviceData * dev, workStatus * job, bool * active, uint32_t jobcount, verifyList * vl, uint64_t cursor ){
+	for(uint32_t j = 0; j < jobcount; ++j){
+		if(!active[j]){
+			continue;
+		}
+		setJobFiles(j+1);
+		if(job[j].p < cursor){
+			job[j].p = cursor;
+		}
+		getResults(&dev[j], 1, NULL, job[j], vl[j]);
+		checkpoint(job[j], dev[j].sd);
 	}
+}
 
-	// set static kernel args
-	sclSetKernelArg(pd.clearresult, 0, sizeof(cl_mem), &pd.d_primecount);
-	sclSetKernelArg(pd.clearresult, 1, sizeof(cl_mem), &pd.d_sum);
-	sclSetKernelArg(pd.clearresult, 2, sizeof(uint32_t), &sd.numgroups);
 
-	sclSetKernelArg(pd.getsegprimes, 3, sizeof(cl_mem), &pd.d_primes);
-	sclSetKernelArg(pd.getsegprimes, 4, sizeof(cl_mem), &pd.d_primecount);
+// jobs of a batch cover the same P range on one GPU.  each segment's primes are generated once and every job
+// runs its setup, iterate and check kernels on them.  jobs keep their own tables, checksum, checkpoint and
+// results file, so each job's results are the same as a single search of it.
+void cl_batch( gpuDevice & gpu, workStatus * job, uint32_t jobcount, searchData & sd ){
 
-	sclSetKernelArg(pd.addsmallprimes, 2, sizeof(cl_mem), &pd.d_primes);
-	sclSetKernelArg(pd.addsmallprimes, 3, sizeof(cl_mem), &pd.d_primecount);
+	time_t boinc_last, time_curr;
 
-	sclSetKernelArg(pd.setup, 0, sizeof(cl_mem), &pd.d_primes);
-	sclSetKernelArg(pd.setup, 1, sizeof(cl_mem), &pd.d_primecount);
+	deviceData * dev = new deviceData[jobcount]();
+	verifyList * vl = new verifyList[jobcount]();
+	uint32_t ** h_iterprime = new uint32_t * [jobcount]();
+	size_t * itersize = new size_t[jobcount]();
+	bool * active = new bool[jobcount]();
+	uint32_t gen = jobcount;
 
-	sclSetKernelArg(pd.iterate, 0, sizeof(cl_mem), &pd.d_primes);
-	sclSetKernelArg(pd.iterate, 1, sizeof(cl_mem), &pd.d_primecount);
-	sclSetKernelArg(pd.iterate, 2, sizeof(cl_mem), &pd.d_factor);
+	for(uint32_t j = 0; j < jobcount; ++j){
 
-	sclSetKernelArg(pd.check, 0, sizeof(cl_mem), &pd.d_primes);
-	sclSetKernelArg(pd.check, 1, sizeof(cl_mem), &pd.d_primecount);
-	sclSetKernelArg(pd.check, 2, sizeof(cl_mem), &pd.d_sum);
-	if(st.factorial || st.compositorial){
-		uint32_t lastn = st.nmax-1;
-		sclSetKernelArg(pd.check, 3, sizeof(uint32_t), &lastn);
-	}
+		workStatus & st = job[j];
+		searchData & jsd = dev[j].sd;
 
-	time(&boinc_last);
-	time(&ckpt_last);
-	time_t totals, totalf;
-	if(boinc_is_standalone()){
-		time(&totals);
-	}
+		fprintf(stderr,"Job %u\n", j+1);
+		if(boinc_is_standalone()){
+			printf("Job %u\n", j+1);
+		}
 
-	float kernel_ms;
-	int kernelq = 0;
-	const int maxq = sd.compute ? 20 : 100;		// target kernel queue depth is 1 second
-	cl_event launchEvent = NULL;
-	const double irsize = 1.0 / (double)(st.pmax-st.pmin);
+		setJobFiles(j+1);
+		jsd = sd;
+		setupSearch(st, jsd);
+		jsd.mont32 = (st.pmax <= 0x100000000);
+		jsd.retire = st.compositorial ? (st.pmin < (st.nmax+1)/2) : (st.pmin < st.nmax);
+		startSearch(st, jsd);
 
-	sclEnqueueKernel(hardware, pd.clearresult);
+		// finished before this run
+		if(st.p == st.pmax){
+			continue;
+		}
+		active[j] = true;
 
-	// main search loop
-	while(st.p < st.pmax){
+		if(st.compositorial){
+			h_iterprime[j] = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax+320, &itersize[j], UINT32_PRIMES);
+		}
+		else if(st.primorial && jsd.retire){
+			h_iterprime[j] = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax-1, &itersize[j], UINT32_PRIMES);
+		}
+		vl[j] = buildVerifyList(st);
 
-		uint64_t stop = st.p + sd.range;
-		if(stop > st.pmax || stop < st.p){
-			// ck overflow
-			stop = st.pmax;
+		// primes are generated in the layout of a combined job when there is one, single mode jobs
+		// copy p and q from it
+		if(gen == jobcount || (jsd.combined && !dev[gen].sd.combined)){
+			gen = j;
 		}
+	}
 
-		// clear prime count
-		sclEnqueueKernel(hardware, pd.clearn);
-		
-		time(&time_curr);
-		if( ((int)time_curr - (int)boinc_last) > 1 ){
-			// update BOINC fraction done every 2 sec
-    			double fd = (double)(st.p-st.pmin)*irsize;
-			boinc_fraction_done(fd);
-			if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",fd*100.0);
-			boinc_last = time_curr;
-			if( ((int)time_curr - (int)ckpt_last) > 60 ){
-				// 1 minute checkpoint
-				if(kernelq > 0){
-					waitOnEvent(hardware, launchEvent);
-					kernelq = 0;
-				}
-				sleepCPU(hardware);
-				boinc_begin_critical_section();
-				getResults(pd, st, sd, hardware, h_checksum, h_primecount, verifylist, verifylistsize);
-				checkpoint(st, sd);
-				boinc_end_critical_section();
-				ckpt_last = time_curr;
-				// clear result arrays
-				sclEnqueueKernel(hardware, pd.clearresult);
+	if(gen < jobcount){
+
+		if(dev[gen].sd.mont32){
+			fprintf(stderr,"Using 32 bit kernels\n");
+			if(boinc_is_standalone()){
+				printf("Using 32 bit kernels\n");
 			}
 		}
 
-		// add small primes that cannot be generated with getsegprimes kernel
-		if(st.p < 114){
-			uint64_t stop_sm = (stop > 114) ? 114 : stop;
-			sclSetKernelArg(pd.addsmallprimes, 0, sizeof(uint64_t), &st.p);
-			sclSetKernelArg(pd.addsmallprimes, 1, sizeof(uint64_t), &stop_sm);
-			sclEnqueueKernel(hardware, pd.addsmallprimes);
-			st.p = stop_sm;
-		}
-
-		// get a segment of primes (2-PRPs).  very fast, target kernel time is 1ms
-		int32_t wheelidx;
-		uint64_t kernel_start = st.p;
-		findWheelOffset(kernel_start, wheelidx);
-		
-		sclSetKernelArg(pd.getsegprimes, 0, sizeof(uint64_t), &kernel_start);
-		sclSetKernelArg(pd.getsegprimes, 1, sizeof(uint64_t), &stop);
-		sclSetKernelArg(pd.getsegprimes, 2, sizeof(int32_t), &wheelidx);
-		sclEnqueueKernel(hardware, pd.getsegprimes);
-
-		uint32_t sstart = 0;
-		uint32_t smax;
-		uint32_t nstart = (st.factorial || st. compositorial) ? st.nmin : 0;
-		uint32_t nmax;
-		uint32_t nextprimepos = 0;
-
-		// setup power table, then profile setup kernel once at program start.  adjust work size to target kernel runtime.
-		if(first_iteration){
-			if(st.factorial){
-				setupPowerTable(pd, st, sd, hardware, h_primecount);
-			}
-			if(st.primorial){
-				setupPrimeProducts(pd, st, sd, hardware, h_primecount);
-			}
-			if(st.compositorial){
-				setupCompositeProducts(pd, st, sd, hardware, h_primecount, h_iterprime, itersize);
-			}
-			if(st.factorial && st.compositorial){
-				sclSetKernelArg(pd.setup, 8, sizeof(uint32_t), &sd.powcount);
-				sclSetKernelArg(pd.setup, 9, sizeof(uint32_t), &sd.prodcount);
+		// the generator is profiled first, the other jobs use its segment size
+		for(uint32_t k = 0; k < jobcount; ++k){
+			uint32_t j = (k == 0) ? gen : ((k <= gen) ? k-1 : k);
+			if(!active[j]){
+				continue;
 			}
-			fprintf(stderr,"Starting Sieve...\n");
+			fprintf(stderr,"Setting up job %u\n", j+1);
 			if(boinc_is_standalone()){
-				printf("Starting Sieve...\n");
-			}
-			sd.scount = (sd.powcount > sd.prodcount) ? sd.powcount : sd.prodcount;
-			smax = sstart + sd.sstep;
-			if(smax > sd.scount)smax = sd.scount;
-			sclSetKernelArg(pd.setup, 3, sizeof(uint32_t), &sstart);
-			sclSetKernelArg(pd.setup, 4, sizeof(uint32_t), &smax);
-			kernel_ms = ProfilesclEnqueueKernel(hardware, pd.setup);
-			sstart += sd.sstep;
-			double multi = sd.compute ? 50.0/kernel_ms : 20.0/kernel_ms;	// target kernel time 50ms or 20ms, first iterations have large powers, avg kernel time is less
-			uint32_t new_sstep = (uint32_t)( multi * (double)sd.sstep );
-			if(!new_sstep) new_sstep=1;
-			sd.sstep = new_sstep;
-		}
-
-		// setup residue for nmin# / nmin! mod P
-		for(; sstart < sd.scount; sstart += sd.sstep){
-			smax = sstart + sd.sstep;
-			if(smax > sd.scount)smax = sd.scount;
-			sclSetKernelArg(pd.setup, 3, sizeof(uint32_t), &sstart);
-			sclSetKernelArg(pd.setup, 4, sizeof(uint32_t), &smax);
-			if(kernelq == 0){
-				launchEvent = sclEnqueueKernelEvent(hardware, pd.setup);
-			}
-			else{
-				sclEnqueueKernel(hardware, pd.setup);
-			}
-			if(++kernelq == maxq){
-				// limit cl queue depth and sleep cpu
-				waitOnEvent(hardware, launchEvent);
-				kernelq = 0;
+				printf("Setting up job %u\n", j+1);
 			}
+			dev[j].hardware = gpu.hardware;
+			dev[j].sd.maxmalloc = gpu.maxmalloc;
+			dev[j].sd.computeunits = gpu.computeunits;
+			dev[j].sd.compute = gpu.compute;
+			dev[j].source = (j == gen) ? NULL : &dev[gen];
+			setupKernelSize(dev[j].sd);
+			setupDevice(dev[j], job[j], h_iterprime[j], itersize[j]);
 		}
 
-		// profile iterate kernel once at program start.  adjust work size to target kernel runtime.
-		if(first_iteration){
-			first_iteration = false;
-			if(st.compositorial){
-				sclSetKernelArg(pd.iterate, 6, sizeof(uint32_t), &nextprimepos);
-			}
-			nmax = nstart + sd.nstep;
-			if(nmax > sd.nlimit)nmax = sd.nlimit;
-			sclSetKernelArg(pd.iterate, 3, sizeof(uint32_t), &nstart);
-			sclSetKernelArg(pd.iterate, 4, sizeof(uint32_t), &nmax);
-			kernel_ms = ProfilesclEnqueueKernel(hardware, pd.iterate);
-			nstart += sd.nstep;
-			double multi = sd.compute ? 50.0/kernel_ms : 10.0/kernel_ms;	// target kernel time 50ms or 10ms
-			uint32_t new_nstep = (uint32_t)( multi * (double)sd.nstep );
-			if(!new_nstep) new_nstep=1;
-			sd.nstep = new_nstep;
-			fprintf(stderr,"c:%u u:%u t:%u r:%u p:%u s:%u n:%u\n", (uint32_t)sd.compute, sd.computeunits, sd.threadcount, sd.range, sd.psize, sd.sstep, sd.nstep);
-			if(boinc_is_standalone()){
-				printf("c:%u u:%u t:%u r:%u p:%u s:%u n:%u\n", (uint32_t)sd.compute, sd.computeunits, sd.threadcount, sd.range, sd.psize, sd.sstep, sd.nstep);
+		fprintf(stderr,"Starting Sieve...\n");
+		if(boinc_is_standalone()){
+			printf("Starting Sieve...\n");
+		}
+
+		time(&boinc_last);
+		time_t totals, totalf;
+		if(boinc_is_standalone()){
+			time(&totals);
+		}
+
+		// jobs resumed from different checkpoints start at the earliest one
+		uint64_t cursor = job[gen].pmax;
+		for(uint32_t j = 0; j < jobcount; ++j){
+			if(active[j] && job[j].p < cursor){
+				cursor = job[j].p;
 			}
 		}
 
-		// iterate from nmin# / nmin! to nmax# / nmax-1! mod P
-		for(; nstart < sd.nlimit; nstart += sd.nstep){
-			if(st.compositorial){
-				while(h_iterprime[nextprimepos] < nstart){
-					++nextprimepos;
+		// main search loop, one pass per checkpoint
+		while(cursor < job[gen].pmax){
+
+			// 1 minute checkpoint
+			time(&time_curr);
+			time_t ckpt_due = time_curr + 60;
+
+			sieveBatch(dev, job, active, jobcount, gen, h_iterprime, cursor, ckpt_due, boinc_last);
+
+			if(cursor < job[gen].pmax){
+				boinc_begin_critical_section();
+				checkpointBatch(dev, job, active, jobcount, vl, cursor);
+				boinc_end_critical_section();
+				// clear result arrays
+				for(uint32_t j = 0; j < jobcount; ++j){
+					if(active[j]){
+						sclEnqueueKernel(dev[j].hardware, dev[j].pd.clearresult);
+					}
 				}
-				sclSetKernelArg(pd.iterate, 6, sizeof(uint32_t), &nextprimepos);
 			}
-			nmax = nstart + sd.nstep;
-			if(nmax > sd.nlimit)nmax = sd.nlimit;
-			sclSetKernelArg(pd.iterate, 3, sizeof(uint32_t), &nstart);
-			sclSetKernelArg(pd.iterate, 4, sizeof(uint32_t), &nmax);
-			if(kernelq == 0){
-				launchEvent = sclEnqueueKernelEvent(hardware, pd.iterate);
-			}
-			else{
-				sclEnqueueKernel(hardware, pd.iterate);
-			}
-			if(++kernelq == maxq){
-				// limit cl queue depth and sleep cpu
-				waitOnEvent(hardware, launchEvent);
-				kernelq = 0;
+		}
+
+		// final checkpoint
+		boinc_begin_critical_section();
+		boinc_fraction_done(1.0);
+		if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",100.0);
+		checkpointBatch(dev, job, active, jobcount, vl, cursor);
+		for(uint32_t j = 0; j < jobcount; ++j){
+			if(active[j]){
+				setJobFiles(j+1);
+				finalizeResults(job[j]);
 			}
 		}
+		boinc_end_critical_section();
 
-		// checksum kernel
-		sclEnqueueKernel(hardware, pd.check);
+		fprintf(stderr,"Sieve complete.\n");
+		for(uint32_t j = 0; j < jobcount; ++j){
+			if(active[j]){
+				fprintf(stderr,"job %u factors %" PRIu64 ", prime count %" PRIu64 "\n", j+1, job[j].factorcount, job[j].primecount);
+			}
+		}
 
-		st.p = stop;
+		if(boinc_is_standalone()){
+			time(&totalf);
+			printf("Sieve finished in %d sec.\n", (int)totalf - (int)totals);
+			for(uint32_t j = 0; j < jobcount; ++j){
+				if(active[j]){
+					printf("job %u factors %" PRIu64 ", prime count %" PRIu64 ", checksum %016" PRIX64 "\n",
+						j+1, job[j].factorcount, job[j].primecount, job[j].checksum);
+				}
+			}
+		}
 
+		for(uint32_t j = 0; j < jobcount; ++j){
+			if(active[j]){
+				// keep the step sizes retuned during the run
+				tuneStore(dev[j].tunekey, dev[j].sd);
+				sclFreePinned(dev[j].hardware, dev[j].pd.h_sum);
+				sclFreePinned(dev[j].hardware, dev[j].pd.h_count);
+				sclFreePinned(dev[j].hardware, dev[j].pd.h_factor);
+				cleanup(dev[j].pd, dev[j].sd, job[j]);
+			}
+		}
 	}
-
-	// final checkpoint
-	if(kernelq > 0){
-		waitOnEvent(hardware, launchEvent);
+	else{
+		fprintf(stderr,"Batch complete.\n");
+		if(boinc_is_standalone()){
+			printf("Batch complete.\n");
+		}
 	}
-	sleepCPU(hardware);
-
-	boinc_begin_critical_section();
-	st.p = st.pmax;
-	boinc_fraction_done(1.0);
-	if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",100.0);
-	getResults(pd, st, sd, hardware, h_checksum, h_primecount, verifylist, verifylistsize);
-	checkpoint(st, sd);
-	finalizeResults(st);
-	boinc_end_critical_section();
-
-	fprintf(stderr,"Sieve complete.\nfactors %" PRIu64 ", prime count %" PRIu64 "\n", st.factorcount, st.primecount);
 
-	if(boinc_is_standalone()){
-		time(&totalf);
-		printf("Sieve finished in %d sec.\n", (int)totalf - (int)totals);
-		printf("factors %" PRIu64 ", prime count %" PRIu64 ", checksum %016" PRIX64 "\n", st.factorcount, st.primecount, st.checksum);
+	for(uint32_t j = 0; j < jobcount; ++j){
+		free(h_iterprime[j]);
+		freeVerifyList(vl[j]);
 	}
+	setJobFiles(0);
+	delete [] dev;
+	delete [] vl;
+	delete [] h_iterprime;
+	delete [] itersize;
+	delete [] active;
+}
 
-	free(h_checksum);
-	free(h_primecount);
-	cleanup(pd, sd, st);
-	if(st.primorial){
-		free(verifylist);
+
+// run the search on the selected backend
+void run_sieve( gpuDevice * gpu, uint32_t gpucount, workStatus & st, searchData & sd ){
+	if(sd.cpu){
+		cpu_sieve( st, sd );
 	}
-	else if(st.compositorial){
-		free(h_iterprime);
-		free(verifylist);
+	else{
+		cl_sieve( gpu, gpucount, st, sd );
 	}
 }
 
@@ -1768,17 +3310,18 @@ void reset_data(workStatus & st, searchData & sd){
 	sd.scount = 0;
 	sd.powcount = 0;
 	sd.prodcount = 0;
+	sd.primprodcount = 0;
 	st.factorial = false;
 	st.primorial = false;
 	st.compositorial = false;
 }
 
 
-void run_test( sclHard hardware, workStatus & st, searchData & sd ){
+void run_test( gpuDevice * gpu, uint32_t gpucount, workStatus & st, searchData & sd ){
 
 	int goodtest = 0;
 
-	printf("Beginning self test of 16 ranges.\n");
+	printf("Beginning self test of 20 ranges.\n");
 
 	time_t start, finish;
 	time(&start);
@@ -1791,7 +3334,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 101000000;
 	st.nmin = 1000000;
 	st.nmax = 2000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 1071 && st.primecount == 54211 && st.checksum == 0x000004F844B5103C ){
 		printf("test case 1 passed.\n\n");
 		fprintf(stderr,"test case 1 passed.\n");
@@ -1809,7 +3352,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 1000010000000;
 	st.nmin = 10000;
 	st.nmax = 2000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 3 && st.primecount == 361727 && st.checksum == 0x0505A1C238896511 ){
 		printf("test case 2 passed.\n\n");
 		fprintf(stderr,"test case 2 passed.\n");
@@ -1827,7 +3370,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 100000;
 	st.nmin = 101;
 	st.nmax = 1000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 42821 && st.primecount == 9571 && st.checksum == 0x0000000065DDB8A0 ){
 		printf("test case 3 passed.\n\n");
 		fprintf(stderr,"test case 3 passed.\n");
@@ -1845,7 +3388,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 1000001000000;
 	st.nmin = 100000000;
 	st.nmax = 110000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 3 && st.primecount == 36249 && st.checksum == 0x00804FE7D7AA6C09 ){
 		printf("test case 4 passed.\n\n");
 		fprintf(stderr,"test case 4 passed.\n");
@@ -1864,7 +3407,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 101000000;
 	st.nmin = 101;
 	st.nmax = 25000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 1703 && st.primecount == 54211 && st.checksum == 0x0000027EFF497990 ){
 		printf("test case 5 passed.\n\n");
 		fprintf(stderr,"test case 5 passed.\n");
@@ -1882,7 +3425,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 2000000;
 	st.nmin = 101;
 	st.nmax = 2000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 24503 && st.primecount == 148954 && st.checksum == 0x000000027BF5B8E0 ){
 		printf("test case 6 passed.\n\n");
 		fprintf(stderr,"test case 6 passed.\n");
@@ -1900,7 +3443,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 100005000000;
 	st.nmin = 9000000;
 	st.nmax = 110000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 32 && st.primecount == 197222 && st.checksum == 0x0022FE7C09210B4B ){
 		printf("test case 7 passed.\n\n");
 		fprintf(stderr,"test case 7 passed.\n");
@@ -1918,7 +3461,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 1730720720000000;
 	st.nmin = 600000;
 	st.nmax = 30000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 1 && st.primecount == 114208 && st.checksum == 0x5CDCB47F7E9532C2 ){
 		printf("test case 8 passed.\n\n");
 		fprintf(stderr,"test case 8 passed.\n");
@@ -1937,7 +3480,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 200010000;
 	st.nmin = 101;
 	st.nmax = 26000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 127 && st.primecount == 529 && st.checksum == 0x0000001848D8AFBB ){
 		printf("test case 9 passed.\n\n");
 		fprintf(stderr,"test case 9 passed.\n");
@@ -1955,7 +3498,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 100000;
 	st.nmin = 101;
 	st.nmax = 1000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 34271 && st.primecount == 9571 && st.checksum == 0x000000006FF88EAE ){
 		printf("test case 10 passed.\n\n");
 		fprintf(stderr,"test case 10 passed.\n");
@@ -1973,7 +3516,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 200005000000;
 	st.nmin = 15000000;
 	st.nmax = 20000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 13 && st.primecount == 192386 && st.checksum == 0x0088B59C23CD3E2B ){
 		printf("test case 11 passed.\n\n");
 		fprintf(stderr,"test case 11 passed.\n");
@@ -1991,7 +3534,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 1000001000000;
 	st.nmin = 700000;
 	st.nmax = 25000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 2 && st.primecount == 36249 && st.checksum == 0x0080997AF3BF42FE ){
 		printf("test case 12 passed.\n\n");
 		fprintf(stderr,"test case 12 passed.\n");
@@ -2011,7 +3554,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 100010000000;
 	st.nmin = 96000;
 	st.nmax = 2000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 27 && st.primecount == 394403 && st.checksum == 0x00D214CC0EF0ECB4 ){
 		printf("test case 13 passed.\n\n");
 		fprintf(stderr,"test case 13 passed.\n");
@@ -2030,7 +3573,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 110000;
 	st.nmin = 101;
 	st.nmax = 1000000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 84077 && st.primecount == 10433 && st.checksum == 0x00000000EFB634E9 ){
 		printf("test case 14 passed.\n\n");
 		fprintf(stderr,"test case 14 passed.\n");
@@ -2049,7 +3592,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 10101000000;
 	st.nmin = 11500000;
 	st.nmax = 12500000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 19 && st.primecount == 43374 && st.checksum == 0x0002578EA9FD63C7 ){
 		printf("test case 15 passed.\n\n");
 		fprintf(stderr,"test case 15 passed.\n");
@@ -2068,7 +3611,7 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 	st.pmax = 2000020000000;
 	st.nmin = 670000;
 	st.nmax = 2460000;
-	cl_sieve( hardware, st, sd );
+	run_sieve( gpu, gpucount, st, sd );
 	if( st.factorcount == 3 && st.primecount == 706162 && st.checksum == 0x1D63BBC574E8D50F ){
 		printf("test case 16 passed.\n\n");
 		fprintf(stderr,"test case 16 passed.\n");
@@ -2079,8 +3622,97 @@ void run_test( sclHard hardware, workStatus & st, searchData & sd ){
 		fprintf(stderr,"test case 16 failed.\n");
 	}
 
+	printf("Starting 2-PRP tests\n\n");
+//	-p 1e5 -P 2e5 -n 500 -N 3000 -!
+//	the prime list has 2-PRPs like 104653 = 229*457 whose factors are all below nmin, their residue is zero after setup
+	reset_data(st, sd);
+	st.factorial = true;
+	st.pmin = 100000;
+	st.pmax = 200000;
+	st.nmin = 500;
+	st.nmax = 3000;
+	run_sieve( gpu, gpucount, st, sd );
+	if( st.factorcount == 292 && st.primecount == 8395 && st.checksum == 0x000000004AE4EEDB ){
+		printf("test case 17 passed.\n\n");
+		fprintf(stderr,"test case 17 passed.\n");
+		++goodtest;
+	}
+	else{
+		printf("test case 17 failed.\n\n");
+		fprintf(stderr,"test case 17 failed.\n");
+	}
+
+//	-p 1016000 -P 1017000 -n 1016000 -N 1016700 -!
+//	p-1-(nmin-1) is small so the setup uses Wilson's theorem.  the 2-PRP 1016801 = 251*4051 must get the zero residue of the power table
+	reset_data(st, sd);
+	st.factorial = true;
+	st.pmin = 1016000;
+	st.pmax = 1017000;
+	st.nmin = 1016000;
+	st.nmax = 1016700;
+	run_sieve( gpu, gpucount, st, sd );
+	if( st.factorcount == 102 && st.primecount == 73 && st.checksum == 0x0000000008EE3DC7 ){
+		printf("test case 18 passed.\n\n");
+		fprintf(stderr,"test case 18 passed.\n");
+		++goodtest;
+	}
+	else{
+		printf("test case 18 failed.\n\n");
+		fprintf(stderr,"test case 18 failed.\n");
+	}
+
+//	-p 1.19e6 -P 1.2e6 -n 3000 -N 6000 -! -# -c
+//	the 2-PRP 1194649 = 1093^2 divides n! and n!/# but never n#, its primorial residue is iterated to N
+	reset_data(st, sd);
+	st.factorial = true;
+	st.primorial = true;
+	st.compositorial = true;
+	st.pmin = 1190000;
+	st.pmax = 1200000;
+	st.nmin = 3000;
+	st.nmax = 6000;
+	run_sieve( gpu, gpucount, st, sd );
+	if( st.factorcount == 11 && st.primecount == 714 && st.checksum == 0x000000006435479A ){
+		printf("test case 19 passed.\n\n");
+		fprintf(stderr,"test case 19 passed.\n");
+		++goodtest;
+	}
+	else{
+		printf("test case 19 failed.\n\n");
+		fprintf(stderr,"test case 19 failed.\n");
+	}
+
+	printf("Starting survivors test\n\n");
+//	-p 3 -P 3e6 -n 500 -N 3000 -! --survivors with an empty results file, every candidate is left
+//	4504 factors without it.  only the smallest factor of a candidate is reported
+	FILE * survfile = my_fopen("survivors_test.txt","w");
+	if( survfile == NULL ){
+		fprintf(stderr,"Cannot open survivors_test.txt !!!\n");
+		exit(EXIT_FAILURE);
+	}
+	fclose(survfile);
+	survivorSetFile("survivors_test.txt");
+	reset_data(st, sd);
+	st.factorial = true;
+	st.pmin = 3;
+	st.pmax = 3000000;
+	st.nmin = 500;
+	st.nmax = 3000;
+	run_sieve( gpu, gpucount, st, sd );
+	survivorSetFile("");
+	remove("survivors_test.txt");
+	if( st.factorcount == 2989 && st.primecount == 216877 && st.checksum == 0x00000048BAF030F7 ){
+		printf("test case 20 passed.\n\n");
+		fprintf(stderr,"test case 20 passed.\n");
+		++goodtest;
+	}
+	else{
+		printf("test case 20 failed.\n\n");
+		fprintf(stderr,"test case 20 failed.\n");
+	}
+
 //	done
-	if(goodtest == 16){
+	if(goodtest == 20){
 		printf("All test cases completed successfully!\n");
 		fprintf(stderr, "All test cases completed successfully!\n");
 	}
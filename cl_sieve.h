@@ -19,22 +19,99 @@ typedef struct {
 
 typedef struct {
 	uint64_t maxmalloc;
-	uint32_t computeunits, nstep, sstep, powcount, prodcount, scount, numresults, threadcount, range, psize, numgroups, nlimit;
-	bool test, compute, write_state_a_next;
+	uint32_t computeunits, nstep, sstep, powcount, prodcount, primprodcount, scount, numresults, threadcount, range, psize, numgroups, nlimit, presieve, sievecount, queuedepth, cputhreads;
+	bool test, retune, alldevices, compute, write_state_a_next, cpu, mont32, retire, compinv, combined;
 }searchData;
 
 typedef struct {
+	cl_program program;
+	cl_command_queue primequeue;	// prime generation, runs ahead of the compute queue by one segment
+	cl_event primesready[2], computedone[2];
 	cl_mem d_factor;
 	cl_mem d_sum;
-	cl_mem d_primes;
+	cl_mem d_primes;		// prime buffer of the segment on the compute queue
+	cl_mem d_primebuf[2];
+	cl_mem d_segcount[2];		// prime count of each buffer
 	cl_mem d_primecount;
+	sclPinned h_sum, h_count, h_factor;	// checkpoint readback, reused at every checkpoint
 	cl_mem d_smallprimes;
 	cl_mem d_powers;
 	cl_mem d_primeproducts;
+	cl_mem d_primproducts;
 	cl_mem d_compproducts;
-	sclSoft check, iterate, clearn, clearresult, setup, getsegprimes, addsmallprimes, verifyslow, verify, verifyreduce, verifyresult;
+	cl_mem d_compact;
+	cl_mem d_holes;
+	cl_mem d_sieveprimes;
+	cl_mem d_alive, d_left;		// candidate bits of --survivors at the segment start, less the factors of the segment
+	uint32_t stagingbound, staging;	// getsegprimes local buffer size, computed again when the presieve bound changes
+	sclSoft compactclear, compactcount, compactholes, compactmove;
+	sclSoft check, iterate, clearn, clearresult, setup, reflect, getsegprimes, addsmallprimes, verifyslow, verify, verifyreduce, verifyresult;
 }progData;
 
-void cl_sieve( sclHard hardware, workStatus & st, searchData & sd );
+// an OpenCL device of the search.  main.cpp fills in the vendor heuristics that seed its kernel sizes
+typedef struct {
+	sclHard hardware;
+	uint64_t maxmalloc;
+	uint32_t computeunits;
+	bool compute;
+}gpuDevice;
+
+// each device has its own program, tables, prime buffers and kernel sizes
+typedef struct deviceData {
+	sclHard hardware;
+	progData pd;
+	searchData sd;
+	char tunekey[2200];		// tuning database line of the device
+	bool tuned, profiled;
+	int buf;			// prime buffer of the next segment
+	int kernelq;
+	cl_event launchEvent;
+	uint32_t * samplestep;		// NULL when the sampled launch was cut short at the end of a table
+	uint32_t samplesize;
+	double sampletarget, setup_ms, iterate_ms;
+	struct deviceData * source;	// batch job that generates this job's primes, NULL when it generates its own
+}deviceData;
+
+// P segments handed out to the GPUs and the CPU share of the search.  worker cpu is the CPU, it is equal to
+// the GPU count when the CPU doesn't search.
+typedef struct {
+	uint64_t cursor;		// start of the next segment
+	uint32_t cpu;
+	double start;			// omp_get_wtime at the start of the checkpoint interval
+	uint64_t * claimed;		// p claimed by each worker in the interval
+	double * rate;			// p per second of each worker
+}segmentQueue;
+
+// primes and composites used during CPU factor verification
+typedef struct {
+	uint32_t * primes;
+	uint32_t * composites;
+	size_t primesize, compsize;
+}verifyList;
+
+void cl_sieve( gpuDevice * gpu, uint32_t gpucount, workStatus & st, searchData & sd );
+
+void cl_batch( gpuDevice & gpu, workStatus * job, uint32_t jobcount, searchData & sd );
+
+void run_test( gpuDevice * gpu, uint32_t gpucount, workStatus & st, searchData & sd );
+
+// host functions shared by the OpenCL and CPU backends
+void setupSearch( workStatus & st, searchData & sd );
+
+void startSearch( workStatus & st, searchData & sd );
+
+void checkpoint( workStatus & st, searchData & sd );
+
+void finalizeResults( workStatus & st );
+
+void reportFactors( workStatus & st, factor * h_factor, uint32_t numfactors, verifyList & vl );
+
+uint32_t buildPowerTable( workStatus & st, cl_ulong ** table, cl_uint2 ** powers, bool composite );
+
+uint32_t buildPrimeProducts( workStatus & st, cl_ulong2 ** table, size_t & smsize );
+
+uint32_t buildCompositeProducts( workStatus & st, cl_ulong2 ** table );
+
+verifyList buildVerifyList( workStatus & st );
 
-void run_test( sclHard hardware, workStatus & st, searchData & sd );
+void freeVerifyList( verifyList & vl );
@@ -0,0 +1,665 @@
+/*
+	cpu_sieve.cpp - Bryan Little 4/2025, montgomery arithmetic by Yves Gallot
+
+	CPU backend, selected with --backend=cpu
+
+	Runs the same getsegprimes -> setup -> iterate -> check pipeline as the OpenCL
+	kernels using OpenMP threads.  Each sieve prime is handled by one thread from setup
+	to check, so results are identical to the GPU: same 2-PRP list, same Montgomery
+	residues, same checksum.  Factor verification and checkpoints are shared with cl_sieve.cpp.
+
+	With --cputhreads the same segment search runs next to the GPUs, cl_sieve.cpp hands it a share
+	of the P segments and merges its results at each checkpoint.
+
+*/
+
+#include <unistd.h>
+#include <string.h>
+#include <cinttypes>
+#include <math.h>
+#include <omp.h>
+
+#include "boinc_api.h"
+#include "simpleCL.h"
+
+#include "primesieve.h"
+#include "cl_sieve.h"
+#include "cpu_sieve.h"
+#include "survivors.h"
+#include "verifyprime.h"
+
+// target time for one segment of primes, seconds
+#define SEGMENT_TIME 1.0
+// largest segment, limits memory used by the segment sieve
+#define MAX_RANGE 33554432
+
+typedef struct cpuData {
+	cl_ulong * primeproducts;	// factorial power table
+	cl_uint2 * powers;
+	cl_ulong2 * primproducts;	// primorial prime products
+	cl_ulong2 * compproducts;
+	uint32_t * iterprime;		// primes used by primorial and compositorial iterate
+	size_t itersize;
+	uint64_t * primes;		// 2-PRPs of the segment
+	uint8_t * sieve;
+	factor * factors;
+	uint32_t numfactors, maxfactors;
+	uint32_t * alive, * left;	// --survivors bits at the segment start, less the prime factors of the segment
+	size_t alivewords;
+	uint64_t checksum, primecount;	// segments searched since the last checkpoint
+	bool validation_error;
+}cpuData;
+
+
+static inline uint64_t m_mul(uint64_t a, uint64_t b, uint64_t p, uint64_t q){
+	unsigned __int128 ab = (unsigned __int128)a * b;
+	uint64_t m = (uint64_t)ab * q;
+	uint64_t mp = (uint64_t)(((unsigned __int128)m * p) >> 64);
+	uint64_t ab1 = (uint64_t)(ab >> 64);
+	uint64_t r = ab1 - mp;
+	return ( ab1 < mp ) ? r + p : r;
+}
+
+// a * (b.s0 + 2^64 b.s1) / 2^128 mod p, same as m_mul128 in setup.cl
+static inline uint64_t m_mul128(uint64_t a, cl_ulong2 b, uint64_t p, uint64_t q){
+	unsigned __int128 lo = (unsigned __int128)a * b.s0;
+	unsigned __int128 hi = (unsigned __int128)a * b.s1 + (uint64_t)(lo >> 64);
+	uint64_t t1 = (uint64_t)hi;
+	uint64_t t2 = (uint64_t)(hi >> 64);
+	// low word cancels
+	uint64_t m = (uint64_t)lo * q;
+	uint64_t mp = (uint64_t)(((unsigned __int128)m * p) >> 64);
+	t2 -= (t1 < mp) ? 1 : 0;
+	t1 -= mp;
+	// t2 is -1 or less than p
+	m = t1 * q;
+	mp = (uint64_t)(((unsigned __int128)m * p) >> 64);
+	uint64_t r = t2 - mp;
+	return ( t2 < mp || t2 == 0xFFFFFFFFFFFFFFFF ) ? r + p : r;
+}
+
+static inline uint64_t add(uint64_t a, uint64_t b, uint64_t p){
+	uint64_t c = (a >= p - b) ? p : 0;
+	return a + b - c;
+}
+
+static inline uint64_t invert(uint64_t p){
+	uint64_t p_inv = 1, prev = 0;
+	while (p_inv != prev) { prev = p_inv; p_inv *= 2 - p * p_inv; }
+	return p_inv;
+}
+
+// base 2 strong probable prime test, same as getsegprimes kernel
+static bool strong_prp_two(uint64_t N, uint64_t q, uint64_t one, uint64_t two, uint64_t nmo){
+	int t = __builtin_ctzll(N-1);
+	uint64_t exp = N >> t;
+	uint64_t curBit = 0x8000000000000000;
+	curBit >>= ( __builtin_clzll(exp) + 1 );
+	uint64_t a = two;
+	while( curBit ){
+		a = m_mul(a,a,N,q);
+		if(exp & curBit){
+			a = add(a,a,N);
+		}
+		curBit >>= 1;
+	}
+	if(a == one || a == nmo){
+		return true;
+	}
+	for(int s = 1; s < t; ++s){
+		a = m_mul(a,a,N,q);
+		if(a == nmo){
+	    		return true;
+		}
+	}
+	return false;
+}
+
+
+static inline void addFactor(cpuData & cd, uint64_t p, int32_t nc, int32_t type){
+	// same as the iterate kernels, a prime factor eliminates the candidate for the next segments.  the
+	// factors of 2-PRPs are discarded by the host
+	if(cd.alive != NULL){
+		uint64_t bit;
+		if(!survivorBit(nc, type, bit)){
+			return;
+		}
+		const uint32_t mask = 1U << (bit & 31);
+		if(!(cd.alive[bit >> 5] & mask)){
+			return;
+		}
+		if(isPrime(p)){
+			#pragma omp atomic
+			cd.left[bit >> 5] &= ~mask;
+		}
+	}
+	uint32_t i;
+	#pragma omp atomic capture
+	i = cd.numfactors++;
+	if(i < cd.maxfactors){
+		cd.factors[i].p = p;
+		cd.factors[i].nc = nc;
+		cd.factors[i].type = type;
+	}
+}
+
+
+// generate the 2-PRPs in [low, high).  same list as the addsmallprimes and getsegprimes kernels.
+static uint32_t getSegPrimes(uint64_t low, uint64_t high, uint64_t * primes, uint8_t * sieve){
+
+	const uint32_t smallprimes[30] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113};
+	uint32_t count = 0;
+
+	// primes that cannot be generated by the sieve
+	if(low < 114){
+		for(uint32_t i=0; i<30; ++i){
+			if(smallprimes[i] >= low && smallprimes[i] < high){
+				primes[count++] = smallprimes[i];
+			}
+		}
+		low = 114;
+	}
+	if(low >= high){
+		return count;
+	}
+
+	// odd numbers only, sieve[i] represents start + 2*i
+	uint64_t start = low | 1;
+	if(start >= high){
+		return count;
+	}
+	uint32_t len = (uint32_t)((high - start + 1) / 2);
+	memset(sieve, 0, len);
+	for(uint32_t i=1; i<30; ++i){
+		uint32_t sp = smallprimes[i];
+		uint32_t r = (uint32_t)(start % sp);
+		// start + 2*j == 0 mod sp
+		uint32_t j = (uint32_t)(( (uint64_t)((sp - r) % sp) * ((sp + 1) / 2) ) % sp);
+		for(; j<len; j+=sp){
+			sieve[j] = 1;
+		}
+	}
+
+	uint32_t sieved = 0;
+	for(uint32_t i=0; i<len; ++i){
+		if(!sieve[i]){
+			primes[count + sieved++] = start + 2*(uint64_t)i;
+		}
+	}
+
+	// 2-PRP test
+	#pragma omp parallel for schedule(static)
+	for(uint32_t i=0; i<sieved; ++i){
+		uint64_t p = primes[count+i];
+		uint64_t q = invert(p);
+		uint64_t one = (-p) % p;
+		uint64_t nmo = p - one;
+		uint64_t two = add(one, one, p);
+		sieve[i] = strong_prp_two(p, q, one, two, nmo);
+	}
+
+	uint32_t total = count;
+	for(uint32_t i=0; i<sieved; ++i){
+		if(sieve[i]){
+			primes[total++] = primes[count+i];
+		}
+	}
+
+	return total;
+}
+
+
+// residue of startN! mod P using the bit-sliced factorial power table, same as factorial_setup kernel
+static uint64_t factorialSetup(uint64_t p, uint64_t q, uint64_t one, uint64_t r2, cpuData & cd, uint32_t powcount){
+	uint64_t res = one;
+	for(uint32_t i=0; i<powcount; ++i){
+		// .s0=bit, .s1=squarings before this term
+		for(uint32_t k=0; k<cd.powers[i].s1; ++k){
+			res = m_mul(res, res, p, q);
+		}
+		res = m_mul(res, m_mul(cd.primeproducts[i], r2, p, q), p, q);
+	}
+	return res;
+}
+
+
+// a^(p-2) = a^-1 mod p, a in montgomery form
+static uint64_t m_inv(uint64_t a, uint64_t p, uint64_t q){
+	const uint64_t e = p-2;
+	uint64_t curBit = 0x8000000000000000;
+	curBit >>= ( __builtin_clzll(e) + 1 );
+	uint64_t r = a;
+	while( curBit ){
+		r = m_mul(r, r, p, q);
+		if(e & curBit){
+			r = m_mul(r, a, p, q);
+		}
+		curBit >>= 1;
+	}
+	return r;
+}
+
+
+// residue of startN! mod P by Wilson's theorem, startN! = (-1)^(p-startN) / (p-1-startN)!, same as factorial_reflect kernel
+static uint64_t reflectSetup(uint64_t p, uint64_t q, uint64_t one, uint32_t startN){
+	// a composite p below 2*startN divides startN!, same as the power table
+	if(!isPrime(p)){
+		return 0;
+	}
+	const uint64_t m = p-1-startN;
+	uint64_t res = one, mk = one;
+	for(uint64_t k=1; k<=m; ++k){
+		res = m_mul(res, mk, p, q);
+		mk = add(mk, one, p);
+	}
+	const uint64_t a = m_inv(res, p, q);
+	// p is odd, p-startN is odd when startN is even
+	return (startN & 1) ? a : p - a;
+}
+
+
+// residue of a 128 bit product table mod P, same as primorial_setup and compositorial_setup kernels
+static uint64_t productSetup(uint64_t p, uint64_t q, uint64_t one, uint64_t r2, const cl_ulong2 * table, uint32_t count){
+	uint64_t res = one;
+	for(uint32_t i=0; i<count; ++i){
+		res = m_mul128(res, table[i], p, q);
+	}
+	// multiply by 2^128 for each product
+	const uint32_t e = 2*count;
+	uint32_t curBit = 0x80000000;
+	curBit >>= ( __builtin_clz(e) + 1 );
+	uint64_t a = r2;
+	while( curBit ){
+		a = m_mul(a, a, p, q);
+		if(e & curBit){
+			a = m_mul(a, r2, p, q);
+		}
+		curBit >>= 1;
+	}
+	return m_mul(res, a, p, q);
+}
+
+
+// setup, iterate, and check one sieve prime.  returns the prime's checksum term.
+static uint64_t sievePrime(uint64_t p, workStatus & st, searchData & sd, cpuData & cd, uint32_t itersize){
+
+	const uint64_t q = invert(p);
+	const uint64_t one = (-p) % p;
+	const uint64_t nmo = p - one;
+	const uint64_t two = add(one, one, p);
+	uint64_t r2 = add(two, two, p);
+	for(int i=0; i<5; ++i){
+		r2 = m_mul(r2, r2, p, q);	// 4^{2^5} = 2^64
+	}
+
+	if(st.primorial && !st.compositorial){
+		uint64_t res = productSetup(p, q, one, r2, cd.primproducts, sd.primprodcount);
+		for(uint32_t j=0; j<itersize; ++j){
+			uint32_t n = cd.iterprime[j];
+			res = m_mul(res, m_mul(n, r2, p, q), p, q);
+			if(res == one || res == nmo){
+				addFactor(cd, p, (res == one) ? -((int32_t)n) : (int32_t)n, PRIMORIAL);
+			}
+		}
+		return res;
+	}
+
+	const uint32_t lastn = st.nmax-1;
+	uint64_t mn = m_mul(st.nmin-1, r2, p, q);	// n in montgomery form
+	uint64_t fres = 0, pres = 0, cres = 0;
+	uint32_t ppos = 0;
+
+	if(st.primorial){
+		// all three forms, startN! = startN# * startN!/#
+		pres = productSetup(p, q, one, r2, cd.primproducts, sd.primprodcount);
+		cres = productSetup(p, q, one, r2, cd.compproducts, sd.prodcount);
+		fres = m_mul(pres, cres, p, q);
+		uint32_t nextprime = cd.iterprime[ppos];
+		for(uint32_t n = st.nmin; n < st.nmax; ++n){
+			mn = add(mn, one, p);
+			fres = m_mul(fres, mn, p, q);
+			if(fres == one || fres == nmo){
+				addFactor(cd, p, (fres == one) ? -((int32_t)n) : (int32_t)n, FACTORIAL);
+			}
+			if(n == nextprime){
+				nextprime = cd.iterprime[++ppos];
+				pres = m_mul(pres, mn, p, q);
+				if(pres == one || pres == nmo){
+					addFactor(cd, p, (pres == one) ? -((int32_t)n) : (int32_t)n, PRIMORIAL);
+				}
+				continue;
+			}
+			cres = m_mul(cres, mn, p, q);
+			if(cres == one || cres == nmo){
+				addFactor(cd, p, (cres == one) ? -((int32_t)n) : (int32_t)n, COMPOSITORIAL);
+			}
+		}
+	}
+	else if(st.factorial && st.compositorial){
+		if(sd.compinv){
+			// the power table is for startN!/#, startN! = startN!/# * startN#, same as combined_inv_setup kernel
+			cres = factorialSetup(p, q, one, r2, cd, sd.powcount);
+			fres = m_mul(cres, productSetup(p, q, one, r2, cd.primproducts, sd.primprodcount), p, q);
+		}
+		else{
+			fres = factorialSetup(p, q, one, r2, cd, sd.powcount);
+			cres = productSetup(p, q, one, r2, cd.compproducts, sd.prodcount);
+		}
+		uint32_t nextprime = cd.iterprime[ppos];
+		for(uint32_t n = st.nmin; n < st.nmax; ++n){
+			mn = add(mn, one, p);
+			fres = m_mul(fres, mn, p, q);
+			if(fres == one || fres == nmo){
+				addFactor(cd, p, (fres == one) ? -((int32_t)n) : (int32_t)n, FACTORIAL);
+			}
+			if(n == nextprime){
+				nextprime = cd.iterprime[++ppos];
+				continue;
+			}
+			cres = m_mul(cres, mn, p, q);
+			if(cres == one || cres == nmo){
+				addFactor(cd, p, (cres == one) ? -((int32_t)n) : (int32_t)n, COMPOSITORIAL);
+			}
+		}
+	}
+	else if(st.factorial){
+		// use Wilson's theorem when p-1-startN is smaller than the power table
+		if(p > st.nmin-1 && p-st.nmin < 2*(uint64_t)sd.powcount && p-st.nmin < st.nmin-1){
+			fres = reflectSetup(p, q, one, st.nmin-1);
+		}
+		else{
+			fres = factorialSetup(p, q, one, r2, cd, sd.powcount);
+		}
+		for(uint32_t n = st.nmin; n < st.nmax; ++n){
+			mn = add(mn, one, p);
+			fres = m_mul(fres, mn, p, q);
+			if(fres == one || fres == nmo){
+				addFactor(cd, p, (fres == one) ? -((int32_t)n) : (int32_t)n, FACTORIAL);
+			}
+		}
+	}
+	else{
+		cres = productSetup(p, q, one, r2, cd.compproducts, sd.prodcount);
+		uint32_t nextprime = cd.iterprime[ppos];
+		for(uint32_t n = st.nmin; n < st.nmax; ++n){
+			mn = add(mn, one, p);
+			if(n == nextprime){
+				nextprime = cd.iterprime[++ppos];
+				continue;
+			}
+			cres = m_mul(cres, mn, p, q);
+			if(cres == one || cres == nmo){
+				addFactor(cd, p, (cres == one) ? -((int32_t)n) : (int32_t)n, COMPOSITORIAL);
+			}
+		}
+	}
+
+	// convert last n out of montgomery form
+	uint32_t result = (uint32_t)m_mul(mn, 1, p, q);
+
+	// adjust result for case where nmax > pmin
+	if(p <= lastn){
+		if(lastn % p == result){
+			result = lastn;
+		}
+	}
+
+	if(result != lastn){
+		#pragma omp atomic write
+		cd.validation_error = true;
+	}
+
+	return fres + pres + cres + mn;
+}
+
+
+// power, product, and prime tables and the segment buffers.  sets the table sizes in sd.
+cpuData * cpuSetup( workStatus & st, searchData & sd ){
+
+	cpuData * cd = (cpuData *)calloc(1, sizeof(cpuData));
+	if( cd == NULL ){
+		fprintf(stderr,"malloc error: cpuData\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// tri-mode builds startN! from the primorial and compositorial residues
+	if(st.factorial && !st.primorial){
+		sd.powcount = buildPowerTable(st, &cd->primeproducts, &cd->powers, sd.compinv);
+	}
+	if(st.primorial || sd.compinv){
+		size_t smsize;
+		sd.primprodcount = buildPrimeProducts(st, &cd->primproducts, smsize);
+		if(!st.compositorial){
+			cd->iterprime = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax-1, &cd->itersize, UINT32_PRIMES);
+		}
+	}
+	if(st.compositorial){
+		if(!sd.compinv){
+			sd.prodcount = buildCompositeProducts(st, &cd->compproducts);
+		}
+		// array of primes from nmin to nmax+prime gap
+		cd->iterprime = (uint32_t*)primesieve_generate_primes(st.nmin, st.nmax+320, &cd->itersize, UINT32_PRIMES);
+	}
+
+	cd->maxfactors = sd.numresults;
+	cd->factors = (factor *)malloc(cd->maxfactors * sizeof(factor));
+	if( cd->factors == NULL ){
+		fprintf(stderr,"malloc error: factors\n");
+		exit(EXIT_FAILURE);
+	}
+	cd->primes = (uint64_t *)malloc((MAX_RANGE/2 + 30) * sizeof(uint64_t));
+	if( cd->primes == NULL ){
+		fprintf(stderr,"malloc error: primes\n");
+		exit(EXIT_FAILURE);
+	}
+	cd->sieve = (uint8_t *)malloc(MAX_RANGE/2);
+	if( cd->sieve == NULL ){
+		fprintf(stderr,"malloc error: sieve\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// starting segment size, adjusted by cpuSegment to the target segment time
+	sd.range = 1000 * sd.threadcount;
+
+	if(survivorsActive()){
+		cpuSurvivors(cd);
+	}
+
+	return cd;
+}
+
+
+// copy the host's candidate bits, like writeSurvivors for a device.  they include the factors found by
+// the devices
+void cpuSurvivors( cpuData * cd ){
+	uint32_t * map = survivorMap(cd->alivewords);
+	if(cd->alive == NULL){
+		cd->alive = (uint32_t *)malloc(cd->alivewords * sizeof(uint32_t));
+		cd->left = (uint32_t *)malloc(cd->alivewords * sizeof(uint32_t));
+		if( cd->alive == NULL || cd->left == NULL ){
+			fprintf(stderr,"malloc error: alive\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memcpy(cd->alive, map, cd->alivewords * sizeof(uint32_t));
+	memcpy(cd->left, map, cd->alivewords * sizeof(uint32_t));
+}
+
+
+// search [start, stop) on sd.threadcount threads.  stop - start is at most MAX_RANGE.
+// the segment size in sd.range is adjusted to the target runtime.
+void cpuSegment( cpuData * cd, workStatus & st, searchData & sd, uint64_t start, uint64_t stop ){
+
+	double seg_start = omp_get_wtime();
+
+	// get a segment of primes (2-PRPs)
+	uint32_t pcount = getSegPrimes(start, stop, cd->primes, cd->sieve);
+
+	// setup, iterate, and check each prime
+	uint64_t sum = 0;
+	#pragma omp parallel for schedule(dynamic, 1) reduction(+:sum)
+	for(uint32_t i=0; i<pcount; ++i){
+		sum += sievePrime(cd->primes[i], st, sd, *cd, (uint32_t)cd->itersize);
+	}
+
+	cd->checksum += sum;
+	cd->primecount += pcount;
+
+	// candidates with a prime factor in this segment are left out of the next ones
+	if(cd->alive != NULL){
+		memcpy(cd->alive, cd->left, cd->alivewords * sizeof(uint32_t));
+	}
+
+	// adjust segment size to target runtime
+	double seg_time = omp_get_wtime() - seg_start;
+	if(seg_time < SEGMENT_TIME*0.5 && sd.range <= MAX_RANGE/2){
+		sd.range *= 2;
+	}
+	else if(seg_time > SEGMENT_TIME*2.0 && sd.range >= 2000){
+		sd.range /= 2;
+	}
+}
+
+
+// true when the factor array is half full and results should be collected
+bool cpuFactorsFull( cpuData * cd ){
+	return cd->numfactors > cd->maxfactors/2;
+}
+
+
+// add the checksum and prime count of the segments searched since the last call to st.
+// returns the number of factors, they stay in *factors until the next segment is searched.
+uint32_t cpuResults( cpuData * cd, workStatus & st, factor ** factors ){
+	// flag set if there is a validation failure
+	if(cd->validation_error){
+		fprintf(stderr,"error: cpu validation failure\n");
+		printf("error: cpu validation failure\n");
+		exit(EXIT_FAILURE);
+	}
+	if(cd->numfactors > cd->maxfactors){
+		fprintf(stderr,"Error: number of results (%u) overflowed array.\n", cd->numfactors);
+		exit(EXIT_FAILURE);
+	}
+	st.checksum += cd->checksum;
+	st.primecount += cd->primecount;
+	cd->checksum = 0;
+	cd->primecount = 0;
+	uint32_t numfactors = cd->numfactors;
+	cd->numfactors = 0;
+	*factors = cd->factors;
+	return numfactors;
+}
+
+
+void cpuFree( cpuData * cd ){
+	free(cd->primes);
+	free(cd->sieve);
+	free(cd->factors);
+	free(cd->primeproducts);
+	free(cd->powers);
+	free(cd->primproducts);
+	free(cd->compproducts);
+	free(cd->iterprime);
+	free(cd->alive);
+	free(cd->left);
+	free(cd);
+}
+
+
+static void getResults( workStatus & st, cpuData * cd, verifyList & vl ){
+	factor * factors;
+	uint32_t numfactors = cpuResults(cd, st, &factors);
+	if(numfactors > 0){
+		if(boinc_is_standalone()){
+			printf("processing %u factors on CPU\n", numfactors);
+		}
+		reportFactors(st, factors, numfactors, vl);
+	}
+}
+
+
+void cpu_sieve( workStatus & st, searchData & sd ){
+
+	time_t boinc_last, ckpt_last, time_curr;
+
+	// setup search parameters
+	setupSearch(st,sd);
+
+	startSearch(st,sd);
+
+	// power, product, and prime tables
+	cpuData * cd = cpuSetup(st, sd);
+
+	// arrays of primes and composites used during CPU factor verification
+	verifyList vl = buildVerifyList(st);
+
+	fprintf(stderr,"Starting Sieve on CPU with %u threads...\n", sd.threadcount);
+	if(boinc_is_standalone()){
+		printf("Starting Sieve on CPU with %u threads...\n", sd.threadcount);
+	}
+
+	time(&boinc_last);
+	time(&ckpt_last);
+	time_t totals, totalf;
+	if(boinc_is_standalone()){
+		time(&totals);
+	}
+
+	const double irsize = 1.0 / (double)(st.pmax-st.pmin);
+
+	// main search loop
+	while(st.p < st.pmax){
+
+		uint64_t stop = st.p + sd.range;
+		if(stop > st.pmax || stop < st.p){
+			// ck overflow
+			stop = st.pmax;
+		}
+
+		time(&time_curr);
+		if( ((int)time_curr - (int)boinc_last) > 1 ){
+			// update BOINC fraction done every 2 sec
+    			double fd = (double)(st.p-st.pmin)*irsize;
+			boinc_fraction_done(fd);
+			if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",fd*100.0);
+			boinc_last = time_curr;
+		}
+		// 1 minute checkpoint, or sooner if the factor array is half full
+		if( ((int)time_curr - (int)ckpt_last) > 60 || cpuFactorsFull(cd) ){
+			boinc_begin_critical_section();
+			getResults(st, cd, vl);
+			checkpoint(st, sd);
+			boinc_end_critical_section();
+			if(survivorsActive()){
+				cpuSurvivors(cd);
+			}
+			ckpt_last = time_curr;
+		}
+
+		cpuSegment(cd, st, sd, st.p, stop);
+
+		st.p = stop;
+	}
+
+	// final checkpoint
+	boinc_begin_critical_section();
+	st.p = st.pmax;
+	boinc_fraction_done(1.0);
+	if(boinc_is_standalone()) printf("Sieve Progress: %.1f%%\n",100.0);
+	getResults(st, cd, vl);
+	checkpoint(st, sd);
+	finalizeResults(st);
+	boinc_end_critical_section();
+
+	fprintf(stderr,"Sieve complete.\nfactors %" PRIu64 ", prime count %" PRIu64 "\n", st.factorcount, st.primecount);
+
+	if(boinc_is_standalone()){
+		time(&totalf);
+		printf("Sieve finished in %d sec.\n", (int)totalf - (int)totals);
+		printf("factors %" PRIu64 ", prime count %" PRIu64 ", checksum %016" PRIX64 "\n", st.factorcount, st.primecount, st.checksum);
+	}
+
+	cpuFree(cd);
+	freeVerifyList(vl);
+	survivorFree();
+}
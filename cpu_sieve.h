@@ -0,0 +1,18 @@
+// cpu_sieve.h
+
+typedef struct cpuData cpuData;
+
+void cpu_sieve( workStatus & st, searchData & sd );
+
+// CPU share of an OpenCL search
+cpuData * cpuSetup( workStatus & st, searchData & sd );
+
+void cpuSegment( cpuData * cd, workStatus & st, searchData & sd, uint64_t start, uint64_t stop );
+
+bool cpuFactorsFull( cpuData * cd );
+
+void cpuSurvivors( cpuData * cd );
+
+uint32_t cpuResults( cpuData * cd, workStatus & st, factor ** factors );
+
+void cpuFree( cpuData * cd );
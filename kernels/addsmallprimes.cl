@@ -5,20 +5,9 @@
 	generate primes <= 113
 */
 
-ulong add(ulong a, ulong b, ulong p){
-	ulong r;
-	ulong c = (a >= p - b) ? p : 0;
-	r = a + b - c;
-	return r;
-}
-
-ulong invert(ulong p){
-	ulong p_inv = 1, prev = 0;
-	while (p_inv != prev) { prev = p_inv; p_inv *= 2 - p * p_inv; }
-	return p_inv;
-}
+#ifndef MONT32
 
-__kernel void addsmallprimes(ulong low, ulong high, __global ulong8 *g_prime, __global uint *g_primecount){
+__kernel void addsmallprimes(ulong low, ulong high, __global PRIME *g_prime, __global uint *g_primecount){
 
 	const uint gid = get_global_id(0);
 
@@ -31,12 +20,47 @@ __kernel void addsmallprimes(ulong low, ulong high, __global ulong8 *g_prime, __
 	if(p < low || p >= high) return;
 
 	ulong q = invert(p);
+#ifdef COMBINED
 	ulong one = (-p) % p;
 	ulong nmo = p - one;
 	ulong two = add(one, one, p);
 
 	g_prime[ atomic_inc(&g_primecount[0]) ] = (ulong8)( p, q, 0, one, two, nmo, 0, 0 );
+#else
+	g_prime[ atomic_inc(&g_primecount[0]) ] = (ulong4)( p, q, 0, 0 );
+#endif
 
 }
 
+#endif
+
+
+// 32 bit version used when P < 2^32
+#ifdef MONT32
+
+__kernel void addsmallprimes32(ulong low, ulong high, __global PRIME32 *g_prime, __global uint *g_primecount){
+
+	const uint gid = get_global_id(0);
+
+	const uint primes[30] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113};
+
+	if(gid > 29) return;
+
+	uint p = primes[gid];
+
+	if(p < low || p >= high) return;
+
+	uint q = invert32(p);
+#ifdef COMBINED
+	uint one = (-p) % p;
+	uint nmo = p - one;
+	uint two = add32(one, one, p);
+
+	g_prime[ atomic_inc(&g_primecount[0]) ] = (uint8)( p, q, 0, one, two, nmo, 0, 0 );
+#else
+	g_prime[ atomic_inc(&g_primecount[0]) ] = (uint4)( p, q, 0, 0 );
+#endif
+
+}
 
+#endif
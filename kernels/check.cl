@@ -6,46 +6,191 @@
 
 */
 
-// r0 + 2^64 * r1 = a * b
-ulong2 mul_wide(const ulong a, const ulong b){
-	ulong2 r;
-#ifdef __NV_CL_C_VERSION
-	const uint a0 = (uint)(a), a1 = (uint)(a >> 32);
-	const uint b0 = (uint)(b), b1 = (uint)(b >> 32);
-	uint c0 = a0 * b0, c1 = mul_hi(a0, b0), c2, c3;
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a0), "r" (b1), "r" (c1));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c2) : "r" (a0), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b1), "r" (c2));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c3) : "r" (a1), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a1), "r" (b0), "r" (c1));
-	asm volatile ("madc.hi.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b0), "r" (c2));
-	asm volatile ("addc.u32 %0, %1, 0;" : "=r" (c3) : "r" (c3));
-	r.s0 = upsample(c1, c0); r.s1 = upsample(c3, c2);
-#else
-	r.s0 = a * b; r.s1 = mul_hi(a, b);
-#endif
-	return r;
+#ifndef MONT32
+
+#if defined(FACTORIAL_KERNELS) || defined(COMPOSITORIAL_KERNELS)
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_compositorial_check(	__global ulong4 * g_prime,
+												__global uint * g_primecount,
+												__global ulong * g_sum ) {
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	const uint pcnt = g_primecount[0];
+	__local ulong sum[256];
+
+	if(gid < pcnt){
+		// .s0=p, .s1=q, .s2=residue of final factorial, .s3=montgomery form of last n
+		const ulong4 prime = g_prime[gid];
+
+		if(prime.s2 == 0){
+			// retired prime, or a 2-PRP whose factors are all below nmin.  n was not iterated
+			const ulong r2 = m_r2((-prime.s0) % prime.s0, prime.s0, prime.s1);
+			sum[lid] = m_mul(LAST_N, r2, prime.s0, prime.s1);
+		}
+		else{
+			sum[lid] = prime.s2 + prime.s3;
+
+			// convert last n out of montgomery form
+			uint result = (uint)m_mul(prime.s3, 1, prime.s0, prime.s1);
+
+			// adjust result for case where nmax > pmin
+			if(AT_MOST(prime.s0, LAST_N)){
+				if(LAST_N % prime.s0 == result){
+					result = LAST_N;
+				}
+			}
+
+			if(result != LAST_N){
+				atomic_or(&g_primecount[5], 1);
+			}
+		}
+	}
+	else{
+		sum[lid] = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(uint s = 128; s > 0; s >>= 1){
+		if(lid < s){
+			sum[lid] += sum[lid + s];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if(lid == 0){
+		uint index = get_group_id(0) + 1;
+		g_sum[index] += sum[0];
+	}
+
+	if(gid == 0){
+		// add primecount to total primecount
+		g_sum[0] += pcnt;
+		// store largest kernel prime count for array bounds check
+		if( pcnt > g_primecount[1] ){
+			g_primecount[1] = pcnt;
+		}
+	}
+
 }
+#endif
+
+
+#ifdef PRIMORIAL_KERNELS
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_check(	__global ulong4 * g_prime,
+											__global uint * g_primecount,
+											__global ulong * g_sum ) {
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	const uint pcnt = g_primecount[0];
+	__local ulong sum[256];
+
+	if(gid < pcnt){
+		sum[lid] = g_prime[gid].s2;
+	}
+	else{
+		sum[lid] = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(uint s = 128; s > 0; s >>= 1){
+		if(lid < s){
+			sum[lid] += sum[lid + s];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if(lid == 0){
+		uint index = get_group_id(0) + 1;
+		g_sum[index] += sum[0];
+	}
+
+	if(gid == 0){
+		// add primecount to total primecount
+		g_sum[0] += pcnt;
+		// store largest kernel prime count for array bounds check
+		if( pcnt > g_primecount[1] ){
+			g_primecount[1] = pcnt;
+		}
+	}
 
-ulong m_mul(ulong a, ulong b, ulong p, ulong q){
-	ulong2 ab = mul_wide(a,b);
-	ulong m = ab.s0 * q;
-	ulong mp = mul_hi(m,p);
-	ulong r = ab.s1 - mp;
-	return ( ab.s1 < mp ) ? r + p : r;
 }
+#endif
+
+
+#ifdef COMBINED_KERNELS
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined_check(	__global ulong8 * g_prime,
+										__global uint * g_primecount,
+										__global ulong * g_sum ) {
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	const uint pcnt = g_primecount[0];
+	__local ulong sum[256];
+
+	if(gid < pcnt){
+		// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of final compositorial, .s5=nmo, .s6=residue of final factorial, .s7= montgomery form of last n
+		const ulong8 prime = g_prime[gid];
+
+		if(prime.s4 == 0){
+			// retired prime, or a 2-PRP whose factors are all below nmin.  n was not iterated
+			sum[lid] = m_mul(LAST_N, prime.s2, prime.s0, prime.s1);
+		}
+		else{
+			sum[lid] = prime.s4 + prime.s6 + prime.s7;
+
+			// convert last n out of montgomery form
+			uint result = (uint)m_mul(prime.s7, 1, prime.s0, prime.s1);
+
+			// adjust result for case where nmax > pmin
+			if(AT_MOST(prime.s0, LAST_N)){
+				if(LAST_N % prime.s0 == result){
+					result = LAST_N;
+				}
+			}
+
+			if(result != LAST_N){
+				atomic_or(&g_primecount[5], 1);
+			}
+		}
+	}
+	else{
+		sum[lid] = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(uint s = 128; s > 0; s >>= 1){
+		if(lid < s){
+			sum[lid] += sum[lid + s];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if(lid == 0){
+		uint index = get_group_id(0) + 1;
+		g_sum[index] += sum[0];
+	}
+
+	if(gid == 0){
+		// add primecount to total primecount
+		g_sum[0] += pcnt;
+		// store largest kernel prime count for array bounds check
+		if( pcnt > g_primecount[1] ){
+			g_primecount[1] = pcnt;
+		}
+	}
 
-ulong add(ulong a, ulong b, ulong p){
-	ulong r;
-	ulong c = (a >= p - b) ? p : 0;
-	r = a + b - c;
-	return r;
 }
+#endif
 
-__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_compositorial_check(	__global ulong8 * g_prime,
-												__global uint * g_primecount,
-												__global ulong * g_sum,
-												const uint nmax ) {
+
+#ifdef COMBINED3_KERNELS
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined3_check(	__global ulong8 * g_prime,
+										__global uint * g_primecount,
+										__global ulong * g_sum ) {
 
 	const uint gid = get_global_id(0);
 	const uint lid = get_local_id(0);
@@ -53,23 +198,109 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_compos
 	__local ulong sum[256];
 
 	if(gid < pcnt){
-		// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of final factorial, .s7= montgomery form of last n
+		// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of final compositorial, .s5=residue of final primorial, .s6=residue of final factorial, .s7= montgomery form of last n
 		const ulong8 prime = g_prime[gid];
 
-		sum[lid] = prime.s6 + prime.s7;
+		if(prime.s4 == 0 && prime.s5 == 0){
+			// retired prime, or a 2-PRP whose factors are all below nmin.  n was not iterated
+			sum[lid] = m_mul(LAST_N, prime.s2, prime.s0, prime.s1);
+		}
+		else{
+			sum[lid] = prime.s4 + prime.s5 + prime.s6 + prime.s7;
+
+			// convert last n out of montgomery form
+			uint result = (uint)m_mul(prime.s7, 1, prime.s0, prime.s1);
 
-		// convert last n out of montgomery form
-		uint result = (uint)m_mul(prime.s7, 1, prime.s0, prime.s1);
+			// adjust result for case where nmax > pmin
+			if(AT_MOST(prime.s0, LAST_N)){
+				if(LAST_N % prime.s0 == result){
+					result = LAST_N;
+				}
+			}
 
-		// adjust result for case where nmax > pmin
-		if(prime.s0 <= nmax){
-			if(nmax % prime.s0 == result){
-				result = nmax;
+			if(result != LAST_N){
+				atomic_or(&g_primecount[5], 1);
 			}
 		}
+	}
+	else{
+		sum[lid] = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(uint s = 128; s > 0; s >>= 1){
+		if(lid < s){
+			sum[lid] += sum[lid + s];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if(lid == 0){
+		uint index = get_group_id(0) + 1;
+		g_sum[index] += sum[0];
+	}
+
+	if(gid == 0){
+		// add primecount to total primecount
+		g_sum[0] += pcnt;
+		// store largest kernel prime count for array bounds check
+		if( pcnt > g_primecount[1] ){
+			g_primecount[1] = pcnt;
+		}
+	}
+
+}
+#endif
+
+#endif
+
+
+/*
+	32 bit versions used when P < 2^32.  Residues are converted to 64 bit montgomery form
+	so the checksum matches the 64 bit kernels.
+*/
+
+#ifdef MONT32
+#if defined(FACTORIAL_KERNELS) || defined(COMPOSITORIAL_KERNELS)
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_compositorial_check32(	__global uint4 * g_prime,
+												__global uint * g_primecount,
+												__global ulong * g_sum ) {
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	const uint pcnt = g_primecount[0];
+	__local ulong sum[256];
+
+	if(gid < pcnt){
+		// .s0=p, .s1=q, .s2=residue of final factorial, .s3=montgomery form of last n
+		const uint4 prime = g_prime[gid];
+
+		// montgomery constants are rebuilt from p
+		const uint one = (-prime.s0) % prime.s0;
+		const uint r2 = setup_r2(add32(one, one, prime.s0), prime.s0, prime.s1);
+
+		if(prime.s2 == 0){
+			// retired prime, or a 2-PRP whose factors are all below nmin.  n was not iterated
+			sum[lid] = m_mul32(m_mul32(LAST_N, r2, prime.s0, prime.s1), r2, prime.s0, prime.s1);
+		}
+		else{
+			// x * 2^32 * 2^32 is montgomery form with R = 2^64
+			sum[lid] = (ulong)m_mul32(prime.s2, r2, prime.s0, prime.s1) + m_mul32(prime.s3, r2, prime.s0, prime.s1);
+
+			// convert last n out of montgomery form
+			uint result = m_mul32(prime.s3, 1, prime.s0, prime.s1);
+
+			// adjust result for case where nmax > pmin
+			if(AT_MOST(prime.s0, LAST_N)){
+				if(LAST_N % prime.s0 == result){
+					result = LAST_N;
+				}
+			}
 
-		if(result != nmax){
-			atomic_or(&g_primecount[5], 1);
+			if(result != LAST_N){
+				atomic_or(&g_primecount[5], 1);
+			}
 		}
 	}
 	else{
@@ -100,9 +331,11 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_compos
 	}
 
 }
+#endif
 
 
-__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_check(	__global ulong8 * g_prime,
+#ifdef PRIMORIAL_KERNELS
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_check32(	__global uint4 * g_prime,
 											__global uint * g_primecount,
 											__global ulong * g_sum ) {
 
@@ -112,7 +345,8 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_check(
 	__local ulong sum[256];
 
 	if(gid < pcnt){
-		sum[lid] = g_prime[gid].s6;
+		const uint4 prime = g_prime[gid];
+		sum[lid] = m_mul32(prime.s2, prime.s3, prime.s0, prime.s1);
 	}
 	else{
 		sum[lid] = 0;
@@ -142,12 +376,13 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_check(
 	}
 
 }
+#endif
 
 
-__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined_check(	__global ulong8 * g_prime,
+#ifdef COMBINED_KERNELS
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined_check32(	__global uint8 * g_prime,
 										__global uint * g_primecount,
-										__global ulong * g_sum,
-										const uint nmax ) {
+										__global ulong * g_sum ) {
 
 	const uint gid = get_global_id(0);
 	const uint lid = get_local_id(0);
@@ -156,22 +391,30 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined_check(
 
 	if(gid < pcnt){
 		// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of final compositorial, .s5=nmo, .s6=residue of final factorial, .s7= montgomery form of last n
-		const ulong8 prime = g_prime[gid];
-
-		sum[lid] = prime.s4 + prime.s6 + prime.s7;
+		const uint8 prime = g_prime[gid];
 
-		// convert last n out of montgomery form
-		uint result = (uint)m_mul(prime.s7, 1, prime.s0, prime.s1);
-
-		// adjust result for case where nmax > pmin
-		if(prime.s0 <= nmax){
-			if(nmax % prime.s0 == result){
-				result = nmax;
-			}
+		if(prime.s4 == 0){
+			// retired prime, or a 2-PRP whose factors are all below nmin.  n was not iterated
+			sum[lid] = m_mul32(m_mul32(LAST_N, prime.s2, prime.s0, prime.s1), prime.s2, prime.s0, prime.s1);
 		}
+		else{
+			// x * 2^32 * 2^32 is montgomery form with R = 2^64
+			sum[lid] = (ulong)m_mul32(prime.s4, prime.s2, prime.s0, prime.s1) + m_mul32(prime.s6, prime.s2, prime.s0, prime.s1)
+					+ m_mul32(prime.s7, prime.s2, prime.s0, prime.s1);
+
+			// convert last n out of montgomery form
+			uint result = m_mul32(prime.s7, 1, prime.s0, prime.s1);
+
+			// adjust result for case where nmax > pmin
+			if(AT_MOST(prime.s0, LAST_N)){
+				if(LAST_N % prime.s0 == result){
+					result = LAST_N;
+				}
+			}
 
-		if(result != nmax){
-			atomic_or(&g_primecount[5], 1);
+			if(result != LAST_N){
+				atomic_or(&g_primecount[5], 1);
+			}
 		}
 	}
 	else{
@@ -202,11 +445,75 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined_check(
 	}
 
 }
+#endif
+
+
+#ifdef COMBINED3_KERNELS
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void combined3_check32(	__global uint8 * g_prime,
+										__global uint * g_primecount,
+										__global ulong * g_sum ) {
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	const uint pcnt = g_primecount[0];
+	__local ulong sum[256];
+
+	if(gid < pcnt){
+		// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of final compositorial, .s5=residue of final primorial, .s6=residue of final factorial, .s7= montgomery form of last n
+		const uint8 prime = g_prime[gid];
 
+		if(prime.s4 == 0 && prime.s5 == 0){
+			// retired prime, or a 2-PRP whose factors are all below nmin.  n was not iterated
+			sum[lid] = m_mul32(m_mul32(LAST_N, prime.s2, prime.s0, prime.s1), prime.s2, prime.s0, prime.s1);
+		}
+		else{
+			// x * 2^32 * 2^32 is montgomery form with R = 2^64
+			sum[lid] = (ulong)m_mul32(prime.s4, prime.s2, prime.s0, prime.s1) + m_mul32(prime.s5, prime.s2, prime.s0, prime.s1)
+					+ m_mul32(prime.s6, prime.s2, prime.s0, prime.s1) + m_mul32(prime.s7, prime.s2, prime.s0, prime.s1);
+
+			// convert last n out of montgomery form
+			uint result = m_mul32(prime.s7, 1, prime.s0, prime.s1);
+
+			// adjust result for case where nmax > pmin
+			if(AT_MOST(prime.s0, LAST_N)){
+				if(LAST_N % prime.s0 == result){
+					result = LAST_N;
+				}
+			}
 
+			if(result != LAST_N){
+				atomic_or(&g_primecount[5], 1);
+			}
+		}
+	}
+	else{
+		sum[lid] = 0;
+	}
 
+	barrier(CLK_LOCAL_MEM_FENCE);
 
+	for(uint s = 128; s > 0; s >>= 1){
+		if(lid < s){
+			sum[lid] += sum[lid + s];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
 
+	if(lid == 0){
+		uint index = get_group_id(0) + 1;
+		g_sum[index] += sum[0];
+	}
 
+	if(gid == 0){
+		// add primecount to total primecount
+		g_sum[0] += pcnt;
+		// store largest kernel prime count for array bounds check
+		if( pcnt > g_primecount[1] ){
+			g_primecount[1] = pcnt;
+		}
+	}
 
+}
+#endif
 
+#endif
@@ -0,0 +1,226 @@
+/*
+
+	common.cl - Bryan Little 4/2025, montgomery arithmetic by Yves Gallot
+
+	Shared arithmetic and prime array layout.  This is the first part of the single program built for each run,
+	followed by the kernel files the run needs.
+
+	Build options select the kernels that are compiled:
+	-D SEARCH_FACTORIAL=1		factorial search, -!
+	-D SEARCH_PRIMORIAL=1		primorial search, -#
+	-D SEARCH_COMPOSITORIAL=1	compositorial search, -c
+	-D COMPINV=1			-! -c with every prime above nmin-1, startN! is built from startN!/# and startN#
+	-D MONT32=1			P <= 2^32, 32 bit kernels
+	-D CKOVERFLOW=1			P near 2^64, getsegprimes checks for overflow
+	-D SURVIVORS=1			--survivors, the iterate kernels skip candidates with a factor, see iterate.cl
+
+	The run constants are always set:
+	-D START_N=nmin-1		n of the initial factorial/primorial/compositorial
+	-D LAST_N=nmax-1		last n iterated, used by the check kernels
+	-D P_MIN=min(pmin,nmax)		no prime of the run is below P_MIN
+
+*/
+
+// one group of setup, iterate and check kernels per search
+#if defined(SEARCH_FACTORIAL) && defined(SEARCH_PRIMORIAL) && defined(SEARCH_COMPOSITORIAL)
+	#define COMBINED3_KERNELS
+#elif defined(SEARCH_FACTORIAL) && defined(SEARCH_COMPOSITORIAL)
+	#define COMBINED_KERNELS
+#elif defined(SEARCH_FACTORIAL)
+	#define FACTORIAL_KERNELS
+#elif defined(SEARCH_PRIMORIAL)
+	#define PRIMORIAL_KERNELS
+#elif defined(SEARCH_COMPOSITORIAL)
+	#define COMPOSITORIAL_KERNELS
+#endif
+
+// combined modes keep .s3=one, .s4=two, .s5=nmo with the residues.  the other modes store .s0=p, .s1=q
+// and two words of state, the montgomery constants are rebuilt from p by the kernels that need them
+#if defined(SEARCH_FACTORIAL) && defined(SEARCH_COMPOSITORIAL)
+	#define COMBINED 1
+	#define PRIME ulong8
+	#define PRIME32 uint8
+#else
+	#define PRIME ulong4
+	#define PRIME32 uint4
+#endif
+
+// p <= n for a prime of the run.  folds to false at compile time when P_MIN is above n, so the branches
+// for primes that divide n! or n# are only compiled into runs that can have them
+#define AT_MOST(_P, _N) (P_MIN <= (_N) && (_P) <= (_N))
+
+// largest 64 bit prime, the modulus used to verify the power and product tables
+// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo
+__constant ulong8 vprime = (ulong8)(18446744073709551557UL, 3751880150584993549UL, 3481, 59, 118, 18446744073709551498UL, 0, 0);
+
+// r0 + 2^64 * r1 = a * b
+ulong2 mul_wide(const ulong a, const ulong b){
+	ulong2 r;
+#ifdef __NV_CL_C_VERSION
+	const uint a0 = (uint)(a), a1 = (uint)(a >> 32);
+	const uint b0 = (uint)(b), b1 = (uint)(b >> 32);
+	uint c0 = a0 * b0, c1 = mul_hi(a0, b0), c2, c3;
+	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a0), "r" (b1), "r" (c1));
+	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c2) : "r" (a0), "r" (b1));
+	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b1), "r" (c2));
+	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c3) : "r" (a1), "r" (b1));
+	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a1), "r" (b0), "r" (c1));
+	asm volatile ("madc.hi.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b0), "r" (c2));
+	asm volatile ("addc.u32 %0, %1, 0;" : "=r" (c3) : "r" (c3));
+	r.s0 = upsample(c1, c0); r.s1 = upsample(c3, c2);
+#else
+	r.s0 = a * b; r.s1 = mul_hi(a, b);
+#endif
+	return r;
+}
+
+ulong m_mul(ulong a, ulong b, ulong p, ulong q){
+	ulong2 ab = mul_wide(a,b);
+	ulong m = ab.s0 * q;
+	ulong mp = mul_hi(m,p);
+	ulong r = ab.s1 - mp;
+	return ( ab.s1 < mp ) ? r + p : r;
+}
+
+ulong add(ulong a, ulong b, ulong p){
+	ulong r;
+	ulong c = (a >= p - b) ? p : 0;
+	r = a + b - c;
+	return r;
+}
+
+ulong invert(ulong p){
+	ulong p_inv = 1, prev = 0;
+	while (p_inv != prev) { prev = p_inv; p_inv *= 2 - p * p_inv; }
+	return p_inv;
+}
+
+// R^2 mod p from one = R mod p, 4^{2^5} = 2^64
+ulong m_r2(ulong one, ulong p, ulong q){
+	ulong r2 = add(one, one, p);
+	r2 = add(r2, r2, p);
+	r2 = m_mul(r2, r2, p, q);
+	r2 = m_mul(r2, r2, p, q);
+	r2 = m_mul(r2, r2, p, q);
+	r2 = m_mul(r2, r2, p, q);
+	r2 = m_mul(r2, r2, p, q);
+	return r2;
+}
+
+// a * (b.s0 + 2^64 b.s1) / 2^128 mod p, one montgomery step per word of b
+ulong m_mul128(ulong a, ulong2 b, ulong p, ulong q){
+	const ulong2 lo = mul_wide(a, b.s0), hi = mul_wide(a, b.s1);
+	ulong t1 = lo.s1 + hi.s0;
+	ulong t2 = hi.s1 + ((t1 < lo.s1) ? 1 : 0);
+	// low word cancels
+	ulong m = lo.s0 * q;
+	ulong mp = mul_hi(m, p);
+	t2 -= (t1 < mp) ? 1 : 0;
+	t1 -= mp;
+	// t2 is -1 or less than p
+	m = t1 * q;
+	mp = mul_hi(m, p);
+	const ulong r = t2 - mp;
+	return ( t2 < mp || t2 == 0xFFFFFFFFFFFFFFFF ) ? r + p : r;
+}
+
+// strong probable prime test to 7 bases, good to 2^64, same as isPrime on the CPU.  the prime list has
+// base 2 pseudoprimes, this is only run for the few p that must be prime
+__constant uint mrbases[7] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+bool is_prime(ulong p, ulong q, ulong one, ulong r2){
+	const ulong nmo = p - one;
+	const uint t = 63u - clz((p-1) & (1-p));
+	const ulong exp = p >> t;
+	for(int i = 0; i < 7; ++i){
+		// base in montgomery form, skip bases that are multiples of p
+		const ulong mbase = m_mul(mrbases[i], r2, p, q);
+		if(mbase == 0) continue;
+		ulong curBit = 0x8000000000000000;
+		curBit >>= ( clz(exp) + 1 );
+		ulong a = mbase;
+		while( curBit ){
+			a = m_mul(a, a, p, q);
+			if(exp & curBit){
+				a = m_mul(a, mbase, p, q);
+			}
+			curBit >>= 1;
+		}
+		bool prp = (a == one || a == nmo);
+		for(uint s = 1; s < t && !prp; ++s){
+			a = m_mul(a, a, p, q);
+			prp = (a == nmo);
+		}
+		if(!prp) return false;
+	}
+	return true;
+}
+
+
+/*
+	32 bit versions used when P < 2^32.  Residues are stored as uint with montgomery R = 2^32.
+*/
+
+uint m_mul32(uint a, uint b, uint p, uint q){
+	ulong ab = (ulong)a * b;
+	uint m = (uint)ab * q;
+	uint mp = mul_hi(m,p);
+	uint hi = (uint)(ab >> 32);
+	uint r = hi - mp;
+	return ( hi < mp ) ? r + p : r;
+}
+
+uint add32(uint a, uint b, uint p){
+	uint r;
+	uint c = (a >= p - b) ? p : 0;
+	r = a + b - c;
+	return r;
+}
+
+uint invert32(uint p){
+	uint p_inv = 1, prev = 0;
+	while (p_inv != prev) { prev = p_inv; p_inv *= 2 - p * p_inv; }
+	return p_inv;
+}
+
+// R^2 mod p from two = 2R mod p, 4^{2^4} = 2^32
+uint setup_r2(uint two, uint p, uint q){
+	uint r2 = add32(two, two, p);
+	r2 = m_mul32(r2, r2, p, q);
+	r2 = m_mul32(r2, r2, p, q);
+	r2 = m_mul32(r2, r2, p, q);
+	r2 = m_mul32(r2, r2, p, q);
+	return r2;
+}
+
+// strong probable prime test to bases 2, 7 and 61, good to 2^32
+__constant uint mrbases32[3] = {2, 7, 61};
+
+bool is_prime32(uint p, uint q, uint one, uint r2){
+	const uint nmo = p - one;
+	const uint t = 31u - clz((p-1) & (1-p));
+	const uint exp = p >> t;
+	for(int i = 0; i < 3; ++i){
+		// base in montgomery form, skip bases that are multiples of p
+		const uint mbase = m_mul32(mrbases32[i], r2, p, q);
+		if(mbase == 0) continue;
+		uint curBit = 0x80000000;
+		curBit >>= ( clz(exp) + 1 );
+		uint a = mbase;
+		while( curBit ){
+			a = m_mul32(a, a, p, q);
+			if(exp & curBit){
+				a = m_mul32(a, mbase, p, q);
+			}
+			curBit >>= 1;
+		}
+		bool prp = (a == one || a == nmo);
+		for(uint s = 1; s < t && !prp; ++s){
+			a = m_mul32(a, a, p, q);
+			prp = (a == nmo);
+		}
+		if(!prp) return false;
+	}
+	return true;
+}
+
@@ -0,0 +1,188 @@
+/*
+
+	compact.cl - Bryan Little 4/2025, montgomery arithmetic by Yves Gallot
+
+	Retire primes whose residue is zero and compact the prime array
+
+	Once p <= n, n! mod p (or n# mod p, and n!/# mod p once 2p <= n) is zero for the rest of the search.
+	The setup and iterate kernels stop working on these primes.  Between iterate kernels the CPU runs these
+	kernels to remove them from the prime array so work groups stay full:
+
+	1) compact_count counts the live primes and adds the checksum of the retired primes to the sum array.
+	   This is the same value the check kernel would produce for a retired prime.
+
+	2) compact_holes stores the position of each retired prime below the new prime count.
+
+	3) compact_move moves the live primes above the new prime count into those positions.
+
+	The prime array layout and the residue checksum come from the MONT32, COMBINED and PRIMORIAL_KERNELS
+	defines in common.cl.
+
+*/
+
+#ifdef MONT32
+
+	#define CPRIME PRIME32
+
+	// r2 is stored by the combined modes and rebuilt from p otherwise
+	uint primeR2(const CPRIME prime){
+	#ifdef COMBINED
+		return prime.s2;
+	#else
+		const uint one = (-prime.s0) % prime.s0;
+		return setup_r2(add32(one, one, prime.s0), prime.s0, prime.s1);
+	#endif
+	}
+
+	// last n in montgomery form with R = 2^64
+	ulong lastN(const CPRIME prime, const uint n){
+		const uint r2 = primeR2(prime);
+		return m_mul32(m_mul32(n, r2, prime.s0, prime.s1), r2, prime.s0, prime.s1);
+	}
+
+#else
+
+	#define CPRIME PRIME
+
+	// r2 is stored by the combined modes and rebuilt from p otherwise
+	ulong primeR2(const CPRIME prime){
+	#ifdef COMBINED
+		return prime.s2;
+	#else
+		return m_r2((-prime.s0) % prime.s0, prime.s0, prime.s1);
+	#endif
+	}
+
+	// last n in montgomery form
+	ulong lastN(const CPRIME prime, const uint n){
+		return m_mul(n, primeR2(prime), prime.s0, prime.s1);
+	}
+
+#endif
+
+#if defined(COMBINED3_KERNELS)
+	// all residues are zero.  the primorial residue of a 2-PRP that is a prime power like 1093^2 never is
+	#define RETIRED(_P) ((_P).s4 == 0 && (_P).s5 == 0)
+#elif defined(COMBINED)
+	// both residues are zero
+	#define RETIRED(_P) ((_P).s4 == 0)
+#else
+	#define RETIRED(_P) ((_P).s2 == 0)
+#endif
+
+
+__kernel void compact_clear(__global uint * g_compact){
+
+	const uint gid = get_global_id(0);
+
+	if(gid < 3){
+		g_compact[gid] = 0;
+	}
+}
+
+
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void compact_count(	__global CPRIME * g_prime,
+										__global uint * g_primecount,
+										__global ulong * g_sum,
+										__global uint * g_compact ){
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	const uint pcnt = g_primecount[0];
+	__local ulong sum[256];
+	__local uint live;
+
+	if(lid == 0){
+		live = 0;
+	}
+	sum[lid] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(gid < pcnt){
+		const CPRIME prime = g_prime[gid];
+		if(RETIRED(prime)){
+#ifndef PRIMORIAL_KERNELS
+			sum[lid] = lastN(prime, LAST_N);
+#endif
+		}
+		else{
+			atomic_inc(&live);
+		}
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+#ifndef PRIMORIAL_KERNELS
+	for(uint s = 128; s > 0; s >>= 1){
+		if(lid < s){
+			sum[lid] += sum[lid + s];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+#endif
+
+	if(lid == 0){
+#ifndef PRIMORIAL_KERNELS
+		uint index = get_group_id(0) + 1;
+		g_sum[index] += sum[0];
+#endif
+		atomic_add(&g_compact[0], live);
+	}
+
+	if(gid == 0){
+		// prime count before compaction
+		g_compact[3] = pcnt;
+	}
+
+}
+
+
+__kernel void compact_holes(	__global CPRIME * g_prime,
+				__global uint * g_primecount,
+				__global ulong * g_sum,
+				__global uint * g_compact,
+				__global uint * g_holes ){
+
+	const uint gid = get_global_id(0);
+	const uint newcnt = g_compact[0];
+	const uint pcnt = g_compact[3];
+
+	if(gid < newcnt && RETIRED(g_prime[gid])){
+		g_holes[ atomic_inc(&g_compact[1]) ] = gid;
+	}
+
+	if(gid == 0){
+		// retired primes are added to the total primecount here
+		g_sum[0] += pcnt - newcnt;
+		// store largest kernel prime count for array bounds check
+		if( pcnt > g_primecount[1] ){
+			g_primecount[1] = pcnt;
+		}
+	}
+
+}
+
+
+__kernel void compact_move(	__global CPRIME * g_prime,
+				__global uint * g_primecount,
+				__global uint * g_compact,
+				__global uint * g_holes ){
+
+	const uint gid = get_global_id(0);
+	const uint newcnt = g_compact[0];
+	const uint pcnt = g_compact[3];
+	const uint pos = newcnt + gid;
+
+	if(pos < pcnt){
+		const CPRIME prime = g_prime[pos];
+		if(!RETIRED(prime)){
+			g_prime[ g_holes[ atomic_inc(&g_compact[2]) ] ] = prime;
+		}
+	}
+
+	if(gid == 0){
+		g_primecount[0] = newcnt;
+	}
+
+}
+
@@ -20,12 +20,21 @@
 	   are divisible by the prime. Since it's a mod 30 wheel only 30 of the positions are used.  The resulting uints
 	   are bitwise ORed.  The unset bits in the uint represent numbers that aren't divisible by any of the primes from 7 to 113.
 
-	3) Each thread iterates through it's bitsieve unit using the mod 30 wheel index increment.  If a bit is
-	   not set, the number is stored to local memory using a local memory atomic counter.
+	   Primes from 127 to a bound chosen by the host are too large for constant arrays.  The work-group covers
+	   7680 consecutive odd numbers, so these primes are sieved into a local memory bit array of the work-group's
+	   range, one prime per thread, and each thread ORs its 30 bits into the bitsieve.  Multiples that could be
+	   base 2 pseudoprimes are not removed, so the 2-PRPs found do not depend on the bound.  A sieve prime count
+	   of zero disables this step.
+
+	3) Each thread counts the unset bits of it's bitsieve unit using the mod 30 wheel index increment.  A work-group
+	   prefix sum of the counts gives each thread a contiguous range of positions, where it stores the numbers.
+	   The local memory array holds sievedsize numbers, sized by the host from the expected density after the
+	   presieve.  When the work-group has more numbers than that, they are staged and tested in waves.
 
 	4) Packing the numbers in local memory allows all threads to stay busy in the next step, which is performing
-	   a base 2 PRP test.  If the number passes the test, it is stored in global memory with an atomic counter along
-	   with other constant data that will be used in other kernels.
+	   a base 2 PRP test, 256 numbers at a time.  A prefix sum of the results gives each 2-PRP its position in a
+	   block of global memory reserved with one atomic per round.  It is stored there along with other constant
+	   data that will be used in other kernels.
 	
 */
 
@@ -34,78 +43,6 @@
 #define __ctzl(_X) \
 	63u - clz(_X & -_X)
 
-// r0 + 2^64 * r1 = a * b
-ulong2 mul_wide(const ulong a, const ulong b){
-	ulong2 r;
-#ifdef __NV_CL_C_VERSION
-	const uint a0 = (uint)(a), a1 = (uint)(a >> 32);
-	const uint b0 = (uint)(b), b1 = (uint)(b >> 32);
-	uint c0 = a0 * b0, c1 = mul_hi(a0, b0), c2, c3;
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a0), "r" (b1), "r" (c1));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c2) : "r" (a0), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b1), "r" (c2));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c3) : "r" (a1), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a1), "r" (b0), "r" (c1));
-	asm volatile ("madc.hi.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b0), "r" (c2));
-	asm volatile ("addc.u32 %0, %1, 0;" : "=r" (c3) : "r" (c3));
-	r.s0 = upsample(c1, c0); r.s1 = upsample(c3, c2);
-#else
-	r.s0 = a * b; r.s1 = mul_hi(a, b);
-#endif
-	return r;
-}
-
-ulong m_mul(ulong a, ulong b, ulong p, ulong q){
-	ulong2 ab = mul_wide(a,b);
-	ulong m = ab.s0 * q;
-	ulong mp = mul_hi(m,p);
-	ulong r = ab.s1 - mp;
-	return ( ab.s1 < mp ) ? r + p : r;
-}
-
-ulong add(ulong a, ulong b, ulong p){
-	ulong r;
-	ulong c = (a >= p - b) ? p : 0;
-	r = a + b - c;
-	return r;
-}
-
-ulong invert(ulong p){
-	ulong p_inv = 1, prev = 0;
-	while (p_inv != prev) { prev = p_inv; p_inv *= 2 - p * p_inv; }
-	return p_inv;
-}
-
-bool strong_prp_two(ulong N, ulong q, ulong one, ulong two, ulong nmo){
-	int t = __ctzl( (N-1) );
-	ulong exp = N >> t;
-	ulong curBit = 0x8000000000000000;
-	curBit >>= ( clz(exp) + 1 );
-	/* If N is prime and N = d*2^t+1, where d is odd, then either
-		1.  a^d = 1 (mod N), or
-		2.  a^(d*2^s) = -1 (mod N) for some s in 0 <= s < t    */
-	ulong a = two;
-  	/* r <-- a^d mod N, assuming d odd */
-	while( curBit ){
-		a = m_mul(a,a,N,q);
-		if(exp & curBit){
-			a = add(a,a,N);
-		}
-		curBit >>= 1;
-	}
-	/* Clause 1. and s = 0 case for clause 2. */
-	if(a == one || a == nmo){
-		return true;
-	}
-	/* 0 < s < t cases for clause 2. */
-	for(int s = 1; s < t; ++s){
-		a = m_mul(a,a,N,q);
-		if(a == nmo){
-	    		return true;
-		}
-	}
-	return false;
-}
 
 // 3 * wheel mod 30
 // this way we don't have to check for index wrap around
@@ -167,18 +104,118 @@ __constant uint p109[109] = { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 
 __constant uint p113[113] = { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2147483648, 0, 1073741824, 0, 536870912, 0, 268435456, 0, 134217728, 0, 67108864, 0, 33554432, 0, 16777216, 0, 8388608, 0, 4194304, 0, 2097152, 0, 1048576, 0, 524288, 0, 262144, 0, 131072, 0, 65536, 0, 32768, 0, 16384, 0, 8192, 0, 4096, 0, 2048, 0, 1024, 0, 512, 0, 256, 0, 128, 0, 64, 0, 32, 0, 16, 0, 8, 0, 4, 0, 2, 0 };
 
-__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void getsegprimes(ulong low, ulong high, int wheelidx, __global ulong8 *g_prime, __global uint *g_primecount){
-
-	const uint gid = get_global_id(0);
+// exclusive prefix sum of x over the 256 thread work-group.  total is set to the sum of all x
+uint groupScan(uint x, __local uint * scan, uint * total){
 	const uint lid = get_local_id(0);
-	int idx = wheelidx;
-	__local ulong sieved[1900];
-	__local int count;
+	scan[lid] = x;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for(uint s = 1; s < 256; s <<= 1){
+		uint t = (lid >= s) ? scan[lid - s] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		scan[lid] += t;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	*total = scan[255];
+	uint r = scan[lid] - x;
+	// scan array is reused by the next call
+	barrier(CLK_LOCAL_MEM_FENCE);
+	return r;
+}
 
-	if(lid == 0){
-		count = 0;
+// sieve the 7680 odd numbers starting at base by the primes in g_sieveprimes.  bit k of presieve represents base + 2k
+// .x is the prime sp and .y is the multiplicative order of 2 mod sp.  a multiple n = sp*m can only be a base 2
+// pseudoprime when ord | n-1, which is m == 1 mod ord.  these multiples are left for the PRP test so the list of
+// 2-PRPs is the same at any presieve bound.  sp*sp is the first multiple so primes in the range are not removed
+void deepPresieve(ulong base, __global uint2 * g_sieveprimes, uint sievecount, __local uint * presieve){
+	const uint lid = get_local_id(0);
+	if(lid < 241){
+		presieve[lid] = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for(uint j = lid; j < sievecount; j += 256){
+		const uint2 sp = g_sieveprimes[j];
+		const ulong sq = (ulong)sp.x * sp.x;
+		ulong k;
+		uint mm;
+		if(sq >= base){
+			k = (sq - base) >> 1;
+			mm = 1;
+		}
+		else{
+			// base mod sp*ord gives both the first multiple and its m mod ord
+			const ulong r = base % ((ulong)sp.x * sp.y);
+			uint d = (sp.x - (uint)(r % sp.x)) % sp.x;
+			// base is odd, the first odd multiple is an even distance away
+			if(d & 1) d += sp.x;
+			k = d >> 1;
+			mm = (uint)( ((r + d) / sp.x) % sp.y );
+		}
+		for(; k < 7680; k += sp.x){
+			if(mm != 1){
+				atomic_or(&presieve[k >> 5], 1u << (k & 31));
+			}
+			// next odd multiple is m+2
+			mm += 2;
+			if(mm >= sp.y) mm -= sp.y;
+		}
 	}
 	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// the 30 bits of the presieve array that belong to this thread's wheel turns
+uint presieveBits(__local uint * presieve){
+	const uint b = get_local_id(0) * 30;
+	const uint sh = b & 31;
+	uint bits = presieve[b >> 5] >> sh;
+	if(sh){
+		bits |= presieve[(b >> 5) + 1] << (32 - sh);
+	}
+	return bits;
+}
+
+#ifndef MONT32
+
+bool strong_prp_two(ulong N, ulong q, ulong one, ulong two, ulong nmo){
+	int t = __ctzl( (N-1) );
+	ulong exp = N >> t;
+	ulong curBit = 0x8000000000000000;
+	curBit >>= ( clz(exp) + 1 );
+	/* If N is prime and N = d*2^t+1, where d is odd, then either
+		1.  a^d = 1 (mod N), or
+		2.  a^(d*2^s) = -1 (mod N) for some s in 0 <= s < t    */
+	ulong a = two;
+  	/* r <-- a^d mod N, assuming d odd */
+	while( curBit ){
+		a = m_mul(a,a,N,q);
+		if(exp & curBit){
+			a = add(a,a,N);
+		}
+		curBit >>= 1;
+	}
+	/* Clause 1. and s = 0 case for clause 2. */
+	if(a == one || a == nmo){
+		return true;
+	}
+	/* 0 < s < t cases for clause 2. */
+	for(int s = 1; s < t; ++s){
+		a = m_mul(a,a,N,q);
+		if(a == nmo){
+	    		return true;
+		}
+	}
+	return false;
+}
+
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void getsegprimes(ulong low, ulong high, int wheelidx, __global PRIME *g_prime, __global uint *g_primecount,
+											__global uint2 *g_sieveprimes, uint sievecount,
+											__local ulong *sieved, uint sievedsize){
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	int idx = wheelidx;
+	__local uint scan[256];
+	__local uint gbase;
+	__local uint presieve[241];
 
 	// each thread is 2 turns of the mod 30 wheel
 	ulong P = low + (gid * 60);
@@ -196,39 +233,228 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void getsegprimes(ulo
 			| p71[P%71] | p73[P%73] | p79[P%79] | p83[P%83] | p89[P%89] | p97[P%97] | p101[P%101]
 			| p103[P%103] | p107[P%107] | p109[P%109] | p113[P%113];
 
-	while(P < end){
-		if( (bitsieve & 1) == 0 ){
-			sieved[atomic_inc(&count)] = P;
+	// sieve primes from 127 to the presieve bound
+	deepPresieve(low + (ulong)get_group_id(0) * 15360, g_sieveprimes, sievecount, presieve);
+	bitsieve |= presieveBits(presieve);
+
+	// count the numbers left in this thread's wheel turns
+	uint mine = 0;
+	ulong N = P;
+	uint bits = bitsieve;
+	for(int i = idx; N < end; ){
+		if( (bits & 1) == 0 ){
+			++mine;
 		}
+		int inc = wheel[i++];
+		N += inc*2;
+		bits >>= inc;
+#ifdef CKOVERFLOW
+		if(N < low) N = end;
+#endif
+	}
 
-		int inc = wheel[idx++];
-		P += inc*2;
-		bitsieve >>= inc;
+	uint count;
+	const uint first = groupScan(mine, scan, &count);
+
+	// stage the numbers in waves of sievedsize
+	for(uint wave = 0; wave < count; wave += sievedsize){
+		const uint wend = wave + sievedsize;
+
+		if(first < wend && first + mine > wave){
+			uint pos = first;
+			N = P;
+			bits = bitsieve;
+			for(int i = idx; N < end; ){
+				if( (bits & 1) == 0 ){
+					if(pos >= wave && pos < wend){
+						sieved[pos - wave] = N;
+					}
+					++pos;
+				}
+				int inc = wheel[i++];
+				N += inc*2;
+				bits >>= inc;
 #ifdef CKOVERFLOW
-		if(P < low) P = end;
+				if(N < low) N = end;
+#endif
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		const uint wcount = min(count - wave, sievedsize);
+
+		for(uint round = 0; round < wcount; round += 256){
+			const uint i = round + lid;
+			ulong p = 0, q = 0, one = 0, nmo = 0, two = 0;
+			uint prp = 0;
+			if(i < wcount){
+				p = sieved[i];
+				q = invert(p);
+				one = (-p) % p;
+				nmo = p - one;
+				two = add(one, one, p);
+				prp = strong_prp_two(p, q, one, two, nmo) ? 1 : 0;
+			}
+			uint found;
+			uint offset = groupScan(prp, scan, &found);
+			// one global atomic per round
+			if(lid == 0 && found){
+				gbase = atomic_add(&g_primecount[0], found);
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if(prp){
+#ifdef COMBINED
+				// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo
+				g_prime[ gbase + offset ] = (ulong8)( p, q, 0, one, two, nmo, 0, 0 );
+#else
+				g_prime[ gbase + offset ] = (ulong4)( p, q, 0, 0 );
 #endif
+			}
+		}
+		// next wave reuses the local array
+		barrier(CLK_LOCAL_MEM_FENCE);
 	}
-	barrier(CLK_LOCAL_MEM_FENCE);
 
-	for(int pos = lid; pos < count; pos += 256){
-		ulong p = sieved[pos];
-		ulong q = invert(p);
-		ulong one = (-p) % p;
-		ulong nmo = p - one;
-		ulong two = add(one, one, p);
-		if( strong_prp_two(p, q, one, two, nmo) ){
-			// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo
-			g_prime[ atomic_inc(&g_primecount[0]) ] = (ulong8)( p, q, 0, one, two, nmo, 0, 0 );
+}
+
+#endif
+
+
+/*
+	32 bit version used when P < 2^32.  Residues are stored as uint with montgomery R = 2^32.
+*/
+
+#ifdef MONT32
+
+// count trailing zeros
+#define __ctz(_X) \
+	31u - clz(_X & -_X)
+
+
+bool strong_prp_two32(uint N, uint q, uint one, uint two, uint nmo){
+	int t = __ctz( (N-1) );
+	uint exp = N >> t;
+	uint curBit = 0x80000000;
+	curBit >>= ( clz(exp) + 1 );
+	uint a = two;
+	while( curBit ){
+		a = m_mul32(a,a,N,q);
+		if(exp & curBit){
+			a = add32(a,a,N);
 		}
+		curBit >>= 1;
 	}
+	if(a == one || a == nmo){
+		return true;
+	}
+	for(int s = 1; s < t; ++s){
+		a = m_mul32(a,a,N,q);
+		if(a == nmo){
+	    		return true;
+		}
+	}
+	return false;
+}
 
-	if(lid == 0){
-		// set flag to notify cpu of local memory overflow
-		if(count > 1900){
-			atomic_or(&g_primecount[4], 1);
+__kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void getsegprimes32(ulong low, ulong high, int wheelidx, __global PRIME32 *g_prime, __global uint *g_primecount,
+											__global uint2 *g_sieveprimes, uint sievecount,
+											__local uint *sieved, uint sievedsize){
+
+	const uint gid = get_global_id(0);
+	const uint lid = get_local_id(0);
+	int idx = wheelidx;
+	__local uint scan[256];
+	__local uint gbase;
+	__local uint presieve[241];
+
+	// each thread is 2 turns of the mod 30 wheel
+	ulong P = low + (gid * 60);
+	ulong end = P + 60;
+	if(end > high) end = high;
+
+	// P fits in a uint whenever the loop below runs
+	const uint P32 = (uint)P;
+	uint bitsieve = p7[P32%7] | p11[P32%11] | p13[P32%13] | p17[P32%17] | p19[P32%19] | p23[P32%23] | p29[P32%29] | p31[P32%31]
+			| p37[P32%37] | p41[P32%41] | p43[P32%43] | p47[P32%47] | p53[P32%53] | p59[P32%59] | p61[P32%61] | p67[P32%67]
+			| p71[P32%71] | p73[P32%73] | p79[P32%79] | p83[P32%83] | p89[P32%89] | p97[P32%97] | p101[P32%101]
+			| p103[P32%103] | p107[P32%107] | p109[P32%109] | p113[P32%113];
+
+	// sieve primes from 127 to the presieve bound
+	deepPresieve(low + (ulong)get_group_id(0) * 15360, g_sieveprimes, sievecount, presieve);
+	bitsieve |= presieveBits(presieve);
+
+	// count the numbers left in this thread's wheel turns
+	uint mine = 0;
+	ulong N = P;
+	uint bits = bitsieve;
+	for(int i = idx; N < end; ){
+		if( (bits & 1) == 0 ){
+			++mine;
 		}
+		int inc = wheel[i++];
+		N += inc*2;
+		bits >>= inc;
 	}
 
-}
+	uint count;
+	const uint first = groupScan(mine, scan, &count);
+
+	// stage the numbers in waves of sievedsize
+	for(uint wave = 0; wave < count; wave += sievedsize){
+		const uint wend = wave + sievedsize;
+
+		if(first < wend && first + mine > wave){
+			uint pos = first;
+			N = P;
+			bits = bitsieve;
+			for(int i = idx; N < end; ){
+				if( (bits & 1) == 0 ){
+					if(pos >= wave && pos < wend){
+						sieved[pos - wave] = (uint)N;
+					}
+					++pos;
+				}
+				int inc = wheel[i++];
+				N += inc*2;
+				bits >>= inc;
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		const uint wcount = min(count - wave, sievedsize);
+
+		for(uint round = 0; round < wcount; round += 256){
+			const uint i = round + lid;
+			uint p = 0, q = 0, one = 0, nmo = 0, two = 0;
+			uint prp = 0;
+			if(i < wcount){
+				p = sieved[i];
+				q = invert32(p);
+				one = (-p) % p;
+				nmo = p - one;
+				two = add32(one, one, p);
+				prp = strong_prp_two32(p, q, one, two, nmo) ? 1 : 0;
+			}
+			uint found;
+			uint offset = groupScan(prp, scan, &found);
+			// one global atomic per round
+			if(lid == 0 && found){
+				gbase = atomic_add(&g_primecount[0], found);
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+			if(prp){
+#ifdef COMBINED
+				// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo
+				g_prime[ gbase + offset ] = (uint8)( p, q, 0, one, two, nmo, 0, 0 );
+#else
+				g_prime[ gbase + offset ] = (uint4)( p, q, 0, 0 );
+#endif
+			}
+		}
+		// next wave reuses the local array
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
 
+}
 
+#endif
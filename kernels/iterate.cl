@@ -20,146 +20,195 @@ typedef struct {
 	int type;
 }factor;
 
-// r0 + 2^64 * r1 = a * b
-ulong2 mul_wide(const ulong a, const ulong b){
-	ulong2 r;
-#ifdef __NV_CL_C_VERSION
-	const uint a0 = (uint)(a), a1 = (uint)(a >> 32);
-	const uint b0 = (uint)(b), b1 = (uint)(b >> 32);
-	uint c0 = a0 * b0, c1 = mul_hi(a0, b0), c2, c3;
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a0), "r" (b1), "r" (c1));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c2) : "r" (a0), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b1), "r" (c2));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c3) : "r" (a1), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a1), "r" (b0), "r" (c1));
-	asm volatile ("madc.hi.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b0), "r" (c2));
-	asm volatile ("addc.u32 %0, %1, 0;" : "=r" (c3) : "r" (c3));
-	r.s0 = upsample(c1, c0); r.s1 = upsample(c3, c2);
+// with -D SURVIVORS=1 the iterate kernels have two more arguments, the bits of the candidates left at the
+// start of the segment and a copy where a prime factor clears its candidate.  a factor is only reported for
+// a candidate that is left, the factors of 2-PRPs are discarded by the host.  the host copies the cleared
+// bits to g_alive after the segment, so every prime of the segment sees the same bits and the smallest
+// factor is reported.  the host writes its bits to both at each checkpoint.
+// each searched type has a plane of 2 bits per n, -1 then +1, in the order of the type numbers.
+#ifdef SURVIVORS
+#define SURVIVOR_ARGS , __global const uint * g_alive, __global uint * g_left
+#define SURVIVOR_PASS , g_alive, g_left
 #else
-	r.s0 = a * b; r.s1 = mul_hi(a, b);
+#define SURVIVOR_ARGS
+#define SURVIVOR_PASS
 #endif
-	return r;
-}
 
-ulong m_mul(ulong a, ulong b, ulong p, ulong q){
-	ulong2 ab = mul_wide(a,b);
-	ulong m = ab.s0 * q;
-	ulong mp = mul_hi(m,p);
-	ulong r = ab.s1 - mp;
-	return ( ab.s1 < mp ) ? r + p : r;
+void addFactor(__global uint * g_primecount, __global factor * g_factor, const ulong p, const int nc, const int type SURVIVOR_ARGS){
+#ifdef SURVIVORS
+	uint plane = 0;
+#ifdef SEARCH_FACTORIAL
+	if(type > FACTORIAL) ++plane;
+#endif
+#ifdef SEARCH_PRIMORIAL
+	if(type > PRIMORIAL) ++plane;
+#endif
+	const uint n = (nc < 0) ? -nc : nc;
+	const ulong bit = ((ulong)plane * (LAST_N - START_N) + (n - (START_N+1))) * 2 + (nc > 0);
+	const uint mask = 1U << (bit & 31);
+	if( !(g_alive[bit >> 5] & mask) ) return;
+	// factors are rare, rebuild the montgomery constants for the primality test
+	const ulong q = invert(p);
+	const ulong one = (-p) % p;
+	if( is_prime(p, q, one, m_r2(one, p, q)) ){
+		atomic_and(&g_left[bit >> 5], ~mask);
+	}
+#endif
+	uint i = atomic_inc(&g_primecount[2]);
+	factor fac = {p, nc, type};
+	g_factor[i] = fac;
 }
 
-ulong add(ulong a, ulong b, ulong p){
-	ulong r;
-	ulong c = (a >= p - b) ? p : 0;
-	r = a + b - c;
-	return r;
-}
+#ifndef MONT32
 
-__kernel void factorial_iterate(__global ulong8 * g_prime,
+#ifdef FACTORIAL_KERNELS
+__kernel void factorial_iterate(__global ulong4 * g_prime,
 				__global uint * g_primecount,
 				__global factor * g_factor,
 				const uint startN,
-				const uint endN ){
+				const uint endN SURVIVOR_ARGS ){
 
 	const uint gid = get_global_id(0);
 
 	if(gid >= g_primecount[0]) return;
 
-	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue, .s7=N in montgomery form
-	ulong8 prime = g_prime[gid];
+	// .s0=p, .s1=q, .s2=residue, .s3=N in montgomery form
+	ulong4 prime = g_prime[gid];
 
-	for(uint currN = startN; currN < endN; ++currN){
-		prime.s7 = add(prime.s7, prime.s3, prime.s0);
-		prime.s6 = m_mul(prime.s6, prime.s7, prime.s0, prime.s1);
-		if(prime.s6 == prime.s3 || prime.s6 == prime.s5){
-			uint i = atomic_inc(&g_primecount[2]);
-			factor fac = {prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, FACTORIAL};
-			g_factor[i] = fac;
+	// retired prime, residue is zero
+	if(prime.s2 == 0) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+	const ulong nmo = prime.s0 - one;
+
+	// the residue becomes zero at n = p
+	const uint stopN = (prime.s0 < endN) ? (uint)prime.s0 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s3 = add(prime.s3, one, prime.s0);
+		prime.s2 = m_mul(prime.s2, prime.s3, prime.s0, prime.s1);
+		if(prime.s2 == one || prime.s2 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s2 == one) ? -((int)currN) : (int)currN, FACTORIAL SURVIVOR_PASS);
 		}
 	}
 
+	if(stopN < endN){
+		g_prime[gid].s2 = 0;
+		return;
+	}
+
 	// store final residue and n
-	g_prime[gid].s6 = prime.s6;
-	g_prime[gid].s7 = prime.s7;
+	g_prime[gid].s2 = prime.s2;
+	g_prime[gid].s3 = prime.s3;
 }
+#endif
 
 
-__kernel void primorial_iterate(__global ulong8 * g_prime,
+#ifdef PRIMORIAL_KERNELS
+__kernel void primorial_iterate(__global ulong4 * g_prime,
 				__global uint * g_primecount,
 				__global factor * g_factor,
 				const uint start,
 				const uint end,
-				__global uint * g_smallprimes ){
+				__global uint * g_smallprimes SURVIVOR_ARGS ){
 
 	const uint gid = get_global_id(0);
 
 	if(gid >= g_primecount[0]) return;
 
-	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue, .s7=N in montgomery form
-	ulong8 prime = g_prime[gid];
+	// .s0=p, .s1=q, .s2=residue, .s3=r2
+	ulong4 prime = g_prime[gid];
+
+	// retired prime, residue is zero
+	if(prime.s2 == 0) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+	const ulong nmo = prime.s0 - one;
 
 	for(uint j=start; j<end; ++j){
 		uint p = g_smallprimes[j];
-		ulong montprime = m_mul(p, prime.s2, prime.s0, prime.s1);
-		prime.s6 = m_mul(prime.s6, montprime, prime.s0, prime.s1);
-		if(prime.s6 == prime.s3 || prime.s6 == prime.s5){
-			uint i = atomic_inc(&g_primecount[2]);
-			factor fac = {prime.s0, (prime.s6 == prime.s3) ? -((int)p) : (int)p, PRIMORIAL};
-			g_factor[i] = fac;
+		if(p == prime.s0){
+			// residue is zero from here on
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		ulong montprime = m_mul(p, prime.s3, prime.s0, prime.s1);
+		prime.s2 = m_mul(prime.s2, montprime, prime.s0, prime.s1);
+		if(prime.s2 == one || prime.s2 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s2 == one) ? -((int)p) : (int)p, PRIMORIAL SURVIVOR_PASS);
 		}
 	}
 
 	// store final residue
-	g_prime[gid].s6 = prime.s6;
+	g_prime[gid].s2 = prime.s2;
 }
+#endif
 
 
-__kernel void compositorial_iterate(	__global ulong8 * g_prime,
+#ifdef COMPOSITORIAL_KERNELS
+__kernel void compositorial_iterate(	__global ulong4 * g_prime,
 					__global uint * g_primecount,
 					__global factor * g_factor,
 					const uint startN,
 					const uint endN,
 					__global uint * g_smallprimes,
-					const uint primeposition ){
+					const uint primeposition SURVIVOR_ARGS ){
 
 	const uint gid = get_global_id(0);
 
 	if(gid >= g_primecount[0]) return;
 
-	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue, .s7=N in montgomery form
-	ulong8 prime = g_prime[gid];
+	// .s0=p, .s1=q, .s2=residue, .s3=N in montgomery form
+	ulong4 prime = g_prime[gid];
+
+	// retired prime, residue is zero
+	if(prime.s2 == 0) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+	const ulong nmo = prime.s0 - one;
+
 	uint ppos = primeposition;
 	uint nextprime = g_smallprimes[ppos];
 
-	for(uint currN = startN; currN < endN; ++currN){
-		prime.s7 = add(prime.s7, prime.s3, prime.s0);
+	// the residue becomes zero at n = 2p, the first composite multiple of p
+	const uint stopN = (prime.s0 < (endN+1)/2) ? (uint)prime.s0*2 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s3 = add(prime.s3, one, prime.s0);
 		if(currN == nextprime){
 			nextprime = g_smallprimes[++ppos];
 			continue;
 		}
-		prime.s6 = m_mul(prime.s6, prime.s7, prime.s0, prime.s1);
-		if(prime.s6 == prime.s3 || prime.s6 == prime.s5){
-			uint i = atomic_inc(&g_primecount[2]);		// found compositorial factor
-			factor fac = {prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, COMPOSITORIAL};
-			g_factor[i] = fac;
+		prime.s2 = m_mul(prime.s2, prime.s3, prime.s0, prime.s1);
+		if(prime.s2 == one || prime.s2 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s2 == one) ? -((int)currN) : (int)currN, COMPOSITORIAL SURVIVOR_PASS);		// found compositorial factor
 		}
 	}
 
+	if(stopN < endN){
+		g_prime[gid].s2 = 0;
+		return;
+	}
+
 	// store final residue and n
-	g_prime[gid].s6 = prime.s6;
-	g_prime[gid].s7 = prime.s7;
+	g_prime[gid].s2 = prime.s2;
+	g_prime[gid].s3 = prime.s3;
 
 }
+#endif
 
 
+#ifdef COMBINED_KERNELS
 __kernel void combined_iterate(	__global ulong8 * g_prime,
 				__global uint * g_primecount,
 				__global factor * g_factor,
 				const uint startN,
 				const uint endN,
 				__global uint * g_smallprimes,
-				const uint primeposition ){
+				const uint primeposition SURVIVOR_ARGS ){
 
 	const uint gid = get_global_id(0);
 
@@ -167,16 +216,21 @@ __kernel void combined_iterate(	__global ulong8 * g_prime,
 
 	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of start!/#, .s5=nmo, .s6=residue of start!, .s7=N in montgomery form
 	ulong8 prime = g_prime[gid];
+
+	// retired prime, both residues are zero
+	if(prime.s4 == 0) return;
+
 	uint ppos = primeposition;
 	uint nextprime = g_smallprimes[ppos];
 
-	for(uint currN = startN; currN < endN; ++currN){
+	// the factorial residue becomes zero at n = p and the compositorial residue at n = 2p
+	const uint stopN = (prime.s0 < (endN+1)/2) ? (uint)prime.s0*2 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
 		prime.s7 = add(prime.s7, prime.s3, prime.s0);
 		prime.s6 = m_mul(prime.s6, prime.s7, prime.s0, prime.s1);
 		if(prime.s6 == prime.s3 || prime.s6 == prime.s5){
-			uint i = atomic_inc(&g_primecount[2]);		// found factorial factor
-			factor fac = {prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, FACTORIAL};
-			g_factor[i] = fac;
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, FACTORIAL SURVIVOR_PASS);		// found factorial factor
 		}
 		if(currN == nextprime){
 			nextprime = g_smallprimes[++ppos];
@@ -184,18 +238,377 @@ __kernel void combined_iterate(	__global ulong8 * g_prime,
 		}
 		prime.s4 = m_mul(prime.s4, prime.s7, prime.s0, prime.s1);
 		if(prime.s4 == prime.s3 || prime.s4 == prime.s5){
-			uint i = atomic_inc(&g_primecount[2]);		// found compositorial factor
-			factor fac = {prime.s0, (prime.s4 == prime.s3) ? -((int)currN) : (int)currN, COMPOSITORIAL};
-			g_factor[i] = fac;
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s4 == prime.s3) ? -((int)currN) : (int)currN, COMPOSITORIAL SURVIVOR_PASS);		// found compositorial factor
 		}
 	}
 
+	if(stopN < endN){
+		g_prime[gid].s4 = 0;
+		g_prime[gid].s6 = 0;
+		return;
+	}
+
 	// store final residues and n
 	g_prime[gid].s4 = prime.s4;
 	g_prime[gid].s6 = prime.s6;
 	g_prime[gid].s7 = prime.s7;
 
 }
+#endif
+
+
+#ifdef COMBINED3_KERNELS
+__kernel void combined3_iterate(	__global ulong8 * g_prime,
+				__global uint * g_primecount,
+				__global factor * g_factor,
+				const uint startN,
+				const uint endN,
+				__global uint * g_smallprimes,
+				const uint primeposition SURVIVOR_ARGS ){
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of start!/#, .s5=residue of start#, .s6=residue of start!, .s7=N in montgomery form
+	ulong8 prime = g_prime[gid];
+
+	// retired prime, all residues are zero.  n!/# is zero first, except for the primorial residue of a
+	// 2-PRP that is a prime power like 1093^2, which never becomes zero
+	if(prime.s4 == 0 && prime.s5 == 0) return;
+
+	const ulong nmo = prime.s0 - prime.s3;
+
+	uint ppos = primeposition;
+	uint nextprime = g_smallprimes[ppos];
+
+	// the factorial and primorial residues become zero at n = p and the compositorial residue at n = 2p
+	const uint stopN = (prime.s0 < (endN+1)/2) ? (uint)prime.s0*2 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s7 = add(prime.s7, prime.s3, prime.s0);
+		prime.s6 = m_mul(prime.s6, prime.s7, prime.s0, prime.s1);
+		if(prime.s6 == prime.s3 || prime.s6 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, FACTORIAL SURVIVOR_PASS);		// found factorial factor
+		}
+		if(currN == nextprime){
+			nextprime = g_smallprimes[++ppos];
+			prime.s5 = m_mul(prime.s5, prime.s7, prime.s0, prime.s1);
+			if(prime.s5 == prime.s3 || prime.s5 == nmo){
+				addFactor(g_primecount, g_factor, prime.s0, (prime.s5 == prime.s3) ? -((int)currN) : (int)currN, PRIMORIAL SURVIVOR_PASS);		// found primorial factor
+			}
+			continue;
+		}
+		prime.s4 = m_mul(prime.s4, prime.s7, prime.s0, prime.s1);
+		if(prime.s4 == prime.s3 || prime.s4 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s4 == prime.s3) ? -((int)currN) : (int)currN, COMPOSITORIAL SURVIVOR_PASS);		// found compositorial factor
+		}
+	}
+
+	if(stopN < endN){
+		if(prime.s5 == 0){
+			g_prime[gid].s4 = 0;
+			g_prime[gid].s5 = 0;
+			g_prime[gid].s6 = 0;
+			return;
+		}
+		// a prime power 2-PRP, its factorial and compositorial residues are zero.  iterate the primorial
+		for(uint currN = max(startN, stopN); currN < endN; ++currN){
+			prime.s7 = add(prime.s7, prime.s3, prime.s0);
+			if(currN == nextprime){
+				nextprime = g_smallprimes[++ppos];
+				prime.s5 = m_mul(prime.s5, prime.s7, prime.s0, prime.s1);
+				if(prime.s5 == prime.s3 || prime.s5 == nmo){
+					addFactor(g_primecount, g_factor, prime.s0, (prime.s5 == prime.s3) ? -((int)currN) : (int)currN, PRIMORIAL SURVIVOR_PASS);		// found primorial factor
+				}
+			}
+		}
+	}
+
+	// store final residues and n
+	g_prime[gid].s4 = prime.s4;
+	g_prime[gid].s5 = prime.s5;
+	g_prime[gid].s6 = prime.s6;
+	g_prime[gid].s7 = prime.s7;
+
+}
+#endif
+
+#endif
+
+
+/*
+	32 bit versions used when P < 2^32.  Residues are stored as uint with montgomery R = 2^32.
+*/
+
+#ifdef MONT32
+#ifdef FACTORIAL_KERNELS
+__kernel void factorial_iterate32(__global uint4 * g_prime,
+				__global uint * g_primecount,
+				__global factor * g_factor,
+				const uint startN,
+				const uint endN SURVIVOR_ARGS ){
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue, .s3=N in montgomery form
+	uint4 prime = g_prime[gid];
+
+	// retired prime, residue is zero
+	if(prime.s2 == 0) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+	const uint nmo = prime.s0 - one;
+
+	// the residue becomes zero at n = p
+	const uint stopN = (prime.s0 < endN) ? (uint)prime.s0 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s3 = add32(prime.s3, one, prime.s0);
+		prime.s2 = m_mul32(prime.s2, prime.s3, prime.s0, prime.s1);
+		if(prime.s2 == one || prime.s2 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s2 == one) ? -((int)currN) : (int)currN, FACTORIAL SURVIVOR_PASS);
+		}
+	}
+
+	if(stopN < endN){
+		g_prime[gid].s2 = 0;
+		return;
+	}
+
+	g_prime[gid].s2 = prime.s2;
+	g_prime[gid].s3 = prime.s3;
+}
+#endif
+
+
+#ifdef PRIMORIAL_KERNELS
+__kernel void primorial_iterate32(__global uint4 * g_prime,
+				__global uint * g_primecount,
+				__global factor * g_factor,
+				const uint start,
+				const uint end,
+				__global uint * g_smallprimes SURVIVOR_ARGS ){
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue, .s3=r2
+	uint4 prime = g_prime[gid];
+
+	// retired prime, residue is zero
+	if(prime.s2 == 0) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+	const uint nmo = prime.s0 - one;
+
+	for(uint j=start; j<end; ++j){
+		uint p = g_smallprimes[j];
+		if(p == prime.s0){
+			// residue is zero from here on
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		uint montprime = m_mul32(p, prime.s3, prime.s0, prime.s1);
+		prime.s2 = m_mul32(prime.s2, montprime, prime.s0, prime.s1);
+		if(prime.s2 == one || prime.s2 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s2 == one) ? -((int)p) : (int)p, PRIMORIAL SURVIVOR_PASS);
+		}
+	}
+
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+#ifdef COMPOSITORIAL_KERNELS
+__kernel void compositorial_iterate32(	__global uint4 * g_prime,
+					__global uint * g_primecount,
+					__global factor * g_factor,
+					const uint startN,
+					const uint endN,
+					__global uint * g_smallprimes,
+					const uint primeposition SURVIVOR_ARGS ){
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue, .s3=N in montgomery form
+	uint4 prime = g_prime[gid];
+
+	// retired prime, residue is zero
+	if(prime.s2 == 0) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+	const uint nmo = prime.s0 - one;
+
+	uint ppos = primeposition;
+	uint nextprime = g_smallprimes[ppos];
+
+	// the residue becomes zero at n = 2p, the first composite multiple of p
+	const uint stopN = (prime.s0 < (endN+1)/2) ? (uint)prime.s0*2 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s3 = add32(prime.s3, one, prime.s0);
+		if(currN == nextprime){
+			nextprime = g_smallprimes[++ppos];
+			continue;
+		}
+		prime.s2 = m_mul32(prime.s2, prime.s3, prime.s0, prime.s1);
+		if(prime.s2 == one || prime.s2 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s2 == one) ? -((int)currN) : (int)currN, COMPOSITORIAL SURVIVOR_PASS);		// found compositorial factor
+		}
+	}
+
+	if(stopN < endN){
+		g_prime[gid].s2 = 0;
+		return;
+	}
+
+	g_prime[gid].s2 = prime.s2;
+	g_prime[gid].s3 = prime.s3;
+
+}
+#endif
+
+
+#ifdef COMBINED_KERNELS
+__kernel void combined_iterate32(	__global uint8 * g_prime,
+				__global uint * g_primecount,
+				__global factor * g_factor,
+				const uint startN,
+				const uint endN,
+				__global uint * g_smallprimes,
+				const uint primeposition SURVIVOR_ARGS ){
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of start!/#, .s5=nmo, .s6=residue of start!, .s7=N in montgomery form
+	uint8 prime = g_prime[gid];
+
+	// retired prime, both residues are zero
+	if(prime.s4 == 0) return;
+
+	uint ppos = primeposition;
+	uint nextprime = g_smallprimes[ppos];
+
+	// the factorial residue becomes zero at n = p and the compositorial residue at n = 2p
+	const uint stopN = (prime.s0 < (endN+1)/2) ? (uint)prime.s0*2 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s7 = add32(prime.s7, prime.s3, prime.s0);
+		prime.s6 = m_mul32(prime.s6, prime.s7, prime.s0, prime.s1);
+		if(prime.s6 == prime.s3 || prime.s6 == prime.s5){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, FACTORIAL SURVIVOR_PASS);		// found factorial factor
+		}
+		if(currN == nextprime){
+			nextprime = g_smallprimes[++ppos];
+			continue;
+		}
+		prime.s4 = m_mul32(prime.s4, prime.s7, prime.s0, prime.s1);
+		if(prime.s4 == prime.s3 || prime.s4 == prime.s5){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s4 == prime.s3) ? -((int)currN) : (int)currN, COMPOSITORIAL SURVIVOR_PASS);		// found compositorial factor
+		}
+	}
+
+	if(stopN < endN){
+		g_prime[gid].s4 = 0;
+		g_prime[gid].s6 = 0;
+		return;
+	}
+
+	g_prime[gid].s4 = prime.s4;
+	g_prime[gid].s6 = prime.s6;
+	g_prime[gid].s7 = prime.s7;
+
+}
+#endif
 
 
+#ifdef COMBINED3_KERNELS
+__kernel void combined3_iterate32(	__global uint8 * g_prime,
+				__global uint * g_primecount,
+				__global factor * g_factor,
+				const uint startN,
+				const uint endN,
+				__global uint * g_smallprimes,
+				const uint primeposition SURVIVOR_ARGS ){
 
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=residue of start!/#, .s5=residue of start#, .s6=residue of start!, .s7=N in montgomery form
+	uint8 prime = g_prime[gid];
+
+	// retired prime, all residues are zero.  n!/# is zero first, except for the primorial residue of a
+	// 2-PRP that is a prime power like 1093^2, which never becomes zero
+	if(prime.s4 == 0 && prime.s5 == 0) return;
+
+	const uint nmo = prime.s0 - prime.s3;
+
+	uint ppos = primeposition;
+	uint nextprime = g_smallprimes[ppos];
+
+	// the factorial and primorial residues become zero at n = p and the compositorial residue at n = 2p
+	const uint stopN = (prime.s0 < (endN+1)/2) ? (uint)prime.s0*2 : endN;
+
+	for(uint currN = startN; currN < stopN; ++currN){
+		prime.s7 = add32(prime.s7, prime.s3, prime.s0);
+		prime.s6 = m_mul32(prime.s6, prime.s7, prime.s0, prime.s1);
+		if(prime.s6 == prime.s3 || prime.s6 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s6 == prime.s3) ? -((int)currN) : (int)currN, FACTORIAL SURVIVOR_PASS);		// found factorial factor
+		}
+		if(currN == nextprime){
+			nextprime = g_smallprimes[++ppos];
+			prime.s5 = m_mul32(prime.s5, prime.s7, prime.s0, prime.s1);
+			if(prime.s5 == prime.s3 || prime.s5 == nmo){
+				addFactor(g_primecount, g_factor, prime.s0, (prime.s5 == prime.s3) ? -((int)currN) : (int)currN, PRIMORIAL SURVIVOR_PASS);		// found primorial factor
+			}
+			continue;
+		}
+		prime.s4 = m_mul32(prime.s4, prime.s7, prime.s0, prime.s1);
+		if(prime.s4 == prime.s3 || prime.s4 == nmo){
+			addFactor(g_primecount, g_factor, prime.s0, (prime.s4 == prime.s3) ? -((int)currN) : (int)currN, COMPOSITORIAL SURVIVOR_PASS);		// found compositorial factor
+		}
+	}
+
+	if(stopN < endN){
+		if(prime.s5 == 0){
+			g_prime[gid].s4 = 0;
+			g_prime[gid].s5 = 0;
+			g_prime[gid].s6 = 0;
+			return;
+		}
+		// a prime power 2-PRP, its factorial and compositorial residues are zero.  iterate the primorial
+		for(uint currN = max(startN, stopN); currN < endN; ++currN){
+			prime.s7 = add32(prime.s7, prime.s3, prime.s0);
+			if(currN == nextprime){
+				nextprime = g_smallprimes[++ppos];
+				prime.s5 = m_mul32(prime.s5, prime.s7, prime.s0, prime.s1);
+				if(prime.s5 == prime.s3 || prime.s5 == nmo){
+					addFactor(g_primecount, g_factor, prime.s0, (prime.s5 == prime.s3) ? -((int)currN) : (int)currN, PRIMORIAL SURVIVOR_PASS);		// found primorial factor
+				}
+			}
+		}
+	}
+
+	// store final residues and n
+	g_prime[gid].s4 = prime.s4;
+	g_prime[gid].s5 = prime.s5;
+	g_prime[gid].s6 = prime.s6;
+	g_prime[gid].s7 = prime.s7;
+
+}
+#endif
+
+#endif
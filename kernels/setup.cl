@@ -2,7 +2,7 @@
 
 	setup.cl - Bryan Little 4/2025, montgomery arithmetic by Yves Gallot
 	
-	generates nmin! mod P using power or product tables
+	generates nmin! mod P using a bit-sliced power table or product tables
 
 	The CPU will run this kernel in many small chunks to limit kernel runtime.
 
@@ -10,61 +10,293 @@
 
 */
 
-// r0 + 2^64 * r1 = a * b
-ulong2 mul_wide(const ulong a, const ulong b){
-	ulong2 r;
-#ifdef __NV_CL_C_VERSION
-	const uint a0 = (uint)(a), a1 = (uint)(a >> 32);
-	const uint b0 = (uint)(b), b1 = (uint)(b >> 32);
-	uint c0 = a0 * b0, c1 = mul_hi(a0, b0), c2, c3;
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a0), "r" (b1), "r" (c1));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c2) : "r" (a0), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b1), "r" (c2));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c3) : "r" (a1), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a1), "r" (b0), "r" (c1));
-	asm volatile ("madc.hi.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b0), "r" (c2));
-	asm volatile ("addc.u32 %0, %1, 0;" : "=r" (c3) : "r" (c3));
-	r.s0 = upsample(c1, c0); r.s1 = upsample(c3, c2);
-#else
-	r.s0 = a * b; r.s1 = mul_hi(a, b);
+#ifdef COMBINED3_KERNELS
+// for p <= startN < 2^31, the float root is off by at most one.  the 2-PRPs that are prime powers,
+// 1093^2 and 3511^2, are squares
+bool small_square(ulong p){
+	uint r = (uint)sqrt((float)p);
+	if((ulong)r*r > p) --r;
+	else if((ulong)(r+1)*(r+1) <= p) ++r;
+	return (ulong)r*r == p;
+}
 #endif
+
+#ifndef MONT32
+
+// a^e, a in montgomery form, e > 0
+ulong m_pow(ulong a, uint e, ulong p, ulong q){
+	uint curBit = 0x80000000;
+	curBit >>= clz(e);
+	curBit >>= 1;
+	ulong r = a;
+	while( curBit ){
+		r = m_mul(r, r, p, q);
+		if(e & curBit){
+			r = m_mul(r, a, p, q);
+		}
+		curBit >>= 1;
+	}
 	return r;
 }
 
-ulong m_mul(ulong a, ulong b, ulong p, ulong q){
-	ulong2 ab = mul_wide(a,b);
-	ulong m = ab.s0 * q;
-	ulong mp = mul_hi(m,p);
-	ulong r = ab.s1 - mp;
-	return ( ab.s1 < mp ) ? r + p : r;
+#ifdef FACTORIAL_KERNELS
+__kernel void factorial_setup(	__global ulong4 * g_prime,
+				__global uint * g_primecount,
+			 	__global ulong * g_smallprimeprod,
+				const uint start,
+				const uint end,
+				__global uint2 * g_smallpowers) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of startN! mod P, .s3=startN in montgomery form
+	ulong4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N)) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+	const ulong r2 = m_r2(one, prime.s0, prime.s1);
+
+	if(!start){
+		// montgomery form of startN
+		g_prime[gid].s3 = m_mul(START_N, r2, prime.s0, prime.s1);
+		// primes <= startN divide startN!, the residue is zero
+		if(AT_MOST(prime.s0, START_N)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	// bit-sliced power table, one squaring chain from the highest bit down
+	for(uint i=start; i<end; ++i){
+		// .s0=bit, .s1=squarings before this term
+		const uint sq = g_smallpowers[i].s1;
+		for(uint k=0; k<sq; ++k){
+			prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
+		}
+		const ulong base = m_mul(g_smallprimeprod[i], r2, prime.s0, prime.s1);
+		prime.s2 = m_mul(prime.s2, base, prime.s0, prime.s1);
+	}
+
+	// done with power table, store to global
+	// residue is equal to startN! mod P
+	g_prime[gid].s2 = prime.s2;
 }
+#endif
 
-ulong add(ulong a, ulong b, ulong p){
-	ulong r;
-	ulong c = (a >= p - b) ? p : 0;
-	r = a + b - c;
+
+// a^(p-2) = a^-1 mod p, p is prime
+ulong m_inv(ulong a, ulong p, ulong q){
+	const ulong e = p - 2;
+	ulong curBit = 0x8000000000000000;
+	curBit >>= ( clz(e) + 1 );
+	ulong r = a;
+	while( curBit ){
+		r = m_mul(r, r, p, q);
+		if(e & curBit){
+			r = m_mul(r, a, p, q);
+		}
+		curBit >>= 1;
+	}
 	return r;
 }
 
-__kernel void factorial_setup(	__global ulong8 * g_prime,
+#ifdef FACTORIAL_KERNELS
+// Wilson's theorem, startN! = (-1)^(p-startN) / (p-1-startN)! mod p
+// used instead of the power table when p-1-startN is small.  The CPU will run this kernel in chunks of
+// k = start+1 to end, where (p-1-startN)! is the product of k up to p-1-startN.  The last chunk inverts it.
+__kernel void factorial_reflect(	__global ulong4 * g_prime,
+					__global uint * g_primecount,
+					const uint last,
+					const uint start,
+					const uint end) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of startN! mod P, .s3=startN in montgomery form
+	ulong4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N)) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+	const ulong r2 = m_r2(one, prime.s0, prime.s1);
+
+	if(!start){
+		// montgomery form of startN
+		g_prime[gid].s3 = m_mul(START_N, r2, prime.s0, prime.s1);
+		// primes <= startN divide startN!, the residue is zero
+		if(AT_MOST(prime.s0, START_N)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	const ulong m = prime.s0 - 1 - START_N;
+	const uint kend = (m < end) ? (uint)m : end;
+	if(start < kend){
+		// k in montgomery form
+		ulong mk = m_mul(start+1, r2, prime.s0, prime.s1);
+		for(uint k=start+1; k<=kend; ++k){
+			prime.s2 = m_mul(prime.s2, mk, prime.s0, prime.s1);
+			mk = add(mk, one, prime.s0);
+		}
+	}
+
+	if(end == last){
+		// Wilson's theorem needs a prime.  the host keeps p below 2*startN, where a composite p divides
+		// startN! and the power table gives zero
+		if(!is_prime(prime.s0, prime.s1, one, r2)){
+			prime.s2 = 0;
+		}
+		else{
+			prime.s2 = m_inv(prime.s2, prime.s0, prime.s1);
+			// p is odd, p-startN is odd when startN is even
+			if(!(START_N & 1)){
+				prime.s2 = prime.s0 - prime.s2;
+			}
+		}
+	}
+
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+#ifdef PRIMORIAL_KERNELS
+__kernel void primorial_setup(	__global ulong4 * g_prime,
+				__global uint * g_primecount,
+				__global ulong2 * g_smallprimeprod,
+				const uint start,
+				const uint end,
+				const uint count) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of start# mod P, .s3=r2
+	ulong4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N)) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+
+	if(!start){
+		// r2 is kept in .s3 for the iterate kernel
+		prime.s3 = m_r2(one, prime.s0, prime.s1);
+		g_prime[gid].s3 = prime.s3;
+		// primes <= startN divide startN#, the residue is zero
+		if(AT_MOST(prime.s0, START_N)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	// each 128 bit product adds a factor of 2^-128
+	for(uint i=start; i<end; ++i){
+		prime.s2 = m_mul128(prime.s2, g_smallprimeprod[i], prime.s0, prime.s1);
+	}
+
+	// last kernel, multiply by 2^128 for each product
+	if(end == count){
+		prime.s2 = m_mul(prime.s2, m_pow(prime.s3, 2*count, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// done with initial primorial, store to global
+	// residue is equal to start# mod P
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+#ifdef COMPOSITORIAL_KERNELS
+__kernel void compositorial_setup(	__global ulong4 * g_prime,
+					__global uint * g_primecount,
+				 	__global ulong2 * g_smallcompprod,
+					const uint start,
+					const uint end,
+				const uint count) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of start!/# mod P, .s3=startN in montgomery form
+	ulong4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N/2)) return;
+
+	// montgomery constants are rebuilt from p
+	const ulong one = (-prime.s0) % prime.s0;
+	const ulong r2 = m_r2(one, prime.s0, prime.s1);
+
+	if(!start){
+		// montgomery form of startN
+		g_prime[gid].s3 = m_mul(START_N, r2, prime.s0, prime.s1);
+		// 2p <= startN divides startN!/#, the residue is zero
+		if(AT_MOST(prime.s0, START_N/2)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	// each 128 bit product adds a factor of 2^-128
+	for(uint i=start; i<end; ++i){
+		prime.s2 = m_mul128(prime.s2, g_smallcompprod[i], prime.s0, prime.s1);
+	}
+
+	// last kernel, multiply by 2^128 for each product
+	if(end == count){
+		prime.s2 = m_mul(prime.s2, m_pow(r2, 2*count, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// done with initial primorial, store to global
+	// residue is equal to start!/# mod P
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+#if defined(COMBINED_KERNELS) && !defined(COMPINV)
+__kernel void combined_setup(	__global ulong8 * g_prime,
 				__global uint * g_primecount,
 			 	__global ulong * g_smallprimeprod,
 				const uint start,
 				const uint end,
 				__global uint2 * g_smallpowers,
-				const uint startN) {
+			 	__global ulong2 * g_smallcompprod,
+				const uint f_end,
+				const uint c_end) {
 
 	const uint gid = get_global_id(0);
 
 	if(gid >= g_primecount[0]) return;
 
-	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN! mod P, .s7=startN in montgomery form
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN!, .s7=startN in montgomery form
 	ulong8 prime = g_prime[gid];
-	uint i = start;
 
+	// retired prime, both residues were set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N/2)) return;
+
+	// first iteration of kernel
 	if(!start){
-		++i;
 		// setup r2 and montgomery form of startN
+		// after r2 setup, .s4 is now used for compositorial residue
 		prime.s2 = add(prime.s4, prime.s4, prime.s0);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
@@ -72,141 +304,481 @@ __kernel void factorial_setup(	__global ulong8 * g_prime,
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);	// 4^{2^5} = 2^64
 		g_prime[gid].s2 = prime.s2;
-		g_prime[gid].s7 = m_mul(startN, prime.s2, prime.s0, prime.s1);
-		// first iteration, base prime = 2
-		// .s0=exp, .s1=curBit
-		uint2 p = g_smallpowers[0];
-		// left to right powmod
-		ulong a = prime.s4;
-		while( p.s1 ){
-			a = m_mul(a, a, prime.s0, prime.s1);
-			if(p.s0 & p.s1){
-				a = add(a, a, prime.s0);		// base 2 we can add
-			}
-			p.s1 >>= 1;
-		}
-		prime.s6 = a;
-	}
-	for(; i<end; ++i){
-		// remaining iterations, starting at prime = 3
-		ulong sm_prime = g_smallprimeprod[i];
-		// .s0=exp, .s1=curBit
-		uint2 p = g_smallpowers[i];
-		const ulong base = m_mul(sm_prime, prime.s2, prime.s0, prime.s1);
-		ulong primepow;
-		if(p.s0 == 1){
-			primepow = base;
+		g_prime[gid].s7 = m_mul(START_N, prime.s2, prime.s0, prime.s1);
+		// 2p <= startN divides startN! and startN!/#, both residues are zero
+		if(AT_MOST(prime.s0, START_N/2)){
+			g_prime[gid].s4 = 0;
+			g_prime[gid].s6 = 0;
+			return;
 		}
-		else{
-			ulong a = base;
-			while( p.s1 ){
-				a = m_mul(a, a, prime.s0, prime.s1);
-				if(p.s0 & p.s1){
-					a = m_mul(a, base, prime.s0, prime.s1);
-				}
-				p.s1 >>= 1;
-			}
-			primepow = a;
+		// primes <= startN divide startN!
+		prime.s6 = AT_MOST(prime.s0, START_N) ? 0 : prime.s3;
+		prime.s4 = prime.s3;
+	}
+
+	// bit-sliced factorial power table, one squaring chain from the highest bit down
+	uint loop_end = (end > f_end) ? f_end : end;
+	if(AT_MOST(prime.s0, START_N)) loop_end = 0;
+	for(uint k=start; k<loop_end; ++k){
+		// .s0=bit, .s1=squarings before this term
+		const uint sq = g_smallpowers[k].s1;
+		for(uint j=0; j<sq; ++j){
+			prime.s6 = m_mul(prime.s6, prime.s6, prime.s0, prime.s1);
 		}
-		prime.s6 = m_mul(prime.s6, primepow, prime.s0, prime.s1);
+		const ulong base = m_mul(g_smallprimeprod[k], prime.s2, prime.s0, prime.s1);
+		prime.s6 = m_mul(prime.s6, base, prime.s0, prime.s1);
 	}
 
-	// done with power table, store to global
-	// residue is equal to startN! mod P
+	// each 128 bit compositorial product adds a factor of 2^-128
+	loop_end = (end > c_end) ? c_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s4 = m_mul128(prime.s4, g_smallcompprod[k], prime.s0, prime.s1);
+	}
+	// end of the compositorial table, multiply by 2^128 for each product
+	if(start < c_end && end >= c_end){
+		prime.s4 = m_mul(prime.s4, m_pow(prime.s2, 2*c_end, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// done with power/product tables, store to global
+	g_prime[gid].s4 = prime.s4;
 	g_prime[gid].s6 = prime.s6;
+
 }
+#endif
 
 
-__kernel void primorial_setup(	__global ulong8 * g_prime,
+#if defined(COMBINED_KERNELS) && defined(COMPINV)
+// startN! = startN!/# * startN#, used when every prime is larger than startN.  startN!/# comes from a power table of
+// the prime powers in startN! less one.  With the primorial product table it is much smaller than the compositorial table.
+__kernel void combined_inv_setup(	__global ulong8 * g_prime,
 				__global uint * g_primecount,
-				__global ulong * g_smallprimeprod,
+			 	__global ulong * g_smallprimeprod,
 				const uint start,
-				const uint end) {
+				const uint end,
+				__global uint2 * g_smallpowers,
+			 	__global ulong2 * g_primorialprod,
+				const uint f_end,
+				const uint p_end) {
 
 	const uint gid = get_global_id(0);
 
 	if(gid >= g_primecount[0]) return;
 
-	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of start# mod P
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN!, .s7=startN in montgomery form
 	ulong8 prime = g_prime[gid];
 
 	if(!start){
+		// after r2 setup, .s4 is used for the compositorial residue, .s6 for the primorial residue, then startN!
 		prime.s2 = add(prime.s4, prime.s4, prime.s0);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);		// 4^{2^5} = 2^64
+		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);	// 4^{2^5} = 2^64
 		g_prime[gid].s2 = prime.s2;
+		g_prime[gid].s7 = m_mul(START_N, prime.s2, prime.s0, prime.s1);
+		prime.s6 = prime.s3;
+		prime.s4 = prime.s3;
 	}
 
-	for(uint i=start; i<end; ++i){
-		ulong p = g_smallprimeprod[i];
-		ulong montprimprod = m_mul(p, prime.s2, prime.s0, prime.s1);
-		if(i){
-			prime.s6 = m_mul(prime.s6, montprimprod, prime.s0, prime.s1);
-		}
-		else{
-			prime.s6 = montprimprod;
+	// bit-sliced compositorial power table, one squaring chain from the highest bit down
+	uint loop_end = (end > f_end) ? f_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		// .s0=bit, .s1=squarings before this term
+		const uint sq = g_smallpowers[k].s1;
+		for(uint j=0; j<sq; ++j){
+			prime.s4 = m_mul(prime.s4, prime.s4, prime.s0, prime.s1);
 		}
+		const ulong base = m_mul(g_smallprimeprod[k], prime.s2, prime.s0, prime.s1);
+		prime.s4 = m_mul(prime.s4, base, prime.s0, prime.s1);
 	}
 
-	// done with initial primorial, store to global
-	// residue is equal to start# mod P
+	// each 128 bit primorial product adds a factor of 2^-128
+	loop_end = (end > p_end) ? p_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s6 = m_mul128(prime.s6, g_primorialprod[k], prime.s0, prime.s1);
+	}
+	// end of the primorial table, multiply by 2^128 for each product
+	if(start < p_end && end >= p_end){
+		prime.s6 = m_mul(prime.s6, m_pow(prime.s2, 2*p_end, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// last kernel, startN! = startN!/# * startN#
+	if(end == max(f_end, p_end)){
+		prime.s6 = m_mul(prime.s6, prime.s4, prime.s0, prime.s1);
+	}
+
+	g_prime[gid].s4 = prime.s4;
 	g_prime[gid].s6 = prime.s6;
+
 }
+#endif
 
 
-__kernel void compositorial_setup(	__global ulong8 * g_prime,
-					__global uint * g_primecount,
-				 	__global ulong * g_smallcompprod,
-					const uint start,
-					const uint end,
-					const uint startN) {
+#ifdef COMBINED3_KERNELS
+__kernel void combined3_setup(	__global ulong8 * g_prime,
+				__global uint * g_primecount,
+			 	__global ulong2 * g_smallprimeprod,
+				const uint start,
+				const uint end,
+			 	__global ulong2 * g_smallcompprod,
+				const uint p_end,
+				const uint c_end) {
 
 	const uint gid = get_global_id(0);
 
 	if(gid >= g_primecount[0]) return;
 
-	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of start!/# mod P, .s7=startN in montgomery form
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN!, .s7=startN in montgomery form
 	ulong8 prime = g_prime[gid];
 
+	// p <= startN divides startN#, and 2p <= startN also divides startN! and startN!/#.  a 2-PRP that is a
+	// prime power doesn't divide startN#, its residues are found from the tables
+	const bool square = AT_MOST(prime.s0, START_N) && small_square(prime.s0);
+	const bool divides = AT_MOST(prime.s0, START_N) && !square;
+	const bool retired = AT_MOST(prime.s0, START_N/2) && !square;
+
+	// retired prime, all residues were set to zero by the first kernel
+	if(start && retired) return;
+
+	// first iteration of kernel
 	if(!start){
+		// setup r2 and montgomery form of startN
+		// after r2 setup, .s4 is the compositorial residue and .s5 is the primorial residue
 		prime.s2 = add(prime.s4, prime.s4, prime.s0);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
 		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);		// 4^{2^5} = 2^64
+		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);	// 4^{2^5} = 2^64
 		g_prime[gid].s2 = prime.s2;
-		g_prime[gid].s7 = m_mul(startN, prime.s2, prime.s0, prime.s1);
+		g_prime[gid].s7 = m_mul(START_N, prime.s2, prime.s0, prime.s1);
+		if(retired){
+			g_prime[gid].s4 = 0;
+			g_prime[gid].s5 = 0;
+			g_prime[gid].s6 = 0;
+			return;
+		}
+		prime.s5 = divides ? 0 : prime.s3;
+		prime.s4 = prime.s3;
+	}
+
+	// each 128 bit primorial product adds a factor of 2^-128
+	uint loop_end = (end > p_end) ? p_end : end;
+	if(divides) loop_end = 0;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s5 = m_mul128(prime.s5, g_smallprimeprod[k], prime.s0, prime.s1);
+	}
+	// end of the primorial table, multiply by 2^128 for each product
+	if(start < p_end && end >= p_end && !divides){
+		prime.s5 = m_mul(prime.s5, m_pow(prime.s2, 2*p_end, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// each 128 bit compositorial product adds a factor of 2^-128
+	loop_end = (end > c_end) ? c_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s4 = m_mul128(prime.s4, g_smallcompprod[k], prime.s0, prime.s1);
+	}
+	// end of the compositorial table, multiply by 2^128 for each product
+	if(start < c_end && end >= c_end){
+		prime.s4 = m_mul(prime.s4, m_pow(prime.s2, 2*c_end, prime.s0, prime.s1), prime.s0, prime.s1);
 	}
 
+	// last kernel, startN! = startN# * startN!/#
+	if(end == max(p_end, c_end)){
+		g_prime[gid].s6 = m_mul(prime.s4, prime.s5, prime.s0, prime.s1);
+	}
+
+	// done with product tables, store to global
+	g_prime[gid].s4 = prime.s4;
+	g_prime[gid].s5 = prime.s5;
+
+}
+#endif
+
+#endif
+
+
+/*
+	32 bit versions used when P < 2^32.  Residues are stored as uint with montgomery R = 2^32.
+*/
+
+#ifdef MONT32
+// montgomery form of a 64 bit table entry, r3 = 2^96 mod P
+uint mont64(ulong a, uint r2, uint r3, uint p, uint q){
+	return add32( m_mul32((uint)a, r2, p, q), m_mul32((uint)(a >> 32), r3, p, q), p );
+}
+
+// a * b / 2^128 mod p, one montgomery step per 32 bit word of b
+uint m_mul128_32(uint a, ulong2 b, uint p, uint q){
+	uint r = m_mul32(a, (uint)b.s0, p, q);
+	ulong t = (ulong)a * (uint)(b.s0 >> 32) + r;
+	uint m = (uint)t * q;
+	uint mp = mul_hi(m, p);
+	uint hi = (uint)(t >> 32);
+	r = ( hi < mp ) ? hi - mp + p : hi - mp;
+	t = (ulong)a * (uint)b.s1 + r;
+	m = (uint)t * q;
+	mp = mul_hi(m, p);
+	hi = (uint)(t >> 32);
+	r = ( hi < mp ) ? hi - mp + p : hi - mp;
+	t = (ulong)a * (uint)(b.s1 >> 32) + r;
+	m = (uint)t * q;
+	mp = mul_hi(m, p);
+	hi = (uint)(t >> 32);
+	return ( hi < mp ) ? hi - mp + p : hi - mp;
+}
+
+// a^e, a in montgomery form, e > 0
+uint m_pow32(uint a, uint e, uint p, uint q){
+	uint curBit = 0x80000000;
+	curBit >>= clz(e);
+	curBit >>= 1;
+	uint r = a;
+	while( curBit ){
+		r = m_mul32(r, r, p, q);
+		if(e & curBit){
+			r = m_mul32(r, a, p, q);
+		}
+		curBit >>= 1;
+	}
+	return r;
+}
+
+
+#ifdef FACTORIAL_KERNELS
+__kernel void factorial_setup32(__global uint4 * g_prime,
+				__global uint * g_primecount,
+			 	__global ulong * g_smallprimeprod,
+				const uint start,
+				const uint end,
+				__global uint2 * g_smallpowers) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of startN! mod P, .s3=startN in montgomery form
+	uint4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N)) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+	const uint r2 = setup_r2(add32(one, one, prime.s0), prime.s0, prime.s1);
+
+	if(!start){
+		// montgomery form of startN
+		g_prime[gid].s3 = m_mul32(START_N, r2, prime.s0, prime.s1);
+		// primes <= startN divide startN!, the residue is zero
+		if(AT_MOST(prime.s0, START_N)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+	const uint r3 = m_mul32(r2, r2, prime.s0, prime.s1);
+
+	// bit-sliced power table, one squaring chain from the highest bit down
 	for(uint i=start; i<end; ++i){
-		ulong p = g_smallcompprod[i];
-		ulong montcompprod = m_mul(p, prime.s2, prime.s0, prime.s1);
-		if(i){
-			prime.s6 = m_mul(prime.s6, montcompprod, prime.s0, prime.s1);
+		// .s0=bit, .s1=squarings before this term
+		const uint sq = g_smallpowers[i].s1;
+		for(uint k=0; k<sq; ++k){
+			prime.s2 = m_mul32(prime.s2, prime.s2, prime.s0, prime.s1);
+		}
+		const uint base = mont64(g_smallprimeprod[i], r2, r3, prime.s0, prime.s1);
+		prime.s2 = m_mul32(prime.s2, base, prime.s0, prime.s1);
+	}
+
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+// a^(p-2) = a^-1 mod p, p is prime
+uint m_inv32(uint a, uint p, uint q){
+	const uint e = p - 2;
+	uint curBit = 0x80000000;
+	curBit >>= ( clz(e) + 1 );
+	uint r = a;
+	while( curBit ){
+		r = m_mul32(r, r, p, q);
+		if(e & curBit){
+			r = m_mul32(r, a, p, q);
+		}
+		curBit >>= 1;
+	}
+	return r;
+}
+
+#ifdef FACTORIAL_KERNELS
+__kernel void factorial_reflect32(	__global uint4 * g_prime,
+					__global uint * g_primecount,
+					const uint last,
+					const uint start,
+					const uint end) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of startN! mod P, .s3=startN in montgomery form
+	uint4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N)) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+	const uint r2 = setup_r2(add32(one, one, prime.s0), prime.s0, prime.s1);
+
+	if(!start){
+		// montgomery form of startN
+		g_prime[gid].s3 = m_mul32(START_N, r2, prime.s0, prime.s1);
+		// primes <= startN divide startN!, the residue is zero
+		if(AT_MOST(prime.s0, START_N)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	const uint m = prime.s0 - 1 - START_N;
+	const uint kend = (m < end) ? m : end;
+	if(start < kend){
+		// k in montgomery form
+		uint mk = m_mul32(start+1, r2, prime.s0, prime.s1);
+		for(uint k=start+1; k<=kend; ++k){
+			prime.s2 = m_mul32(prime.s2, mk, prime.s0, prime.s1);
+			mk = add32(mk, one, prime.s0);
+		}
+	}
+
+	if(end == last){
+		// Wilson's theorem needs a prime.  the host keeps p below 2*startN, where a composite p divides
+		// startN! and the power table gives zero
+		if(!is_prime32(prime.s0, prime.s1, one, r2)){
+			prime.s2 = 0;
 		}
 		else{
-			prime.s6 = montcompprod;
+			prime.s2 = m_inv32(prime.s2, prime.s0, prime.s1);
+			// p is odd, p-startN is odd when startN is even
+			if(!(START_N & 1)){
+				prime.s2 = prime.s0 - prime.s2;
+			}
 		}
 	}
 
-	// done with initial primorial, store to global
-	// residue is equal to start!/# mod P
-	g_prime[gid].s6 = prime.s6;
+	g_prime[gid].s2 = prime.s2;
 }
+#endif
 
 
-__kernel void combined_setup(	__global ulong8 * g_prime,
+#ifdef PRIMORIAL_KERNELS
+__kernel void primorial_setup32(__global uint4 * g_prime,
+				__global uint * g_primecount,
+				__global ulong2 * g_smallprimeprod,
+				const uint start,
+				const uint end,
+				const uint count) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of start# mod P, .s3=r2
+	uint4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N)) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+
+	if(!start){
+		// r2 is kept in .s3 for the iterate kernel
+		prime.s3 = setup_r2(add32(one, one, prime.s0), prime.s0, prime.s1);
+		g_prime[gid].s3 = prime.s3;
+		// primes <= startN divide startN#, the residue is zero
+		if(AT_MOST(prime.s0, START_N)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	// each 128 bit product adds a factor of 2^-128
+	for(uint i=start; i<end; ++i){
+		prime.s2 = m_mul128_32(prime.s2, g_smallprimeprod[i], prime.s0, prime.s1);
+	}
+
+	// last kernel, multiply by 2^128 for each product
+	if(end == count){
+		prime.s2 = m_mul32(prime.s2, m_pow32(prime.s3, 4*count, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+#ifdef COMPOSITORIAL_KERNELS
+__kernel void compositorial_setup32(	__global uint4 * g_prime,
+					__global uint * g_primecount,
+				 	__global ulong2 * g_smallcompprod,
+					const uint start,
+					const uint end,
+				const uint count) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=residue of start!/# mod P, .s3=startN in montgomery form
+	uint4 prime = g_prime[gid];
+
+	// retired prime, the residue was set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N/2)) return;
+
+	// montgomery constants are rebuilt from p
+	const uint one = (-prime.s0) % prime.s0;
+	const uint r2 = setup_r2(add32(one, one, prime.s0), prime.s0, prime.s1);
+
+	if(!start){
+		// montgomery form of startN
+		g_prime[gid].s3 = m_mul32(START_N, r2, prime.s0, prime.s1);
+		// 2p <= startN divides startN!/#, the residue is zero
+		if(AT_MOST(prime.s0, START_N/2)){
+			g_prime[gid].s2 = 0;
+			return;
+		}
+		prime.s2 = one;
+	}
+
+	// each 128 bit product adds a factor of 2^-128
+	for(uint i=start; i<end; ++i){
+		prime.s2 = m_mul128_32(prime.s2, g_smallcompprod[i], prime.s0, prime.s1);
+	}
+
+	// last kernel, multiply by 2^128 for each product
+	if(end == count){
+		prime.s2 = m_mul32(prime.s2, m_pow32(r2, 4*count, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	g_prime[gid].s2 = prime.s2;
+}
+#endif
+
+
+#if defined(COMBINED_KERNELS) && !defined(COMPINV)
+__kernel void combined_setup32(	__global uint8 * g_prime,
 				__global uint * g_primecount,
 			 	__global ulong * g_smallprimeprod,
 				const uint start,
 				const uint end,
 				__global uint2 * g_smallpowers,
-				const uint startN,
-			 	__global ulong * g_smallcompprod,
+			 	__global ulong2 * g_smallcompprod,
 				const uint f_end,
 				const uint c_end) {
 
@@ -215,80 +787,193 @@ __kernel void combined_setup(	__global ulong8 * g_prime,
 	if(gid >= g_primecount[0]) return;
 
 	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN!, .s7=startN in montgomery form
-	ulong8 prime = g_prime[gid];
-	uint i = start;
+	uint8 prime = g_prime[gid];
+
+	// retired prime, both residues were set to zero by the first kernel
+	if(start && AT_MOST(prime.s0, START_N/2)) return;
 
-	// first iteration of kernel
 	if(!start){
-		++i;
-		// setup r2 and montgomery form of startN
 		// after r2 setup, .s4 is now used for compositorial residue
-		prime.s2 = add(prime.s4, prime.s4, prime.s0);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);
-		prime.s2 = m_mul(prime.s2, prime.s2, prime.s0, prime.s1);	// 4^{2^5} = 2^64
+		prime.s2 = setup_r2(prime.s4, prime.s0, prime.s1);
 		g_prime[gid].s2 = prime.s2;
-		g_prime[gid].s7 = m_mul(startN, prime.s2, prime.s0, prime.s1);
-		// first iteration of factorial power table, base prime = 2
-		// .s0=exp, .s1=curBit
-		uint2 power = g_smallpowers[0];
-		// left to right powmod
-		ulong a = prime.s4;
-		while( power.s1 ){
-			a = m_mul(a, a, prime.s0, prime.s1);
-			if(power.s0 & power.s1){
-				a = add(a, a, prime.s0);		// base 2 we can add
-			}
-			power.s1 >>= 1;
+		g_prime[gid].s7 = m_mul32(START_N, prime.s2, prime.s0, prime.s1);
+		// 2p <= startN divides startN! and startN!/#, both residues are zero
+		if(AT_MOST(prime.s0, START_N/2)){
+			g_prime[gid].s4 = 0;
+			g_prime[gid].s6 = 0;
+			return;
 		}
-		prime.s6 = a;
-		// first iteration of compositorial product table
-		ulong prod = g_smallcompprod[0];
-		prime.s4 = m_mul(prod, prime.s2, prime.s0, prime.s1);
+		// primes <= startN divide startN!
+		prime.s6 = AT_MOST(prime.s0, START_N) ? 0 : prime.s3;
+		prime.s4 = prime.s3;
 	}
+	const uint r3 = m_mul32(prime.s2, prime.s2, prime.s0, prime.s1);
 
-	// remaining iterations of factorial power table, starting at prime = 3
+	// bit-sliced factorial power table, one squaring chain from the highest bit down
 	uint loop_end = (end > f_end) ? f_end : end;
-	for(uint k=i; k<loop_end; ++k){
-		ulong sm_prime = g_smallprimeprod[k];
-		// .s0=exp, .s1=curBit
-		uint2 power = g_smallpowers[k];
-		const ulong base = m_mul(sm_prime, prime.s2, prime.s0, prime.s1);
-		ulong primepow;
-		if(power.s0 == 1){
-			primepow = base;
-		}
-		else{
-			ulong a = base;
-			while( power.s1 ){
-				a = m_mul(a, a, prime.s0, prime.s1);
-				if(power.s0 & power.s1){
-					a = m_mul(a, base, prime.s0, prime.s1);
-				}
-				power.s1 >>= 1;
-			}
-			primepow = a;
+	if(AT_MOST(prime.s0, START_N)) loop_end = 0;
+	for(uint k=start; k<loop_end; ++k){
+		// .s0=bit, .s1=squarings before this term
+		const uint sq = g_smallpowers[k].s1;
+		for(uint j=0; j<sq; ++j){
+			prime.s6 = m_mul32(prime.s6, prime.s6, prime.s0, prime.s1);
 		}
-		prime.s6 = m_mul(prime.s6, primepow, prime.s0, prime.s1);
+		const uint base = mont64(g_smallprimeprod[k], prime.s2, r3, prime.s0, prime.s1);
+		prime.s6 = m_mul32(prime.s6, base, prime.s0, prime.s1);
 	}
 
+	// each 128 bit compositorial product adds a factor of 2^-128
 	loop_end = (end > c_end) ? c_end : end;
-	for(uint k=i; k<loop_end; ++k){
-		ulong prod = g_smallcompprod[k];
-		ulong montcompprod = m_mul(prod, prime.s2, prime.s0, prime.s1);
-		prime.s4 = m_mul(prime.s4, montcompprod, prime.s0, prime.s1);
+	for(uint k=start; k<loop_end; ++k){
+		prime.s4 = m_mul128_32(prime.s4, g_smallcompprod[k], prime.s0, prime.s1);
+	}
+	// end of the compositorial table, multiply by 2^128 for each product
+	if(start < c_end && end >= c_end){
+		prime.s4 = m_mul32(prime.s4, m_pow32(prime.s2, 4*c_end, prime.s0, prime.s1), prime.s0, prime.s1);
 	}
 
-	// done with power/product tables, store to global
 	g_prime[gid].s4 = prime.s4;
 	g_prime[gid].s6 = prime.s6;
 
 }
+#endif
 
 
+#if defined(COMBINED_KERNELS) && defined(COMPINV)
+// startN! = startN!/# * startN#, used when every prime is larger than startN.  startN!/# comes from a power table of
+// the prime powers in startN! less one.  With the primorial product table it is much smaller than the compositorial table.
+__kernel void combined_inv_setup32(	__global uint8 * g_prime,
+				__global uint * g_primecount,
+			 	__global ulong * g_smallprimeprod,
+				const uint start,
+				const uint end,
+				__global uint2 * g_smallpowers,
+			 	__global ulong2 * g_primorialprod,
+				const uint f_end,
+				const uint p_end) {
 
+	const uint gid = get_global_id(0);
 
+	if(gid >= g_primecount[0]) return;
 
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN!, .s7=startN in montgomery form
+	uint8 prime = g_prime[gid];
 
+	if(!start){
+		// after r2 setup, .s4 is used for the compositorial residue, .s6 for the primorial residue, then startN!
+		prime.s2 = setup_r2(prime.s4, prime.s0, prime.s1);
+		g_prime[gid].s2 = prime.s2;
+		g_prime[gid].s7 = m_mul32(START_N, prime.s2, prime.s0, prime.s1);
+		prime.s6 = prime.s3;
+		prime.s4 = prime.s3;
+	}
+	const uint r3 = m_mul32(prime.s2, prime.s2, prime.s0, prime.s1);
+
+	// bit-sliced compositorial power table, one squaring chain from the highest bit down
+	uint loop_end = (end > f_end) ? f_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		// .s0=bit, .s1=squarings before this term
+		const uint sq = g_smallpowers[k].s1;
+		for(uint j=0; j<sq; ++j){
+			prime.s4 = m_mul32(prime.s4, prime.s4, prime.s0, prime.s1);
+		}
+		const uint base = mont64(g_smallprimeprod[k], prime.s2, r3, prime.s0, prime.s1);
+		prime.s4 = m_mul32(prime.s4, base, prime.s0, prime.s1);
+	}
+
+	// each 128 bit primorial product adds a factor of 2^-128
+	loop_end = (end > p_end) ? p_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s6 = m_mul128_32(prime.s6, g_primorialprod[k], prime.s0, prime.s1);
+	}
+	// end of the primorial table, multiply by 2^128 for each product
+	if(start < p_end && end >= p_end){
+		prime.s6 = m_mul32(prime.s6, m_pow32(prime.s2, 4*p_end, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// last kernel, startN! = startN!/# * startN#
+	if(end == max(f_end, p_end)){
+		prime.s6 = m_mul32(prime.s6, prime.s4, prime.s0, prime.s1);
+	}
+
+	g_prime[gid].s4 = prime.s4;
+	g_prime[gid].s6 = prime.s6;
+
+}
+#endif
+
+
+#ifdef COMBINED3_KERNELS
+__kernel void combined3_setup32(	__global uint8 * g_prime,
+				__global uint * g_primecount,
+			 	__global ulong2 * g_smallprimeprod,
+				const uint start,
+				const uint end,
+			 	__global ulong2 * g_smallcompprod,
+				const uint p_end,
+				const uint c_end) {
+
+	const uint gid = get_global_id(0);
+
+	if(gid >= g_primecount[0]) return;
+
+	// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo, .s6=residue of startN!, .s7=startN in montgomery form
+	uint8 prime = g_prime[gid];
+
+	// p <= startN divides startN#, and 2p <= startN also divides startN! and startN!/#.  a 2-PRP that is a
+	// prime power doesn't divide startN#, its residues are found from the tables
+	const bool square = AT_MOST(prime.s0, START_N) && small_square(prime.s0);
+	const bool divides = AT_MOST(prime.s0, START_N) && !square;
+	const bool retired = AT_MOST(prime.s0, START_N/2) && !square;
+
+	// retired prime, all residues were set to zero by the first kernel
+	if(start && retired) return;
+
+	if(!start){
+		// after r2 setup, .s4 is the compositorial residue and .s5 is the primorial residue
+		prime.s2 = setup_r2(prime.s4, prime.s0, prime.s1);
+		g_prime[gid].s2 = prime.s2;
+		g_prime[gid].s7 = m_mul32(START_N, prime.s2, prime.s0, prime.s1);
+		if(retired){
+			g_prime[gid].s4 = 0;
+			g_prime[gid].s5 = 0;
+			g_prime[gid].s6 = 0;
+			return;
+		}
+		prime.s5 = divides ? 0 : prime.s3;
+		prime.s4 = prime.s3;
+	}
+
+	// each 128 bit primorial product adds a factor of 2^-128
+	uint loop_end = (end > p_end) ? p_end : end;
+	if(divides) loop_end = 0;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s5 = m_mul128_32(prime.s5, g_smallprimeprod[k], prime.s0, prime.s1);
+	}
+	// end of the primorial table, multiply by 2^128 for each product
+	if(start < p_end && end >= p_end && !divides){
+		prime.s5 = m_mul32(prime.s5, m_pow32(prime.s2, 4*p_end, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// each 128 bit compositorial product adds a factor of 2^-128
+	loop_end = (end > c_end) ? c_end : end;
+	for(uint k=start; k<loop_end; ++k){
+		prime.s4 = m_mul128_32(prime.s4, g_smallcompprod[k], prime.s0, prime.s1);
+	}
+	// end of the compositorial table, multiply by 2^128 for each product
+	if(start < c_end && end >= c_end){
+		prime.s4 = m_mul32(prime.s4, m_pow32(prime.s2, 4*c_end, prime.s0, prime.s1), prime.s0, prime.s1);
+	}
+
+	// last kernel, startN! = startN# * startN!/#
+	if(end == max(p_end, c_end)){
+		g_prime[gid].s6 = m_mul32(prime.s4, prime.s5, prime.s0, prime.s1);
+	}
+
+	g_prime[gid].s4 = prime.s4;
+	g_prime[gid].s5 = prime.s5;
+
+}
+#endif
+
+#endif
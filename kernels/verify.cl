@@ -6,45 +6,7 @@
 
 */
 
-// r0 + 2^64 * r1 = a * b
-ulong2 mul_wide(const ulong a, const ulong b){
-	ulong2 r;
-#ifdef __NV_CL_C_VERSION
-	const uint a0 = (uint)(a), a1 = (uint)(a >> 32);
-	const uint b0 = (uint)(b), b1 = (uint)(b >> 32);
-	uint c0 = a0 * b0, c1 = mul_hi(a0, b0), c2, c3;
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a0), "r" (b1), "r" (c1));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c2) : "r" (a0), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b1), "r" (c2));
-	asm volatile ("madc.hi.u32 %0, %1, %2, 0;" : "=r" (c3) : "r" (a1), "r" (b1));
-	asm volatile ("mad.lo.cc.u32 %0, %1, %2, %3;" : "=r" (c1) : "r" (a1), "r" (b0), "r" (c1));
-	asm volatile ("madc.hi.cc.u32 %0, %1, %2, %3;" : "=r" (c2) : "r" (a1), "r" (b0), "r" (c2));
-	asm volatile ("addc.u32 %0, %1, 0;" : "=r" (c3) : "r" (c3));
-	r.s0 = upsample(c1, c0); r.s1 = upsample(c3, c2);
-#else
-	r.s0 = a * b; r.s1 = mul_hi(a, b);
-#endif
-	return r;
-}
-
-ulong m_mul(ulong a, ulong b, ulong p, ulong q){
-	ulong2 ab = mul_wide(a,b);
-	ulong m = ab.s0 * q;
-	ulong mp = mul_hi(m,p);
-	ulong r = ab.s1 - mp;
-	return ( ab.s1 < mp ) ? r + p : r;
-}
-
-ulong add(ulong a, ulong b, ulong p){
-	ulong r;
-	ulong c = (a >= p - b) ? p : 0;
-	r = a + b - c;
-	return r;
-}
-
-// .s0=p, .s1=q, .s2=r2, .s3=one, .s4=two, .s5=nmo
-__constant ulong8 prime = (ulong8)(18446744073709551557UL, 3751880150584993549UL, 3481, 59, 118, 18446744073709551498UL, 0, 0);
-
+#if defined(SEARCH_FACTORIAL) && !defined(SEARCH_PRIMORIAL)
 __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_verify(	__global ulong * g_smallprimes,
 											__global uint2 * g_smallpowers,
 											__global ulong4 * g_verify,
@@ -55,45 +17,40 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_verify
 	const uint gs = get_global_size(0);
 	__local ulong total[256];
 	bool first_iter = true;
-	ulong thread_total = prime.s3;
+	bool table_error = false;
+	ulong thread_total = vprime.s3;
 
 	for(uint position = gid; position < smallcount; position+=gs){
-		ulong sm_prime = g_smallprimes[position];
-		// .s0=exp, .s1=curBit
-		uint2 p = g_smallpowers[position];
-		const ulong base = m_mul(sm_prime, prime.s2, prime.s0, prime.s1);
-		ulong primepow;
-		if(p.s0 == 1){
-			primepow = base;
+		// .s0=bit, .s1=squarings before this term
+		// terms are independent here, the term is raised to 2^bit
+		const uint2 power = g_smallpowers[position];
+		const uint bit = power.s0;
+		// squarings must match the bit change from the previous term
+		const uint prevbit = position ? g_smallpowers[position-1].s0 : bit;
+		if(power.s1 != prevbit - bit){
+			table_error = true;
 		}
-		else{
-			// left to right powmod
-			ulong a = base;
-			while( p.s1 ){
-				a = m_mul(a, a, prime.s0, prime.s1);
-				if(p.s0 & p.s1){
-					a = m_mul(a, base, prime.s0, prime.s1);
-				}
-				p.s1 >>= 1;
-			}
-			primepow = a;
+		ulong primepow = m_mul(g_smallprimes[position], vprime.s2, vprime.s0, vprime.s1);
+		for(uint k=0; k<bit; ++k){
+			primepow = m_mul(primepow, primepow, vprime.s0, vprime.s1);
 		}
 		if(first_iter){
 			first_iter = false;
 			thread_total = primepow;
 		}
 		else{
-			thread_total = m_mul(thread_total, primepow, prime.s0, prime.s1);
+			thread_total = m_mul(thread_total, primepow, vprime.s0, vprime.s1);
 		}
 	}
 
-	total[lid] = thread_total;
+	// a bad squaring count zeroes the product
+	total[lid] = table_error ? 0 : thread_total;
 
 	barrier(CLK_LOCAL_MEM_FENCE);
 
 	for(uint s = 128; s > 0; s >>= 1){
 		if(lid < s){
-			total[lid] = m_mul(total[lid], total[lid+s], prime.s0, prime.s1);
+			total[lid] = m_mul(total[lid], total[lid+s], vprime.s0, vprime.s1);
 		}
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
@@ -104,10 +61,12 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void factorial_verify
 
 
 }
+#endif
 
 
+#if defined(SEARCH_PRIMORIAL) || defined(COMPINV)
 __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_verify(	__global ulong4 * g_verify,
-											__global ulong * g_products,
+											__global ulong2 * g_products,
 											__global uint * g_primes,
 											const uint prodsize,
 											const uint primesize ){
@@ -115,23 +74,26 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_verify
 	const uint lid = get_local_id(0);
 	const uint gs = get_global_size(0);
 	__local ulong total[256];
-	ulong thread_total = prime.s3;
+	ulong thread_total = vprime.s3;
 	bool first_iter = true;
 
+	// 2^192 mod P converts a 128 bit product to montgomery form
+	const ulong r3 = m_mul( vprime.s2, vprime.s2, vprime.s0, vprime.s1);
+
 	for(uint i=gid; i<prodsize; i+=gs){
-		ulong n = m_mul( g_products[i], prime.s2, prime.s0, prime.s1);
+		ulong n = m_mul128( r3, g_products[i], vprime.s0, vprime.s1);
 		if(first_iter){
 			first_iter = false;
 			thread_total = n;
 		}
 		else{
-			thread_total = m_mul( thread_total, n, prime.s0, prime.s1);
+			thread_total = m_mul( thread_total, n, vprime.s0, vprime.s1);
 		}
 	}
 
 	for(uint i=gid; i<primesize; i+=gs){
-		ulong n = m_mul( g_primes[i], prime.s2, prime.s0, prime.s1);
-		thread_total = m_mul( thread_total, n, prime.s0, prime.s1);
+		ulong n = m_mul( g_primes[i], vprime.s2, vprime.s0, vprime.s1);
+		thread_total = m_mul( thread_total, n, vprime.s0, vprime.s1);
 	}
 
 	total[lid] = thread_total;
@@ -140,7 +102,7 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_verify
 
 	for(uint s = 128; s > 0; s >>= 1){
 		if(lid < s){
-			total[lid] = m_mul( total[lid], total[lid+s], prime.s0, prime.s1);
+			total[lid] = m_mul( total[lid], total[lid+s], vprime.s0, vprime.s1);
 		}
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
@@ -150,10 +112,12 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void primorial_verify
 	}
 
 }
+#endif
 
 
+#if defined(SEARCH_COMPOSITORIAL) && !defined(COMPINV)
 __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void compositorial_verify(	__global ulong4 * g_verify,
-											__global ulong * g_products,
+											__global ulong2 * g_products,
 											__global uint * g_primes,
 											const uint prodsize,
 											const uint primesize,
@@ -163,17 +127,20 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void compositorial_ve
 	const uint lid = get_local_id(0);
 	const uint gs = get_global_size(0);
 	__local ulong total[256];
-	ulong thread_total = prime.s3;
+	ulong thread_total = vprime.s3;
 	bool first_iter = true;
 
+	// 2^192 mod P converts a 128 bit product to montgomery form
+	const ulong r3 = m_mul( vprime.s2, vprime.s2, vprime.s0, vprime.s1);
+
 	for(uint i=gid; i<prodsize; i+=gs){
-		ulong n = m_mul( g_products[i], prime.s2, prime.s0, prime.s1);
+		ulong n = m_mul128( r3, g_products[i], vprime.s0, vprime.s1);
 		if(first_iter){
 			first_iter = false;
 			thread_total = n;
 		}
 		else{
-			thread_total = m_mul( thread_total, n, prime.s0, prime.s1);
+			thread_total = m_mul( thread_total, n, vprime.s0, vprime.s1);
 		}
 	}
 
@@ -181,8 +148,8 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void compositorial_ve
 	for(uint i=gid+nmin; i<nmax; i+=gs){
 		for(; k<primesize && g_primes[k] < i; ++k);
 		if(g_primes[k] == i) continue;
-		ulong n = m_mul( i, prime.s2, prime.s0, prime.s1);
-		thread_total = m_mul( thread_total, n, prime.s0, prime.s1);
+		ulong n = m_mul( i, vprime.s2, vprime.s0, vprime.s1);
+		thread_total = m_mul( thread_total, n, vprime.s0, vprime.s1);
 	}
 
 	total[lid] = thread_total;
@@ -191,7 +158,7 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void compositorial_ve
 
 	for(uint s = 128; s > 0; s >>= 1){
 		if(lid < s){
-			total[lid] = m_mul( total[lid], total[lid+s], prime.s0, prime.s1);
+			total[lid] = m_mul( total[lid], total[lid+s], vprime.s0, vprime.s1);
 		}
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
@@ -201,5 +168,6 @@ __kernel __attribute__ ((reqd_work_group_size(256, 1, 1))) void compositorial_ve
 	}
 
 }
+#endif
 
 
@@ -9,7 +9,7 @@
 
 	Search limits:  P up to 2^64 and N up to 2^31
 
-	Using OpenMP for multithreaded factor verification.
+	Using OpenMP for multithreaded factor verification and the CPU backend.
 
 */
 
@@ -23,6 +23,9 @@
 #include "primesieve.h"
 #include "putil.h"
 #include "cl_sieve.h"
+#include "cpu_sieve.h"
+#include "tunedb.h"
+#include "survivors.h"
 
 void help()
 {
@@ -32,6 +35,7 @@ void help()
 	printf("-#	Use primorial mode\n");
 	printf("-c	Use compositorial mode\n");
 	printf("		Note: -! -c can be used together to find factors of both at the same time.\n");
+	printf("		Note: -! -# -c can be used together to find factors of all three at the same time.\n");
 	printf("-n #	Start primorial n#+-1, factorial n!+-1, or compositorial n!/#+-1\n");
 	printf("-N #	End primorial N#+-1, factorial N!+-1, or compositorial N!/#+-1\n");
 	printf("		N range is 101 <= -n < -N < 2^31, [-n, -N) exclusive\n");
@@ -41,12 +45,33 @@ void help()
 	printf("		Note for primorial and factorial there are no factors when p <= n\n");
 	printf("		Note N!+-1, N#+-1, and N!/#+-1 are not divisible by 2.\n");
 	printf("-v #	Optional, specify the number of CPU threads used to verify factors.  Default is 2, max is 128.\n");
+	printf("		With --backend=cpu this is also the number of threads used to sieve.\n");
+	printf("--backend=cpu	Optional, sieve on the CPU with OpenMP instead of an OpenCL GPU.  Results are identical.\n");
+	printf("--presieve=#	Optional, sieve primes up to # before the GPU prime generator's PRP test.  113 <= # <= 65536.\n");
+	printf("		Default is a timing sweep at startup that picks the fastest bound for the GPU.\n");
+	printf("--alldevices	Optional, search with every GPU of the OpenCL platform in one process.  P is shared between them.\n");
+	printf("--cputhreads=#	Optional, also sieve part of P on # CPU threads next to the GPU.  1 <= # <= 128.\n");
+	printf("		The CPU's share follows its measured speed so that the CPU and GPU finish together.\n");
+	printf("--batch=file	Optional, search several workunits of the same P range on one GPU.  Each line of the file is\n");
+	printf("		a job \"n N mode\", mode is !, #, c, !c or !#c.  The primes of each segment are generated once.\n");
+	printf("		Job j writes factors_j.txt and checkpoints to stateA_j.ckp and stateB_j.ckp.\n");
+	printf("--survivors=file	Optional, only report factors of candidates that are left.  The file is a factors.txt of an\n");
+	printf("		earlier search, or a sieve file with one candidate like 1234!+1 per line.  Only the smallest factor\n");
+	printf("		of each candidate is reported.\n");
+	printf("--retune	Optional, profile the GPU again and replace its kernel sizes in pfcsieve_tune.txt.\n");
 	printf("-s 	Perform self test to verify proper operation of the program with the current GPU.\n");
 	printf("-h	Print this help\n");
         boinc_finish(EXIT_FAILURE);
 }
 
 
+// jobs of --batch
+#define MAX_JOBS 64
+static const char * batch_file = NULL;
+
+// candidates of --survivors
+static const char * survivor_file = NULL;
+
 static const char *short_opts = "p:P:n:N:v:s!#cfh";
 
 static int parse_option(int opt, char *arg, const char *source, workStatus & st, searchData & sd)
@@ -99,6 +124,52 @@ static int parse_option(int opt, char *arg, const char *source, workStatus & st,
       printf("\n-c argument specified for compositorial mode.\n\n");
       break;
 
+    case 'b':
+      if(strcmp(arg,"cpu") == 0){
+        sd.cpu = true;
+        fprintf(stderr,"--backend=cpu argument specified, sieving on CPU.\n");
+        printf("\n--backend=cpu argument specified, sieving on CPU.\n\n");
+      }
+      else if(strcmp(arg,"gpu") == 0){
+        sd.cpu = false;
+      }
+      else{
+        status = -1;
+      }
+      break;
+
+    case 'e':
+      status = parse_uint(&sd.presieve,arg,113,65536);
+      break;
+
+    case 'a':
+      sd.alldevices = true;
+      fprintf(stderr,"--alldevices argument specified, searching with every GPU.\n");
+      printf("\n--alldevices argument specified, searching with every GPU.\n\n");
+      break;
+
+    case 'u':
+      status = parse_uint(&sd.cputhreads,arg,1,128);
+      break;
+
+    case 'B':
+      batch_file = arg;
+      fprintf(stderr,"--batch argument specified, searching the jobs in %s.\n", arg);
+      printf("\n--batch argument specified, searching the jobs in %s.\n\n", arg);
+      break;
+
+    case 'S':
+      survivor_file = arg;
+      fprintf(stderr,"--survivors argument specified, reporting factors of the candidates left in %s.\n", arg);
+      printf("\n--survivors argument specified, reporting factors of the candidates left in %s.\n\n", arg);
+      break;
+
+    case 'r':
+      sd.retune = true;
+      fprintf(stderr,"--retune argument specified, profiling kernel sizes.\n");
+      printf("\n--retune argument specified, profiling kernel sizes.\n\n");
+      break;
+
     case 'h':
       help();
       break;
@@ -114,6 +185,13 @@ static int parse_option(int opt, char *arg, const char *source, workStatus & st,
 static const struct option long_opts[] = {
   {"device",  optional_argument, 0, 'd'},		// handle --device arg, but it's not used
   {"test",  no_argument, 0, 's'},
+  {"backend",  required_argument, 0, 'b'},
+  {"presieve",  required_argument, 0, 'e'},
+  {"retune",  no_argument, 0, 'r'},
+  {"alldevices",  no_argument, 0, 'a'},
+  {"cputhreads",  required_argument, 0, 'u'},
+  {"batch",  required_argument, 0, 'B'},
+  {"survivors",  required_argument, 0, 'S'},
   {0,0,0,0}
 };
 
@@ -208,126 +286,42 @@ double getSysOpType()
 #endif
 
 
-int main(int argc, char *argv[])
-{ 
-	sclHard hardware = {};
-	searchData sd = {};
-	sd.numresults = 1000000;
-	sd.write_state_a_next = true;
-	sd.threadcount = 2;
-	workStatus st = {};
-
-        // Initialize BOINC
-        BOINC_OPTIONS options;
-        boinc_options_defaults(options);
-        options.normal_thread_priority = true;
-        boinc_init_options(&options);
-
-	fprintf(stderr, "\nPFCSieve v%s.%s by Bryan Little\nwith contributions by Yves Gallot, Mark Rodenkirch, and Kim Walisch\n",VERSION_MAJOR,VERSION_MINOR);
-	fprintf(stderr, "Compiled " __DATE__ " with GCC " __VERSION__ "\n");
-	if(boinc_is_standalone()){
-		printf("\nPFCSieve v%s.%s by Bryan Little\nwith contributions by Yves Gallot, Mark Rodenkirch, and Kim Walisch\n",VERSION_MAJOR,VERSION_MINOR);
-		printf("Compiled " __DATE__ " with GCC " __VERSION__ "\n");
-	}
-
-        // Print out cmd line for diagnostics
-        fprintf(stderr, "Command line: ");
-        for (int i = 0; i < argc; i++)
-        	fprintf(stderr, "%s ", argv[i]);
-        fprintf(stderr, "\n");
-
-	process_args(argc,argv,st,sd);
-
-	omp_set_num_threads(sd.threadcount);
+// print the device and normalize its compute units
+void gpuInfo( gpuDevice & gpu ){
 
-	primesieve_set_num_threads(1);
-
-	cl_platform_id platform = 0;
-	cl_device_id device = 0;
-	cl_context ctx;
-	cl_command_queue queue;
 	cl_int err = 0;
-
-	int retval = 0;
-	retval = boinc_get_opencl_ids(argc, argv, 0, &device, &platform);
-	if (retval) {
-		if(boinc_is_standalone()){
-			printf("init_data.xml not found, using device 0.\n");
-
-			err = clGetPlatformIDs(1, &platform, NULL);
-			if (err != CL_SUCCESS) {
-				printf( "clGetPlatformIDs() failed with %d\n", err );
-				fprintf(stderr, "Error: clGetPlatformIDs() failed with %d\n", err );
-				exit(EXIT_FAILURE);
-			}
-			err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-			if (err != CL_SUCCESS) {
-				printf( "clGetDeviceIDs() failed with %d\n", err );
-				fprintf(stderr, "Error: clGetDeviceIDs() failed with %d\n", err );
-				exit(EXIT_FAILURE);
-			}
-		}
-		else{
-			fprintf(stderr, "Error: boinc_get_opencl_ids() failed with error %d\n", retval );
-			exit(EXIT_FAILURE);
-		}
-	}
-
-	cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
-
-	ctx = clCreateContext(cps, 1, &device, NULL, NULL, &err);
-	if (err != CL_SUCCESS) {
-		fprintf(stderr, "Error: clCreateContext() returned %d\n", err);
-        	exit(EXIT_FAILURE); 
-   	}
-
-	// OpenCL v2.0
-	//cl_queue_properties qp[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
-	//queue = clCreateCommandQueueWithProperties(ctx, device, qp, &err);
-
-	queue = clCreateCommandQueue(ctx, device, CL_QUEUE_PROFILING_ENABLE, &err);	
-	if(err != CL_SUCCESS) { 
-		fprintf(stderr, "Error: Creating Command Queue. (clCreateCommandQueueWithProperties) returned %d\n", err );
-		exit(EXIT_FAILURE);
-    	}
-
-	hardware.platform = platform;
-	hardware.device = device;
-	hardware.queue = queue;
-	hardware.context = ctx;
-
- 	char device_name[1024];
- 	char device_vend[1024];
- 	char device_driver[1024];
+	char device_name[1024];
+	char device_vend[1024];
+	char device_driver[1024];
 	cl_uint CUs;
 	cl_ulong maxMemAllocSize;
 
-	err = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), &device_name, NULL);
+	err = clGetDeviceInfo(gpu.hardware.device, CL_DEVICE_NAME, sizeof(device_name), &device_name, NULL);
 	if (err != CL_SUCCESS) {
 		printf( "clGetDeviceInfo failed with %d\n", err );
 		exit(EXIT_FAILURE);
 	}
-	err = clGetDeviceInfo(device, CL_DEVICE_VENDOR, sizeof(device_vend), &device_vend, NULL);
+	err = clGetDeviceInfo(gpu.hardware.device, CL_DEVICE_VENDOR, sizeof(device_vend), &device_vend, NULL);
 	if (err != CL_SUCCESS) {
 		printf( "clGetDeviceInfo failed with %d\n", err );
 		exit(EXIT_FAILURE);
 	}
-	err = clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(device_driver), &device_driver, NULL);
+	err = clGetDeviceInfo(gpu.hardware.device, CL_DRIVER_VERSION, sizeof(device_driver), &device_driver, NULL);
 	if (err != CL_SUCCESS) {
 		printf( "clGetDeviceInfo failed with %d\n", err );
 		exit(EXIT_FAILURE);
 	}
-	err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &CUs, NULL);
+	err = clGetDeviceInfo(gpu.hardware.device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &CUs, NULL);
 	if (err != CL_SUCCESS) {
 		printf( "clGetDeviceInfo failed with %d\n", err );
 		exit(EXIT_FAILURE);
 	}
-	err = clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxMemAllocSize, NULL);
+	err = clGetDeviceInfo(gpu.hardware.device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxMemAllocSize, NULL);
 	if (err != CL_SUCCESS) {
 		printf( "clGetDeviceInfo failed with %d\n", err );
 		exit(EXIT_FAILURE);
 	}
-	sd.maxmalloc = (uint64_t)maxMemAllocSize;
+	gpu.maxmalloc = (uint64_t)maxMemAllocSize;
 
 	fprintf(stderr, "GPU Info:\n  Name: \t\t%s\n  Vendor: \t\t%s\n  Driver: \t\t%s\n  Compute Units: \t%u\n", device_name, device_vend, device_driver, CUs);
 	if(boinc_is_standalone()){
@@ -336,7 +330,8 @@ int main(int argc, char *argv[])
 
 	// check vendor and normalize compute units
 	// kernel size will be determined by profiling so this doesn't have to be accurate.
-	sd.computeunits = (uint32_t)CUs;
+	// these only seed the first profile, the database entry replaces them on later runs.
+	gpu.computeunits = (uint32_t)CUs;
 	char intel_s[] = "Intel";
 	char arc_s[] = "Arc";
 	char nvidia_s[] = "NVIDIA";	
@@ -347,10 +342,10 @@ int main(int argc, char *argv[])
 
 		float winVer = (float)getSysOpType();
 
-		if(winVer >= 10.0f && !sd.compute){
+		if(winVer >= 10.0f && !gpu.compute){
 
 		 	cl_uint ccmajor;
-			err = clGetDeviceInfo(hardware.device, CL_DEVICE_COMPUTE_CAPABILITY_MAJOR_NV, sizeof(ccmajor), &ccmajor, NULL);
+			err = clGetDeviceInfo(gpu.hardware.device, CL_DEVICE_COMPUTE_CAPABILITY_MAJOR_NV, sizeof(ccmajor), &ccmajor, NULL);
 			if ( err != CL_SUCCESS ) {
 				printf( "Error checking device compute capability\n" );
 				fprintf(stderr, "Error checking device compute capability\n");
@@ -358,7 +353,7 @@ int main(int argc, char *argv[])
 			}
 
 			if(ccmajor >= 6){
-				sd.compute = true;
+				gpu.compute = true;
 			}
 		}
 
@@ -384,7 +379,7 @@ int main(int argc, char *argv[])
 			|| strstr((char*)device_name, (char*)dc6) != NULL
 			|| strstr((char*)device_name, (char*)dc7) != NULL
 			|| strstr((char*)device_name, (char*)dc8) != NULL){
-			sd.compute = true;
+			gpu.compute = true;
 		}
 
 #endif
@@ -392,28 +387,262 @@ int main(int argc, char *argv[])
 	// Intel
 	else if( strstr((char*)device_vend, (char*)intel_s) != NULL ){
 		if( strstr((char*)device_name, (char*)arc_s) != NULL ){
-			sd.computeunits /= 10;
+			gpu.computeunits /= 10;
 		}
 		else{
-			sd.computeunits /= 20;
+			gpu.computeunits /= 20;
 	                fprintf(stderr,"Detected Intel integrated graphics\n");	
 		}
 	}
 	// AMD
         else{
-		sd.computeunits /= 2;
+		gpu.computeunits /= 2;
         }
 
-	if(!sd.computeunits) sd.computeunits++;
-	
+	if(!gpu.computeunits) gpu.computeunits++;
+}
+
+
+// n, N and mode of each job in the batch file, p and P are the command line range.  returns the job count.
+static uint32_t readBatch( const char * filename, workStatus & st, workStatus * job ){
+
+	char resolved_name[512], line[256], mode[8];
+	boinc_resolve_filename(filename, resolved_name, sizeof(resolved_name));
+	FILE * in = boinc_fopen(resolved_name, "r");
+	if(in == NULL){
+		fprintf(stderr,"Cannot open %s !!!\n", filename);
+		printf("Cannot open %s !!!\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t count = 0, lc = 0;
+	while(fgets(line, sizeof(line), in) != NULL){
+		++lc;
+		uint32_t nmin, nmax;
+		int fields = sscanf(line, "%u %u %7s", &nmin, &nmax, mode);
+		if(fields <= 0){
+			// blank line
+			continue;
+		}
+		if(fields != 3 || nmin < 101 || nmin >= nmax || nmax > 0x7FFFFFFF || strspn(mode, "!#c") != strlen(mode)){
+			fprintf(stderr,"Invalid job on line %u of %s\n", lc, filename);
+			printf("Invalid job on line %u of %s\n", lc, filename);
+			exit(EXIT_FAILURE);
+		}
+		if(count == MAX_JOBS){
+			fprintf(stderr,"Error: more than %u jobs in %s\n", MAX_JOBS, filename);
+			printf("Error: more than %u jobs in %s\n", MAX_JOBS, filename);
+			exit(EXIT_FAILURE);
+		}
+		job[count] = st;
+		job[count].nmin = nmin;
+		job[count].nmax = nmax;
+		job[count].factorial = (strchr(mode, '!') != NULL);
+		job[count].primorial = (strchr(mode, '#') != NULL);
+		job[count].compositorial = (strchr(mode, 'c') != NULL);
+		++count;
+	}
+	fclose(in);
+
+	if(!count){
+		fprintf(stderr,"Error: no jobs in %s\n", filename);
+		printf("Error: no jobs in %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	return count;
+}
+
+
+int main(int argc, char *argv[])
+{ 
+	searchData sd = {};
+	sd.numresults = 1000000;
+	sd.write_state_a_next = true;
+	sd.threadcount = 2;
+	workStatus st = {};
+
+        // Initialize BOINC
+        BOINC_OPTIONS options;
+        boinc_options_defaults(options);
+        options.normal_thread_priority = true;
+        boinc_init_options(&options);
+
+	fprintf(stderr, "\nPFCSieve v%s.%s by Bryan Little\nwith contributions by Yves Gallot, Mark Rodenkirch, and Kim Walisch\n",VERSION_MAJOR,VERSION_MINOR);
+	fprintf(stderr, "Compiled " __DATE__ " with GCC " __VERSION__ "\n");
+	if(boinc_is_standalone()){
+		printf("\nPFCSieve v%s.%s by Bryan Little\nwith contributions by Yves Gallot, Mark Rodenkirch, and Kim Walisch\n",VERSION_MAJOR,VERSION_MINOR);
+		printf("Compiled " __DATE__ " with GCC " __VERSION__ "\n");
+	}
+
+        // Print out cmd line for diagnostics
+        fprintf(stderr, "Command line: ");
+        for (int i = 0; i < argc; i++)
+        	fprintf(stderr, "%s ", argv[i]);
+        fprintf(stderr, "\n");
+
+	process_args(argc,argv,st,sd);
+
+	// the candidate bits are built when the search starts, after its checkpoint is read
+	if(survivor_file != NULL){
+		if(sd.test || batch_file != NULL){
+			fprintf(stderr,"--survivors can't be used with -s or --batch\n");
+			printf("--survivors can't be used with -s or --batch\n");
+			exit(EXIT_FAILURE);
+		}
+		survivorSetFile(survivor_file);
+	}
+
+	// jobs of a batch share one GPU's prime generator
+	workStatus job[MAX_JOBS];
+	uint32_t jobcount = 0;
+	if(batch_file != NULL){
+		if(sd.cpu || sd.test || sd.alldevices || sd.cputhreads){
+			fprintf(stderr,"--batch runs on one GPU, it can't be used with --backend=cpu, -s, --alldevices or --cputhreads\n");
+			printf("--batch runs on one GPU, it can't be used with --backend=cpu, -s, --alldevices or --cputhreads\n");
+			exit(EXIT_FAILURE);
+		}
+		jobcount = readBatch(batch_file, st, job);
+	}
+
+	omp_set_num_threads(sd.threadcount);
+
+	primesieve_set_num_threads(1);
+
+	// CPU backend does not use OpenCL
+	if(sd.cpu){
+		fprintf(stderr, "CPU Info:\n  Threads: \t\t%u\n", sd.threadcount);
+		if(boinc_is_standalone()){
+			printf("CPU Info:\n  Threads: \t\t%u\n", sd.threadcount);
+		}
+		if(sd.test){
+			run_test(NULL, 0, st, sd);
+		}
+		else{
+			cpu_sieve(st, sd);
+		}
+		boinc_finish(EXIT_SUCCESS);
+		return 0;
+	}
+
+	cl_platform_id platform = 0;
+	cl_device_id device = 0;
+	cl_int err = 0;
+
+	int retval = 0;
+	retval = boinc_get_opencl_ids(argc, argv, 0, &device, &platform);
+	if (retval) {
+		if(boinc_is_standalone()){
+			printf("init_data.xml not found, using device 0.\n");
+
+			err = clGetPlatformIDs(1, &platform, NULL);
+			if (err != CL_SUCCESS) {
+				printf( "clGetPlatformIDs() failed with %d\n", err );
+				fprintf(stderr, "Error: clGetPlatformIDs() failed with %d\n", err );
+				exit(EXIT_FAILURE);
+			}
+			err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+			if (err != CL_SUCCESS) {
+				printf( "clGetDeviceIDs() failed with %d\n", err );
+				fprintf(stderr, "Error: clGetDeviceIDs() failed with %d\n", err );
+				exit(EXIT_FAILURE);
+			}
+		}
+		else{
+			fprintf(stderr, "Error: boinc_get_opencl_ids() failed with error %d\n", retval );
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// every gpu of the platform searches its share of P
+	cl_uint gpucount = 1;
+	cl_device_id * devices = &device;
+	if(sd.alldevices){
+		err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, NULL, &gpucount);
+		if (err != CL_SUCCESS || gpucount == 0) {
+			printf( "clGetDeviceIDs() failed with %d\n", err );
+			fprintf(stderr, "Error: clGetDeviceIDs() failed with %d\n", err );
+			exit(EXIT_FAILURE);
+		}
+		devices = (cl_device_id *)malloc(gpucount * sizeof(cl_device_id));
+		if( devices == NULL ){
+			fprintf(stderr,"malloc error: devices\n");
+			exit(EXIT_FAILURE);
+		}
+		err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, gpucount, devices, NULL);
+		if (err != CL_SUCCESS) {
+			printf( "clGetDeviceIDs() failed with %d\n", err );
+			fprintf(stderr, "Error: clGetDeviceIDs() failed with %d\n", err );
+			exit(EXIT_FAILURE);
+		}
+		fprintf(stderr, "Using %u GPUs\n", gpucount);
+		if(boinc_is_standalone()){
+			printf("Using %u GPUs\n", gpucount);
+		}
+	}
+
+	// compiled kernels and tuned kernel sizes are kept in the project directory, it persists between workunits
+	APP_INIT_DATA init_data;
+	const char * cache_dir = ".";
+	if(!boinc_is_standalone()){
+		boinc_get_init_data(init_data);
+		cache_dir = init_data.project_dir;
+	}
+	sclSetBinaryCache(cache_dir);
+	tuneSetDir(cache_dir, sd.retune);
+
+	gpuDevice * gpu = (gpuDevice *)calloc(gpucount, sizeof(gpuDevice));
+	if( gpu == NULL ){
+		fprintf(stderr,"malloc error: gpu\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// each device has its own context and queue
+	for(cl_uint i = 0; i < gpucount; ++i){
+
+		cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+
+		cl_context ctx = clCreateContext(cps, 1, &devices[i], NULL, NULL, &err);
+		if (err != CL_SUCCESS) {
+			fprintf(stderr, "Error: clCreateContext() returned %d\n", err);
+	        	exit(EXIT_FAILURE); 
+	   	}
+
+		// OpenCL v2.0
+		//cl_queue_properties qp[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+		//queue = clCreateCommandQueueWithProperties(ctx, device, qp, &err);
+
+		cl_command_queue queue = clCreateCommandQueue(ctx, devices[i], CL_QUEUE_PROFILING_ENABLE, &err);	
+		if(err != CL_SUCCESS) { 
+			fprintf(stderr, "Error: Creating Command Queue. (clCreateCommandQueueWithProperties) returned %d\n", err );
+			exit(EXIT_FAILURE);
+	    	}
+
+		gpu[i].hardware.platform = platform;
+		gpu[i].hardware.device = devices[i];
+		gpu[i].hardware.queue = queue;
+		gpu[i].hardware.context = ctx;
+
+		gpuInfo(gpu[i]);
+	}
+
 	if(sd.test){
-		run_test(hardware, st, sd);
+		run_test(gpu, gpucount, st, sd);
+	}
+	else if(jobcount){
+		cl_batch(gpu[0], job, jobcount, sd);
 	}
 	else{
-		cl_sieve(hardware, st, sd);
+		cl_sieve(gpu, gpucount, st, sd);
 	}
 
-        sclReleaseClHard(hardware);
+	for(cl_uint i = 0; i < gpucount; ++i){
+	        sclReleaseClHard(gpu[i].hardware);
+	}
+	free(gpu);
+	if(devices != &device){
+		free(devices);
+	}
 
 	boinc_finish(EXIT_SUCCESS);
 
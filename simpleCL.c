@@ -26,6 +26,8 @@ extern "C" {
 #endif
 
 #include "simpleCL.h"
+#include <dirent.h>
+#include <utime.h>
 
 void sclPrintErrorFlags( cl_int flag ){
     
@@ -349,36 +351,207 @@ void sclPrintErrorFlags( cl_int flag ){
 
 
 
-void sclGetBinary( sclSoft software ){
+// directory for compiled kernel binaries, empty disables the cache
+static char sclBinaryCacheDir[1024] = "";
+
+// the run constants are part of the key, each workunit adds binaries.  only the most recently used are kept.
+#define SCL_CACHE_MAX 32
+
+void sclSetBinaryCache( const char * dir ){
+
+	snprintf( sclBinaryCacheDir, sizeof(sclBinaryCacheDir), "%s", (dir != NULL) ? dir : "" );
+
+}
+
+// FNV-1a
+static uint64_t _sclHash( uint64_t h, const char * s ){
+
+	for( ; *s; ++s ){
+		h ^= (unsigned char)*s;
+		h *= 0x100000001b3ULL;
+	}
+	h ^= 0xff;	// field separator
+	h *= 0x100000001b3ULL;
+
+	return h;
+}
+
+// cache file name from device name, driver version, kernel source and build options
+static void _sclBinaryName( char * filename, size_t len, sclHard hardware, const char * source, const char * options ){
+
+	const cl_device_info info[4] = { CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DEVICE_VERSION, CL_DRIVER_VERSION };
+	char str[1024];
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for(int i = 0; i < 4; ++i){
+		if( clGetDeviceInfo( hardware.device, info[i], sizeof(str), str, NULL ) != CL_SUCCESS ){
+			str[0] = '\0';
+		}
+		h = _sclHash( h, str );
+	}
+	h = _sclHash( h, source );
+	h = _sclHash( h, (options != NULL) ? options : "" );
+
+	snprintf( filename, len, "%s/pfcsieve_%016llx.bin", sclBinaryCacheDir, (unsigned long long)h );
+
+}
+
+// remove all but the SCL_CACHE_MAX most recently used binaries from the cache directory
+static void _sclPruneCache( void ){
+
+	DIR * dir = opendir( sclBinaryCacheDir );
+	if( dir == NULL ){
+		return;
+	}
+
+	char path[1300];
+	struct stat st;
+	struct dirent * ent;
+
+	for(;;){
+		unsigned int count = 0;
+		time_t oldest = 0;
+		char oldname[1300] = "";
+
+		rewinddir( dir );
+		while( (ent = readdir( dir )) != NULL ){
+			size_t len = strlen( ent->d_name );
+			if( strncmp( ent->d_name, "pfcsieve_", 9 ) != 0 || len < 4 || strcmp( ent->d_name + len - 4, ".bin" ) != 0 ){
+				continue;
+			}
+			snprintf( path, sizeof(path), "%s/%s", sclBinaryCacheDir, ent->d_name );
+			if( stat( path, &st ) != 0 ){
+				continue;
+			}
+			if( count == 0 || st.st_mtime < oldest ){
+				oldest = st.st_mtime;
+				snprintf( oldname, sizeof(oldname), "%s", path );
+			}
+			++count;
+		}
+
+		if( count <= SCL_CACHE_MAX || remove( oldname ) != 0 ){
+			break;
+		}
+	}
+
+	closedir( dir );
+}
+
+// program from a cached binary, NULL if there is no usable binary
+static cl_program _sclLoadBinary( const char * filename, sclHard hardware, const char * options ){
+
+	FILE * fpbin = fopen( filename, "rb" );
+	if( fpbin == NULL ){
+		return NULL;
+	}
+
+	fseek( fpbin, 0, SEEK_END );
+	long fsize = ftell( fpbin );
+	rewind( fpbin );
+	if( fsize <= 0 ){
+		fclose( fpbin );
+		return NULL;
+	}
+
+	size_t size = (size_t)fsize;
+	unsigned char * binary = new unsigned char [ size ];
+	size_t x = fread( binary, size, 1, fpbin );
+	fclose( fpbin );
+	if( x != 1 ){
+		delete [ ] binary;
+		return NULL;
+	}
+
+	cl_int err, status;
+	const unsigned char * bin = binary;
+	cl_program program = clCreateProgramWithBinary( hardware.context, 1, &hardware.device, &size, &bin, &status, &err );
+	delete [ ] binary;
+
+	if( err != CL_SUCCESS || status != CL_SUCCESS ){
+		if( program != NULL ){
+			clReleaseProgram( program );
+		}
+		return NULL;
+	}
+
+	// a binary still needs clBuildProgram, a stale or corrupt binary falls back to a source build
+	if( clBuildProgram( program, 1, &hardware.device, options, NULL, NULL ) != CL_SUCCESS ){
+		clReleaseProgram( program );
+		return NULL;
+	}
+
+	// mark the binary as recently used so pruning keeps it
+	utime( filename, NULL );
+
+	return program;
+}
+
+// index of the device among the GPUs of its platform, 0 when it isn't found
+unsigned int _sclDeviceIndex( sclHard hardware ){
+
+	cl_uint count = 0;
+	unsigned int index = 0;
+
+	if( clGetDeviceIDs( hardware.platform, CL_DEVICE_TYPE_GPU, 0, NULL, &count ) != CL_SUCCESS || count == 0 ){
+		return 0;
+	}
+	cl_device_id * devices = new cl_device_id [ count ];
+	if( clGetDeviceIDs( hardware.platform, CL_DEVICE_TYPE_GPU, count, devices, NULL ) == CL_SUCCESS ){
+		for( cl_uint i = 0; i < count; ++i ){
+			if( devices[i] == hardware.device ){
+				index = i;
+				break;
+			}
+		}
+	}
+	delete [ ] devices;
+
+	return index;
+}
+
+
+// write the program binary to the cache.  failures are not fatal, the kernel is built from source next time.
+void sclGetBinary( cl_program program, const char * name, const char * filename, sclHard hardware ){
 
 	size_t size;
 	cl_int err;
 
-	err = clGetProgramInfo( software.program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL );
-	if ( err!=CL_SUCCESS ) {
-		printf( "Error: clGetProgramInfo\n" );
-		fprintf(stderr, "Error: clGetProgramInfo\n" );
-		sclPrintErrorFlags( err );
+	err = clGetProgramInfo( program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL );
+	if ( err!=CL_SUCCESS || size == 0 ) {
+		fprintf(stderr, "Warning: unable to get binary for %s\n", name );
+		return;
 	}
 
 	unsigned char * binary = new unsigned char [ size ];
 
-	err = clGetProgramInfo( software.program, CL_PROGRAM_BINARIES, size, &binary, NULL );
+	err = clGetProgramInfo( program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binary, NULL );
 	if ( err!=CL_SUCCESS ) {
-		printf( "Error: clGetProgramInfo\n" );
-		fprintf(stderr, "Error: clGetProgramInfo\n" );
-		sclPrintErrorFlags( err );
+		fprintf(stderr, "Warning: unable to get binary for %s\n", name );
+		delete [ ] binary;
+		return;
 	}
 
-	FILE * fpbin = fopen( software.kernelName, "wb" );
+	// write to a temporary file and rename so another process never loads a partial binary.
+	// the name is unique to the process and device, identical devices write the same binary file.
+	char tmpname[1200];
+	snprintf( tmpname, sizeof(tmpname), "%s.%d.%u.tmp", filename, (int)getpid(), _sclDeviceIndex( hardware ) );
+
+	FILE * fpbin = fopen( tmpname, "wb" );
 	if( fpbin == NULL ){
-		printf( "Error: cannot write binary: %s\n", software.kernelName );
-		fprintf( stderr, "Error: cannot write binary: %s\n", software.kernelName );
+		fprintf( stderr, "Warning: cannot write binary: %s\n", tmpname );
 	}
 	else
 	{
-		fwrite( binary, 1, size, fpbin );
+		size_t x = fwrite( binary, size, 1, fpbin );
 		fclose( fpbin );
+		if( x != 1 || rename( tmpname, filename ) != 0 ){
+			fprintf( stderr, "Warning: cannot write binary: %s\n", filename );
+			remove( tmpname );
+		}
+		else{
+			_sclPruneCache();
+		}
 	}
 	delete [ ] binary;
 
@@ -481,6 +654,21 @@ void sclEnqueueKernel( sclHard hardware, sclSoft software) {
 }
 
 
+// the kernel starts once the events, which can be from another queue, are complete
+void sclEnqueueKernelWait( sclHard hardware, sclSoft software, cl_uint numevents, const cl_event * events ) {
+
+	cl_int err;
+
+	err = clEnqueueNDRangeKernel( hardware.queue, software.kernel, 3, NULL, software.global_size, software.local_size, numevents, events, NULL );
+	if ( err != CL_SUCCESS ) {
+		printf( "\nError on EnqueueKernel %s", software.kernelName );
+		fprintf(stderr, "\nError on EnqueueKernel %s", software.kernelName );
+		sclPrintErrorFlags(err); 
+	}
+
+}
+
+
 cl_event sclEnqueueKernelEvent( sclHard hardware, sclSoft software) {
 
 	cl_event myEvent;
@@ -628,22 +816,53 @@ unsigned long int _sclGetMaxGlobalMemSize( cl_device_id device ){
 }
 
 
-sclSoft sclGetCLSoftware( const char* source, const char* name, sclHard hardware, const char * options ){
+cl_program sclGetCLProgram( const char* source, const char* name, sclHard hardware, const char * options ){
+
+	cl_program program = NULL;
+
+	/* Load the program from the binary cache
+	 ########################################################### */
+	char filename[1100];
+	if( sclBinaryCacheDir[0] != '\0' ){
+		_sclBinaryName( filename, sizeof(filename), hardware, source, options );
+		program = _sclLoadBinary( filename, hardware, options );
+	}
+	/* ########################################################### */
+
+	if( program == NULL ){
+
+		/* Create program objects from source
+		 ########################################################### */
+		program = _sclCreateProgram( source, hardware.context );
+		/* ########################################################### */
+
+		/* Build the program (compile it)
+	   	 ############################################ */
+	   	_sclBuildProgram( program, hardware.device, name, options );
+	   	/* ############################################ */
+
+		if( sclBinaryCacheDir[0] != '\0' ){
+			sclGetBinary( program, name, filename, hardware );
+		}
+	}
+
+	return program;
+
+}
+
+
+sclSoft sclGetCLKernel( cl_program program, const char* name, sclHard hardware ){
 
 	sclSoft software;
 
 	sprintf( software.kernelName, "%s", name);
-	
-	/* Create program objects from source
+
+	/* Each sclSoft holds a reference to the program, released by sclReleaseClSoft
 	 ########################################################### */
-	software.program = _sclCreateProgram( source, hardware.context );
+	clRetainProgram( program );
+	software.program = program;
 	/* ########################################################### */
-	
-	/* Build the program (compile it)
-   	 ############################################ */
-   	_sclBuildProgram( software.program, hardware.device, name, options );
-   	/* ############################################ */
-   	
+
    	/* Create the kernel object
 	 ########################################################################## */
 	software.kernel = _sclCreateKernel( software );
@@ -668,6 +887,19 @@ sclSoft sclGetCLSoftware( const char* source, const char* name, sclHard hardware
 }
 
 
+sclSoft sclGetCLSoftware( const char* source, const char* name, sclHard hardware, const char * options ){
+
+	cl_program program = sclGetCLProgram( source, name, hardware, options );
+
+	sclSoft software = sclGetCLKernel( program, name, hardware );
+
+	clReleaseProgram( program );
+
+	return software;
+	
+}
+
+
 
 void sclWrite( sclHard hardware, size_t size, cl_mem buffer, void* hostPointer ) {
 
@@ -721,6 +953,49 @@ void sclReadNB( sclHard hardware, size_t size, cl_mem buffer, void *hostPointer
 
 }
 
+// page-locked host memory.  the buffer stays mapped until it is freed, reads into ptr are a DMA into
+// memory that is reused instead of a copy through pageable memory
+sclPinned sclMallocPinned( sclHard hardware, size_t size ){
+
+	cl_int err;
+	sclPinned pinned;
+
+	pinned.size = size;
+	pinned.buffer = clCreateBuffer( hardware.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err );
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clCreateBuffer failure: pinned host buffer\n" );
+		fprintf(stderr, "ERROR: clCreateBuffer failure: pinned host buffer\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	pinned.ptr = clEnqueueMapBuffer( hardware.queue, pinned.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, NULL, NULL, &err );
+	if ( err != CL_SUCCESS ) {
+		printf( "ERROR: clEnqueueMapBuffer failure: pinned host buffer\n" );
+		fprintf(stderr, "ERROR: clEnqueueMapBuffer failure: pinned host buffer\n" );
+		exit(EXIT_FAILURE);
+	}
+
+	return pinned;
+}
+
+void sclFreePinned( sclHard hardware, sclPinned pinned ){
+
+	cl_int err;
+
+	if( pinned.buffer == NULL ){
+		return;
+	}
+
+	err = clEnqueueUnmapMemObject( hardware.queue, pinned.buffer, pinned.ptr, 0, NULL, NULL );
+	if ( err != CL_SUCCESS ) {
+		printf( "\nclEnqueueUnmapMemObject Error\n" );
+		fprintf(stderr, "\nclEnqueueUnmapMemObject Error\n" );
+		sclPrintErrorFlags( err );
+	}
+
+	sclReleaseMemObject( pinned.buffer );
+}
+
 cl_int sclFinish( sclHard hardware ){
 
 	cl_int err;
@@ -28,6 +28,7 @@ extern "C" {
 #define CL_TARGET_OPENCL_VERSION 110
 
 #include <sys/stat.h>
+#include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -59,12 +60,18 @@ typedef struct {
         size_t local_size[3] = {1,1,1};
 
 }sclSoft;
+typedef struct {
+	cl_mem buffer;
+	void * ptr;
+	size_t size;
+}sclPinned;
 #define _OCLUTILS_STRUCTS
 #endif
 
 /* USER FUNCTIONS */
 
-void sclGetBinary( sclSoft software );
+void sclSetBinaryCache( const char * dir );
+void sclGetBinary( cl_program program, const char * name, const char * filename, sclHard hardware );
 void sclSetGlobalSize( sclSoft & software, uint64_t size );
 void sclSetGlobalSizeExact( sclSoft & software, uint64_t size );
 
@@ -75,11 +82,15 @@ void 			sclWrite( sclHard hardware, size_t size, cl_mem buffer, void* hostPointe
 void 			sclWriteNB( sclHard hardware, size_t size, cl_mem buffer, void* hostPointer );
 void			sclReadNB( sclHard hardware, size_t size, cl_mem buffer, void *hostPointer );
 void			sclRead( sclHard hardware, size_t size, cl_mem buffer, void *hostPointer );
+sclPinned		sclMallocPinned( sclHard hardware, size_t size );
+void			sclFreePinned( sclHard hardware, sclPinned pinned );
 
 /* ######################################################## */
 
 /* ####### inicialization of sclSoft structs  ############## */
 sclSoft 		sclGetCLSoftware( const char* source, const char* name, sclHard hardware, const char * options );
+cl_program		sclGetCLProgram( const char* source, const char* name, sclHard hardware, const char * options );
+sclSoft			sclGetCLKernel( cl_program program, const char* name, sclHard hardware );
 
 /* ######################################################## */
 
@@ -100,6 +111,7 @@ void 			sclPrintErrorFlags( cl_int flag );
 /* ####### Device execution ############################### */
 
 void			sclEnqueueKernel( sclHard hardware, sclSoft software );
+void			sclEnqueueKernelWait( sclHard hardware, sclSoft software, cl_uint numevents, const cl_event * events );
 cl_event		sclEnqueueKernelEvent( sclHard hardware, sclSoft software );
 double			ProfilesclEnqueueKernel( sclHard hardware, sclSoft software );
 double			ProfilesclEnqueueKernelNS( sclHard hardware, sclSoft software );
@@ -137,6 +149,7 @@ char* 			_sclLoadProgramSource( const char *filename );
 int 			_sclGetMaxComputeUnits( cl_device_id device );
 unsigned long int 	_sclGetMaxMemAllocSize( cl_device_id device );
 unsigned long int 	_sclGetMaxGlobalMemSize( cl_device_id device );
+unsigned int 		_sclDeviceIndex( sclHard hardware );
 
 
 /* ######################################################## */
@@ -0,0 +1,225 @@
+/*
+	survivors.cpp - Bryan Little 4/2025
+
+	--survivors=file limits the search to candidates that don't have a factor yet.  There is one bit per
+	candidate n!+-1, n#+-1 and n!/#+-1 of the search, n in [nmin, nmax), a set bit is a candidate left.
+
+	The file is a results file of an earlier search, lines "p | n!+1", or a sieve file with one candidate
+	"n!+1" per line.  A factor line eliminates its candidate.  When the file lists candidates, only those
+	are left, all others are eliminated.  Candidates outside the search are ignored.
+
+	Only the first factor found of a candidate is reported, it eliminates the candidate.  The factors of a
+	checkpoint are sorted by p, so that is the smallest factor of the candidate in the search.  The devices
+	and the CPU keep a copy of the bits from the last checkpoint, a prime factor found in a segment clears
+	its candidate for the later segments, so their factors of it aren't returned.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "boinc_api.h"
+#include "simpleCL.h"
+#include "cl_sieve.h"
+#include "survivors.h"
+
+static char survivorFile[512] = "";
+static uint32_t * survivorBits = NULL;
+static size_t survivorWords = 0;
+static uint32_t survivorNmin, survivorSpan;
+static bool survivorType[3];
+
+// set the file to load at the start of the search
+void survivorSetFile( const char * filename ){
+	snprintf( survivorFile, sizeof(survivorFile), "%s", filename );
+}
+
+bool survivorsActive(){
+	return survivorBits != NULL;
+}
+
+// each searched type has a plane of 2 bits per n, -1 then +1.  planes are in the order of the type numbers.
+// returns false when the candidate is not in the search.
+bool survivorBit( int32_t nc, int32_t type, uint64_t & bit ){
+	uint32_t n = ( nc < 0 ) ? -nc : nc;
+	if( type < FACTORIAL || type > COMPOSITORIAL || !survivorType[type] || n < survivorNmin || n - survivorNmin >= survivorSpan ){
+		return false;
+	}
+	uint32_t plane = 0;
+	if( type > FACTORIAL && survivorType[FACTORIAL] ) ++plane;
+	if( type > PRIMORIAL && survivorType[PRIMORIAL] ) ++plane;
+	bit = ( (uint64_t)plane * survivorSpan + ( n - survivorNmin ) ) * 2 + ( nc > 0 );
+	return true;
+}
+
+// candidate of a line "p | n!+1" or "n!/#-1".  factored is set when the line has a factor.
+// returns false for other lines, like the checksum at the end of a results file.
+static bool parseLine( const char * line, bool & factored, int32_t & nc, int32_t & type ){
+
+	const char * s = strchr( line, '|' );
+	factored = ( s != NULL );
+	s = factored ? s+1 : line;
+
+	while( *s == ' ' || *s == '\t' ) ++s;
+	if( *s < '0' || *s > '9' ){
+		return false;
+	}
+	char * end;
+	unsigned long n = strtoul( s, &end, 10 );
+	if( n == 0 || n > 0x7FFFFFFF ){
+		return false;
+	}
+	s = end;
+
+	if( strncmp( s, "!/#", 3 ) == 0 ){
+		type = COMPOSITORIAL;
+		s += 3;
+	}
+	else if( *s == '!' ){
+		type = FACTORIAL;
+		++s;
+	}
+	else if( *s == '#' ){
+		type = PRIMORIAL;
+		++s;
+	}
+	else{
+		return false;
+	}
+
+	if( ( s[0] != '+' && s[0] != '-' ) || s[1] != '1' ){
+		return false;
+	}
+	nc = ( s[0] == '-' ) ? -(int32_t)n : (int32_t)n;
+
+	for( s += 2; *s != '\0'; ++s ){
+		if( *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n' ){
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// set the candidates listed in the file, when set is true, and clear the factored ones, when clear is true.
+// counts both kinds of lines.  returns false when the file can't be opened.
+static bool readCandidates( const char * filename, bool set, bool clear, uint32_t & listed, uint32_t & factored ){
+
+	char resolved_name[512], line[256];
+	boinc_resolve_filename( filename, resolved_name, sizeof(resolved_name) );
+	FILE * in = boinc_fopen( resolved_name, "r" );
+	if( in == NULL ){
+		return false;
+	}
+
+	listed = factored = 0;
+	while( fgets( line, sizeof(line), in ) != NULL ){
+		bool hasfactor;
+		int32_t nc, type;
+		uint64_t bit;
+		if( !parseLine( line, hasfactor, nc, type ) || !survivorBit( nc, type, bit ) ){
+			continue;
+		}
+		if( hasfactor ){
+			++factored;
+			if( clear ) survivorBits[bit >> 5] &= ~( 1U << ( bit & 31 ) );
+		}
+		else{
+			++listed;
+			if( set ) survivorBits[bit >> 5] |= 1U << ( bit & 31 );
+		}
+	}
+
+	fclose( in );
+
+	return true;
+}
+
+// build the candidate bits of the search from the file.  a resumed search also eliminates the candidates
+// with a factor in its results file.
+void survivorStart( workStatus & st, const char * resultsfile, bool resumed ){
+
+	if( survivorFile[0] == '\0' ){
+		return;
+	}
+
+	survivorNmin = st.nmin;
+	survivorSpan = st.nmax - st.nmin;
+	survivorType[FACTORIAL] = st.factorial;
+	survivorType[PRIMORIAL] = st.primorial;
+	survivorType[COMPOSITORIAL] = st.compositorial;
+
+	uint64_t bits = (uint64_t)( st.factorial + st.primorial + st.compositorial ) * survivorSpan * 2;
+	survivorWords = ( bits + 31 ) / 32;
+	if( !survivorWords ) survivorWords = 1;
+
+	free( survivorBits );
+	survivorBits = (uint32_t *)calloc( survivorWords, sizeof(uint32_t) );
+	if( survivorBits == NULL ){
+		fprintf(stderr,"malloc error: survivors\n");
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t listed, factored;
+	if( !readCandidates( survivorFile, true, false, listed, factored ) ){
+		fprintf(stderr,"Cannot open %s !!!\n", survivorFile);
+		printf("Cannot open %s !!!\n", survivorFile);
+		exit(EXIT_FAILURE);
+	}
+	// a results file doesn't list candidates, every candidate without a factor is left
+	if( !listed ){
+		memset( survivorBits, 0xFF, survivorWords * sizeof(uint32_t) );
+		if( bits & 31 ){
+			survivorBits[survivorWords-1] = ( 1U << ( bits & 31 ) ) - 1;
+		}
+	}
+	if( factored ){
+		readCandidates( survivorFile, false, true, listed, factored );
+	}
+
+	uint32_t reported = 0;
+	if( resumed ){
+		readCandidates( resultsfile, false, true, listed, reported );
+	}
+
+	uint64_t left = 0;
+	for( size_t i = 0; i < survivorWords; ++i ){
+		for( uint32_t w = survivorBits[i]; w; w &= w-1 ){
+			++left;
+		}
+	}
+
+	fprintf(stderr,"%" PRIu64 " of %" PRIu64 " candidates left after %s", left, bits, survivorFile);
+	if( resumed ) fprintf(stderr," and %u factors in %s", reported, resultsfile);
+	fprintf(stderr,"\n");
+	if( boinc_is_standalone() ){
+		printf("%" PRIu64 " of %" PRIu64 " candidates left after %s", left, bits, survivorFile);
+		if( resumed ) printf(" and %u factors in %s", reported, resultsfile);
+		printf("\n");
+	}
+}
+
+// eliminate the candidate of the factor.  returns false when it was eliminated before.
+bool survivorKill( int32_t nc, int32_t type ){
+	uint64_t bit;
+	if( !survivorBit( nc, type, bit ) ){
+		return false;
+	}
+	uint32_t mask = 1U << ( bit & 31 );
+	bool alive = ( survivorBits[bit >> 5] & mask ) != 0;
+	survivorBits[bit >> 5] &= ~mask;
+	return alive;
+}
+
+// the candidate bits, copied to the devices at each checkpoint
+uint32_t * survivorMap( size_t & words ){
+	words = survivorWords;
+	return survivorBits;
+}
+
+void survivorFree(){
+	free( survivorBits );
+	survivorBits = NULL;
+	survivorWords = 0;
+}
@@ -0,0 +1,15 @@
+// survivors.h
+
+void survivorSetFile( const char * filename );
+
+bool survivorsActive();
+
+void survivorStart( workStatus & st, const char * resultsfile, bool resumed );
+
+bool survivorBit( int32_t nc, int32_t type, uint64_t & bit );
+
+bool survivorKill( int32_t nc, int32_t type );
+
+uint32_t * survivorMap( size_t & words );
+
+void survivorFree();
@@ -0,0 +1,161 @@
+/*
+	tunedb.cpp - Bryan Little 4/2025
+
+	Kernel sizes measured by profiling are kept in pfcsieve_tune.txt next to the cached kernel binaries.
+	There is one line per device, driver, search mode and power of two of p and N:
+
+	device|driver|mode|p bits|N bits	range psize presieve sstep nstep queuedepth compute
+
+	A later run with the same key uses the stored sizes and skips the startup profile.  The compute flag
+	picks the kernel time targets, the profile sets it from the iterate kernel timings.  It is the vendor
+	heuristic of main.cpp only when the N range was too short to time the kernel at both targets.
+	--retune ignores the stored line, profiles again and replaces it.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "boinc_api.h"
+#include "simpleCL.h"
+#include "cl_sieve.h"
+#include "tunedb.h"
+
+#define TUNE_FILENAME "pfcsieve_tune.txt"
+
+static char tuneFile[1100] = TUNE_FILENAME;
+static bool tuneRetune = false;
+
+static uint32_t log2floor( uint64_t x ){
+	uint32_t b = 0;
+	while( x >>= 1 ) ++b;
+	return b;
+}
+
+// copy a device string, the key can't contain the separators
+static void keyString( char * dst, const char * src, size_t len ){
+	size_t i = 0;
+	for( ; src[i] != '\0' && i < len-1; ++i ){
+		dst[i] = ( src[i] == '|' || src[i] == '\t' || src[i] == '\n' || src[i] == '\r' ) ? ' ' : src[i];
+	}
+	dst[i] = '\0';
+}
+
+// set the database directory
+void tuneSetDir( const char * dir, bool retune ){
+	snprintf( tuneFile, sizeof(tuneFile), "%s/%s", dir, TUNE_FILENAME );
+	tuneRetune = retune;
+}
+
+// sets the key of the device from its name, driver, the mode and p, N magnitude.  on a hit the stored sizes
+// are copied to sd.  the prime array size is only a lower bound, it is checked against the range at this run's p.
+bool tuneLookup( sclHard hardware, workStatus & st, searchData & sd, char * key, size_t keysize ){
+
+	char str[1024], name[1024], driver[1024];
+
+	if( clGetDeviceInfo( hardware.device, CL_DEVICE_NAME, sizeof(str), str, NULL ) != CL_SUCCESS ){
+		str[0] = '\0';
+	}
+	keyString( name, str, sizeof(name) );
+	if( clGetDeviceInfo( hardware.device, CL_DRIVER_VERSION, sizeof(str), str, NULL ) != CL_SUCCESS ){
+		str[0] = '\0';
+	}
+	keyString( driver, str, sizeof(driver) );
+
+	snprintf( key, keysize, "%s|%s|%s%s%s%s/%u|%u|%u", name, driver,
+		st.factorial ? "!" : "", st.primorial ? "#" : "", st.compositorial ? "c" : "", sd.compinv ? "i" : "",
+		sd.mont32 ? 32 : 64, log2floor(st.p), log2floor(st.nmax) );
+
+	if( tuneRetune ){
+		return false;
+	}
+
+	FILE * fp = fopen( tuneFile, "r" );
+	if( fp == NULL ){
+		return false;
+	}
+
+	bool found = false;
+	char line[4096];
+	size_t keylen = strlen( key );
+
+	while( !found && fgets( line, sizeof(line), fp ) != NULL ){
+		if( strncmp( line, key, keylen ) != 0 || line[keylen] != '\t' ){
+			continue;
+		}
+		uint32_t range, psize, presieve, sstep, nstep, queuedepth, compute;
+		if( sscanf( line+keylen+1, "%u %u %u %u %u %u %u", &range, &psize, &presieve, &sstep, &nstep, &queuedepth, &compute ) != 7
+			|| !range || !sstep || !nstep || !queuedepth || presieve < 113 || presieve > 65536 ){
+			fprintf( stderr, "Warning: ignoring bad line in %s\n", tuneFile );
+			continue;
+		}
+		sd.range = range;
+		sd.psize = psize;
+		// --presieve overrides the stored bound
+		if( !sd.presieve ){
+			sd.presieve = presieve;
+		}
+		sd.sstep = sstep;
+		sd.nstep = nstep;
+		sd.queuedepth = queuedepth;
+		sd.compute = ( compute != 0 );
+		found = true;
+	}
+
+	fclose( fp );
+
+	if( found ){
+		fprintf( stderr, "Using kernel sizes from %s\n", tuneFile );
+		if( boinc_is_standalone() ){
+			printf( "Using kernel sizes from %s\n", tuneFile );
+		}
+	}
+
+	return found;
+}
+
+// write the sizes of the device under its key from tuneLookup, replacing the old line.
+// failures are not fatal, the next run profiles again.
+void tuneStore( const char * key, searchData & sd ){
+
+	// one temporary file per process, the devices of a process store one at a time
+	char tmpname[1200];
+	snprintf( tmpname, sizeof(tmpname), "%s.%d.tmp", tuneFile, (int)getpid() );
+
+	FILE * out = fopen( tmpname, "w" );
+	if( out == NULL ){
+		fprintf( stderr, "Warning: cannot write %s\n", tmpname );
+		return;
+	}
+
+	// keep the lines of other devices and modes
+	FILE * in = fopen( tuneFile, "r" );
+	if( in != NULL ){
+		char line[4096];
+		size_t keylen = strlen( key );
+		while( fgets( line, sizeof(line), in ) != NULL ){
+			if( strncmp( line, key, keylen ) == 0 && line[keylen] == '\t' ){
+				continue;
+			}
+			fputs( line, out );
+		}
+		fclose( in );
+	}
+
+	fprintf( out, "%s\t%u %u %u %u %u %u %u\n", key, sd.range, sd.psize, sd.presieve, sd.sstep, sd.nstep, sd.queuedepth, (uint32_t)sd.compute );
+
+	bool good = ( fclose( out ) == 0 );
+	// another process sees the old or the new file, never a partial one
+#ifdef _WIN32
+	// rename does not replace an existing file on windows
+	if( !good || !MoveFileExA( tmpname, tuneFile, MOVEFILE_REPLACE_EXISTING ) ){
+#else
+	if( !good || rename( tmpname, tuneFile ) != 0 ){
+#endif
+		fprintf( stderr, "Warning: cannot write %s\n", tuneFile );
+		remove( tmpname );
+	}
+}
@@ -0,0 +1,7 @@
+// tunedb.h
+
+void tuneSetDir( const char * dir, bool retune );
+
+bool tuneLookup( sclHard hardware, workStatus & st, searchData & sd, char * key, size_t keysize );
+
+void tuneStore( const char * key, searchData & sd );
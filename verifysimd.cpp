@@ -0,0 +1,590 @@
+/*
+	verifysimd.cpp
+
+	Bryan Little 4/2025
+
+	batched primality tests and factor verification on CPU
+
+	Each SIMD lane holds one factor with its own modulus.  AVX-512 IFMA uses 8 lanes of two
+	52 bit limbs with R = 2^104.  AVX2 uses 4 lanes of two 32 bit digits with R = 2^64.
+	The instruction set is selected at runtime with CPUID.  Other CPUs use the scalar
+	functions in verifyprime.cpp.
+
+	Montgomery arithmetic by Yves Gallot,
+	Peter L. Montgomery, Modular multiplication without trial division, Math. Comp.44 (1985), 519–521.
+
+*/
+
+#include <cinttypes>
+#include <stdio.h>
+
+#include "verifyprime.h"
+#include "verifysimd.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#define SIMD_X86
+	#include <immintrin.h>
+	#include "primesieve/cpu_supports_avx512_vbmi2.hpp"
+	#define IFMA_TARGET __attribute__ ((target ("avx512f,avx512ifma")))
+	#define AVX2_TARGET __attribute__ ((target ("avx2")))
+#endif
+
+#define FACTORIAL 0
+#define PRIMORIAL 1
+#define COMPOSITORIAL 2
+
+#define SIMD_SCALAR 0
+#define SIMD_AVX2 1
+#define SIMD_IFMA 2
+
+static const uint32_t prp_bases[7] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+// precomputed 34!, 101#, and 44!/# that fit in 128 bits
+static const unsigned __int128 f34 = ((unsigned __int128)0xde1bc4d19efcac82 << 64) | 0x445da75b00000000;
+static const unsigned __int128 p101 = ((unsigned __int128)0xaf2fa8f8a2d02a93 << 64) | 0xae69c9f8987d5efe;
+static const unsigned __int128 c44 = ((unsigned __int128)0x98dcc10f185c0e67 << 64) | 0x3c93ff0000000000;
+
+
+static int detectSIMD(){
+#ifdef SIMD_X86
+	int abcd[4];
+
+	run_cpuid(0, 0, abcd);
+	if(abcd[0] < 7){
+		return SIMD_SCALAR;
+	}
+
+	// OS must save YMM state
+	run_cpuid(1, 0, abcd);
+	if((abcd[2] & (1 << 27)) == 0){
+		return SIMD_SCALAR;
+	}
+	int xcr0 = get_xcr0();
+	int ymm_mask = XSTATE_SSE | XSTATE_YMM;
+	int zmm_mask = XSTATE_SSE | XSTATE_YMM | XSTATE_ZMM;
+	if((xcr0 & ymm_mask) != ymm_mask){
+		return SIMD_SCALAR;
+	}
+
+	run_cpuid(7, 0, abcd);
+	int bit_AVX2 = (1 << 5);
+	int bit_AVX512IFMA = (1 << 21);
+	if((xcr0 & zmm_mask) == zmm_mask && (abcd[1] & (bit_AVX512F | bit_AVX512IFMA)) == (bit_AVX512F | bit_AVX512IFMA)){
+		return SIMD_IFMA;
+	}
+	if(abcd[1] & bit_AVX2){
+		return SIMD_AVX2;
+	}
+#endif
+	return SIMD_SCALAR;
+}
+
+static const int simd_level = detectSIMD();
+
+
+const char * simdName(){
+	if(simd_level == SIMD_IFMA) return "AVX-512 IFMA";
+	if(simd_level == SIMD_AVX2) return "AVX2";
+	return "scalar";
+}
+
+
+// per lane constants.  R = 2^bits
+typedef struct {
+	uint64_t p[VERIFY_BATCH], pinv[VERIFY_BATCH], one[VERIFY_BATCH], r2[VERIFY_BATCH], d[VERIFY_BATCH], t[VERIFY_BATCH];
+	uint32_t maxbits, maxt;
+}laneData;
+
+
+// p must be odd
+static void setupLanes(laneData & ld, const uint64_t * p, uint32_t lanes, uint32_t bits){
+
+	ld.maxbits = 0;
+	ld.maxt = 0;
+
+	for(uint32_t i=0; i<lanes; ++i){
+		uint64_t P = p[i];
+		uint64_t p_inv = 1, prev = 0;
+		while (p_inv != prev) { prev = p_inv; p_inv *= 2 - P * p_inv; }
+		ld.p[i] = P;
+		ld.pinv[i] = (-p_inv) & ((bits == 104) ? 0xFFFFFFFFFFFFF : 0xFFFFFFFF);		// -p^-1 mod 2^52 or 2^32
+		ld.one[i] = (uint64_t)( ((unsigned __int128)1 << bits) % P );
+		ld.r2[i] = (uint64_t)( ((unsigned __int128)ld.one[i] * ld.one[i]) % P );
+		// p-1 = d * 2^t
+		uint32_t t = __builtin_ctzll(P-1);
+		ld.t[i] = t;
+		ld.d[i] = P >> t;
+		uint32_t b = 64 - __builtin_clzll(ld.d[i]);
+		if(b > ld.maxbits) ld.maxbits = b;
+		if(t > ld.maxt) ld.maxt = t;
+	}
+}
+
+
+static uint64_t startResidue(uint64_t p, int32_t type){
+	if(type == FACTORIAL) return (uint64_t)(f34 % p);
+	if(type == PRIMORIAL) return (uint64_t)(p101 % p);
+	return (uint64_t)(c44 % p);
+}
+
+
+#ifdef SIMD_X86
+
+// gcc 12 warns about the undefined source operand inside the immediate shift intrinsics
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+/*
+	AVX-512 IFMA, 8 lanes
+*/
+
+typedef struct {
+	__m512i p, p0, p1, pinv;
+}mod52;
+
+// a * b / 2^104 mod p
+IFMA_TARGET static inline __m512i m_mul52(__m512i a, __m512i b, const mod52 & m){
+	const __m512i mask = _mm512_set1_epi64(0xFFFFFFFFFFFFF);
+	const __m512i zero = _mm512_setzero_si512();
+	__m512i a0 = _mm512_and_si512(a, mask);
+	__m512i a1 = _mm512_srli_epi64(a, 52);
+	__m512i b0 = _mm512_and_si512(b, mask);
+	__m512i b1 = _mm512_srli_epi64(b, 52);
+
+	// first limb of a
+	__m512i z0 = _mm512_madd52lo_epu64(zero, a0, b0);
+	__m512i z1 = _mm512_madd52hi_epu64(zero, a0, b0);
+	z1 = _mm512_madd52lo_epu64(z1, a0, b1);
+	__m512i z2 = _mm512_madd52hi_epu64(zero, a0, b1);
+	__m512i mq = _mm512_madd52lo_epu64(zero, z0, m.pinv);
+	z0 = _mm512_madd52lo_epu64(z0, mq, m.p0);
+	z1 = _mm512_madd52hi_epu64(z1, mq, m.p0);
+	z1 = _mm512_madd52lo_epu64(z1, mq, m.p1);
+	z2 = _mm512_madd52hi_epu64(z2, mq, m.p1);
+	z1 = _mm512_add_epi64(z1, _mm512_srli_epi64(z0, 52));
+
+	// second limb of a
+	z1 = _mm512_madd52lo_epu64(z1, a1, b0);
+	z2 = _mm512_madd52hi_epu64(z2, a1, b0);
+	z2 = _mm512_madd52lo_epu64(z2, a1, b1);
+	__m512i z3 = _mm512_madd52hi_epu64(zero, a1, b1);
+	mq = _mm512_madd52lo_epu64(zero, z1, m.pinv);
+	z1 = _mm512_madd52lo_epu64(z1, mq, m.p0);
+	z2 = _mm512_madd52hi_epu64(z2, mq, m.p0);
+	z2 = _mm512_madd52lo_epu64(z2, mq, m.p1);
+	z3 = _mm512_madd52hi_epu64(z3, mq, m.p1);
+	z2 = _mm512_add_epi64(z2, _mm512_srli_epi64(z1, 52));
+	z3 = _mm512_add_epi64(z3, _mm512_srli_epi64(z2, 52));
+	z2 = _mm512_and_si512(z2, mask);
+
+	// result is < 2p, subtract p using limbs since it can be >= 2^64
+	__m512i d0 = _mm512_sub_epi64(z2, m.p0);
+	__m512i d1 = _mm512_sub_epi64(_mm512_sub_epi64(z3, m.p1), _mm512_srli_epi64(d0, 63));
+	d0 = _mm512_and_si512(d0, mask);
+	__mmask8 ge = _mm512_cmpge_epi64_mask(d1, zero);
+	__m512i r = _mm512_or_si512(z2, _mm512_slli_epi64(z3, 52));
+	__m512i d = _mm512_or_si512(d0, _mm512_slli_epi64(d1, 52));
+
+	return _mm512_mask_blend_epi64(ge, r, d);
+}
+
+IFMA_TARGET static inline __m512i add52(__m512i a, __m512i b, __m512i p){
+	__mmask8 c = _mm512_cmpge_epu64_mask(a, _mm512_sub_epi64(p, b));
+	return _mm512_mask_sub_epi64(_mm512_add_epi64(a, b), c, _mm512_add_epi64(a, b), p);
+}
+
+IFMA_TARGET static inline mod52 setupMod52(const laneData & ld){
+	mod52 m;
+	m.p = _mm512_loadu_si512(ld.p);
+	m.p0 = _mm512_and_si512(m.p, _mm512_set1_epi64(0xFFFFFFFFFFFFF));
+	m.p1 = _mm512_srli_epi64(m.p, 52);
+	m.pinv = _mm512_loadu_si512(ld.pinv);
+	return m;
+}
+
+IFMA_TARGET static void isPrimeIFMA(const uint64_t * p, bool * result){
+
+	laneData ld;
+	setupLanes(ld, p, 8, 104);
+
+	const mod52 m = setupMod52(ld);
+	const __m512i one = _mm512_loadu_si512(ld.one);
+	const __m512i pmo = _mm512_sub_epi64(m.p, one);
+	const __m512i r2 = _mm512_loadu_si512(ld.r2);
+	const __m512i d = _mm512_loadu_si512(ld.d);
+	const __m512i t = _mm512_loadu_si512(ld.t);
+	__mmask8 prime = 0xFF;
+
+	for(int i=0; i<7; ++i){
+		uint64_t base[8];
+		__mmask8 skip = 0;
+		for(int j=0; j<8; ++j){
+			// needed for composite bases
+			base[j] = (prp_bases[i] >= p[j]) ? prp_bases[i] % p[j] : prp_bases[i];
+			if(base[j] == 0) skip |= (1 << j);
+		}
+		const __m512i a = m_mul52(_mm512_loadu_si512(base), r2, m);
+
+		// left to right powmod, a^d
+		__m512i x = one;
+		for(int bit = ld.maxbits-1; bit >= 0; --bit){
+			x = m_mul52(x, x, m);
+			__mmask8 set = _mm512_test_epi64_mask(d, _mm512_set1_epi64(1ull << bit));
+			x = _mm512_mask_mov_epi64(x, set, m_mul52(x, a, m));
+		}
+
+		__mmask8 pass = _mm512_cmpeq_epu64_mask(x, one) | _mm512_cmpeq_epu64_mask(x, pmo);
+		for(uint32_t s = 1; s < ld.maxt; ++s){
+			x = m_mul52(x, x, m);
+			__mmask8 active = _mm512_cmpgt_epu64_mask(t, _mm512_set1_epi64(s));
+			pass |= active & _mm512_cmpeq_epu64_mask(x, pmo);
+		}
+
+		prime &= (pass | skip);
+	}
+
+	for(int j=0; j<8; ++j){
+		result[j] = (prime >> j) & 1;
+	}
+}
+
+IFMA_TARGET static void verifyIFMA(const uint64_t * p, const uint32_t * n, const int32_t * c, const int32_t * type,
+					uint32_t * primelist, size_t primelistsize, uint32_t * complist, size_t complistsize, bool * result){
+
+	laneData ld;
+	setupLanes(ld, p, 8, 104);
+
+	const mod52 m = setupMod52(ld);
+	const __m512i one = _mm512_loadu_si512(ld.one);
+	const __m512i pmo = _mm512_sub_epi64(m.p, one);
+	const __m512i r2 = _mm512_loadu_si512(ld.r2);
+
+	uint64_t start[8], fn[8], pn[8], cn[8];
+	uint32_t fmax = 0, pmax = 0, cmax = 0;
+	__mmask8 minus = 0;
+	for(int j=0; j<8; ++j){
+		start[j] = startResidue(p[j], type[j]);
+		fn[j] = (type[j] == FACTORIAL) ? n[j] : 0;
+		pn[j] = (type[j] == PRIMORIAL) ? n[j] : 0;
+		cn[j] = (type[j] == COMPOSITORIAL) ? n[j] : 0;
+		if(fn[j] > fmax) fmax = fn[j];
+		if(pn[j] > pmax) pmax = pn[j];
+		if(cn[j] > cmax) cmax = cn[j];
+		if(c[j] == -1) minus |= (1 << j);
+	}
+
+	__m512i x = m_mul52(_mm512_loadu_si512(start), r2, m);
+
+	// factorial lanes, multiply by 35 ... n
+	const __m512i vfn = _mm512_loadu_si512(fn);
+	__m512i mi = m_mul52(_mm512_set1_epi64(34), r2, m);
+	for(uint32_t i=35; i<=fmax; ++i){
+		mi = add52(mi, one, m.p);
+		__mmask8 active = _mm512_cmpge_epu64_mask(vfn, _mm512_set1_epi64(i));
+		x = _mm512_mask_mov_epi64(x, active, m_mul52(x, mi, m));
+	}
+
+	// primorial lanes, multiply by the primes up to n
+	const __m512i vpn = _mm512_loadu_si512(pn);
+	for(size_t k=0; k<primelistsize && primelist[k] <= pmax; ++k){
+		const __m512i v = _mm512_set1_epi64(primelist[k]);
+		__mmask8 active = _mm512_cmpge_epu64_mask(vpn, v);
+		x = _mm512_mask_mov_epi64(x, active, m_mul52(x, m_mul52(v, r2, m), m));
+	}
+
+	// compositorial lanes, multiply by the composites up to n
+	const __m512i vcn = _mm512_loadu_si512(cn);
+	for(size_t k=0; k<complistsize && complist[k] <= cmax; ++k){
+		const __m512i v = _mm512_set1_epi64(complist[k]);
+		__mmask8 active = _mm512_cmpge_epu64_mask(vcn, v);
+		x = _mm512_mask_mov_epi64(x, active, m_mul52(x, m_mul52(v, r2, m), m));
+	}
+
+	__mmask8 good = (_mm512_cmpeq_epu64_mask(x, one) & minus) | (_mm512_cmpeq_epu64_mask(x, pmo) & ~minus);
+
+	for(int j=0; j<8; ++j){
+		result[j] = (good >> j) & 1;
+	}
+}
+
+
+/*
+	AVX2, 4 lanes
+*/
+
+typedef struct {
+	__m256i p, p1, pinv;
+}mod32;
+
+// unsigned a > b
+AVX2_TARGET static inline __m256i cmpgt_u64(__m256i a, __m256i b){
+	const __m256i sign = _mm256_set1_epi64x(0x8000000000000000);
+	return _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+}
+
+// a * b / 2^64 mod p
+AVX2_TARGET static inline __m256i m_mul32(__m256i a, __m256i b, const mod32 & m){
+	const __m256i mask = _mm256_set1_epi64x(0xFFFFFFFF);
+	__m256i a1 = _mm256_srli_epi64(a, 32);
+	__m256i b1 = _mm256_srli_epi64(b, 32);
+
+	// first digit of a
+	__m256i ab0 = _mm256_mul_epu32(a, b);
+	__m256i ab1 = _mm256_mul_epu32(a, b1);
+	__m256i t0 = _mm256_and_si256(ab0, mask);
+	__m256i t1 = _mm256_add_epi64(_mm256_srli_epi64(ab0, 32), _mm256_and_si256(ab1, mask));
+	__m256i t2 = _mm256_srli_epi64(ab1, 32);
+	__m256i mq = _mm256_mul_epu32(t0, m.pinv);
+	__m256i mp0 = _mm256_mul_epu32(mq, m.p);
+	__m256i mp1 = _mm256_mul_epu32(mq, m.p1);
+	t1 = _mm256_add_epi64(t1, _mm256_srli_epi64(_mm256_add_epi64(t0, _mm256_and_si256(mp0, mask)), 32));
+	t1 = _mm256_add_epi64(t1, _mm256_add_epi64(_mm256_srli_epi64(mp0, 32), _mm256_and_si256(mp1, mask)));
+	t2 = _mm256_add_epi64(t2, _mm256_add_epi64(_mm256_srli_epi64(mp1, 32), _mm256_srli_epi64(t1, 32)));
+	t1 = _mm256_and_si256(t1, mask);
+
+	// second digit of a
+	ab0 = _mm256_mul_epu32(a1, b);
+	ab1 = _mm256_mul_epu32(a1, b1);
+	t1 = _mm256_add_epi64(t1, _mm256_and_si256(ab0, mask));
+	t2 = _mm256_add_epi64(t2, _mm256_add_epi64(_mm256_srli_epi64(ab0, 32), _mm256_and_si256(ab1, mask)));
+	t2 = _mm256_add_epi64(t2, _mm256_srli_epi64(t1, 32));
+	t1 = _mm256_and_si256(t1, mask);
+	__m256i t3 = _mm256_add_epi64(_mm256_srli_epi64(ab1, 32), _mm256_srli_epi64(t2, 32));
+	t2 = _mm256_and_si256(t2, mask);
+	mq = _mm256_mul_epu32(t1, m.pinv);
+	mp0 = _mm256_mul_epu32(mq, m.p);
+	mp1 = _mm256_mul_epu32(mq, m.p1);
+	t2 = _mm256_add_epi64(t2, _mm256_srli_epi64(_mm256_add_epi64(t1, _mm256_and_si256(mp0, mask)), 32));
+	t2 = _mm256_add_epi64(t2, _mm256_add_epi64(_mm256_srli_epi64(mp0, 32), _mm256_and_si256(mp1, mask)));
+	t3 = _mm256_add_epi64(t3, _mm256_add_epi64(_mm256_srli_epi64(mp1, 32), _mm256_srli_epi64(t2, 32)));
+	t2 = _mm256_and_si256(t2, mask);
+
+	// result is < 2p, subtract p if it is >= p or overflowed 2^64
+	__m256i r = _mm256_or_si256(t2, _mm256_slli_epi64(t3, 32));
+	__m256i over = _mm256_cmpgt_epi64(_mm256_srli_epi64(t3, 32), _mm256_setzero_si256());
+	__m256i ge = _mm256_or_si256(over, _mm256_xor_si256(cmpgt_u64(m.p, r), _mm256_set1_epi64x(-1)));
+
+	return _mm256_sub_epi64(r, _mm256_and_si256(ge, m.p));
+}
+
+AVX2_TARGET static inline __m256i add32(__m256i a, __m256i b, __m256i p){
+	__m256i lt = cmpgt_u64(_mm256_sub_epi64(p, b), a);
+	return _mm256_sub_epi64(_mm256_add_epi64(a, b), _mm256_andnot_si256(lt, p));
+}
+
+AVX2_TARGET static inline uint32_t lanemask(__m256i a){
+	return (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(a));
+}
+
+AVX2_TARGET static inline mod32 setupMod32(const laneData & ld){
+	mod32 m;
+	m.p = _mm256_loadu_si256((const __m256i *)ld.p);
+	m.p1 = _mm256_srli_epi64(m.p, 32);
+	m.pinv = _mm256_loadu_si256((const __m256i *)ld.pinv);
+	return m;
+}
+
+AVX2_TARGET static void isPrimeAVX2(const uint64_t * p, bool * result){
+
+	laneData ld;
+	setupLanes(ld, p, 4, 64);
+
+	const mod32 m = setupMod32(ld);
+	const __m256i one = _mm256_loadu_si256((const __m256i *)ld.one);
+	const __m256i pmo = _mm256_sub_epi64(m.p, one);
+	const __m256i r2 = _mm256_loadu_si256((const __m256i *)ld.r2);
+	const __m256i d = _mm256_loadu_si256((const __m256i *)ld.d);
+	const __m256i t = _mm256_loadu_si256((const __m256i *)ld.t);
+	uint32_t prime = 0xF;
+
+	for(int i=0; i<7; ++i){
+		uint64_t base[4];
+		uint32_t skip = 0;
+		for(int j=0; j<4; ++j){
+			// needed for composite bases
+			base[j] = (prp_bases[i] >= p[j]) ? prp_bases[i] % p[j] : prp_bases[i];
+			if(base[j] == 0) skip |= (1 << j);
+		}
+		const __m256i a = m_mul32(_mm256_loadu_si256((const __m256i *)base), r2, m);
+
+		// left to right powmod, a^d
+		__m256i x = one;
+		for(int bit = ld.maxbits-1; bit >= 0; --bit){
+			x = m_mul32(x, x, m);
+			const __m256i b = _mm256_set1_epi64x(1ull << bit);
+			__m256i set = _mm256_cmpeq_epi64(_mm256_and_si256(d, b), b);
+			x = _mm256_blendv_epi8(x, m_mul32(x, a, m), set);
+		}
+
+		uint32_t pass = lanemask(_mm256_or_si256(_mm256_cmpeq_epi64(x, one), _mm256_cmpeq_epi64(x, pmo)));
+		for(uint32_t s = 1; s < ld.maxt; ++s){
+			x = m_mul32(x, x, m);
+			__m256i active = _mm256_cmpgt_epi64(t, _mm256_set1_epi64x(s));
+			pass |= lanemask(_mm256_and_si256(active, _mm256_cmpeq_epi64(x, pmo)));
+		}
+
+		prime &= (pass | skip);
+	}
+
+	for(int j=0; j<4; ++j){
+		result[j] = (prime >> j) & 1;
+	}
+}
+
+AVX2_TARGET static void verifyAVX2(const uint64_t * p, const uint32_t * n, const int32_t * c, const int32_t * type,
+					uint32_t * primelist, size_t primelistsize, uint32_t * complist, size_t complistsize, bool * result){
+
+	laneData ld;
+	setupLanes(ld, p, 4, 64);
+
+	const mod32 m = setupMod32(ld);
+	const __m256i one = _mm256_loadu_si256((const __m256i *)ld.one);
+	const __m256i pmo = _mm256_sub_epi64(m.p, one);
+	const __m256i r2 = _mm256_loadu_si256((const __m256i *)ld.r2);
+
+	uint64_t start[4], fn[4], pn[4], cn[4];
+	uint32_t fmax = 0, pmax = 0, cmax = 0;
+	uint32_t minus = 0;
+	for(int j=0; j<4; ++j){
+		start[j] = startResidue(p[j], type[j]);
+		fn[j] = (type[j] == FACTORIAL) ? n[j] : 0;
+		pn[j] = (type[j] == PRIMORIAL) ? n[j] : 0;
+		cn[j] = (type[j] == COMPOSITORIAL) ? n[j] : 0;
+		if(fn[j] > fmax) fmax = fn[j];
+		if(pn[j] > pmax) pmax = pn[j];
+		if(cn[j] > cmax) cmax = cn[j];
+		if(c[j] == -1) minus |= (1 << j);
+	}
+
+	__m256i x = m_mul32(_mm256_loadu_si256((const __m256i *)start), r2, m);
+
+	// factorial lanes, multiply by 35 ... n
+	const __m256i vfn = _mm256_loadu_si256((const __m256i *)fn);
+	__m256i mi = m_mul32(_mm256_set1_epi64x(34), r2, m);
+	for(uint32_t i=35; i<=fmax; ++i){
+		mi = add32(mi, one, m.p);
+		__m256i done = _mm256_cmpgt_epi64(_mm256_set1_epi64x(i), vfn);
+		x = _mm256_blendv_epi8(m_mul32(x, mi, m), x, done);
+	}
+
+	// primorial lanes, multiply by the primes up to n
+	const __m256i vpn = _mm256_loadu_si256((const __m256i *)pn);
+	for(size_t k=0; k<primelistsize && primelist[k] <= pmax; ++k){
+		const __m256i v = _mm256_set1_epi64x(primelist[k]);
+		__m256i done = _mm256_cmpgt_epi64(v, vpn);
+		x = _mm256_blendv_epi8(m_mul32(x, m_mul32(v, r2, m), m), x, done);
+	}
+
+	// compositorial lanes, multiply by the composites up to n
+	const __m256i vcn = _mm256_loadu_si256((const __m256i *)cn);
+	for(size_t k=0; k<complistsize && complist[k] <= cmax; ++k){
+		const __m256i v = _mm256_set1_epi64x(complist[k]);
+		__m256i done = _mm256_cmpgt_epi64(v, vcn);
+		x = _mm256_blendv_epi8(m_mul32(x, m_mul32(v, r2, m), m), x, done);
+	}
+
+	uint32_t good = (lanemask(_mm256_cmpeq_epi64(x, one)) & minus) | (lanemask(_mm256_cmpeq_epi64(x, pmo)) & ~minus);
+
+	for(int j=0; j<4; ++j){
+		result[j] = (good >> j) & 1;
+	}
+}
+
+#endif
+
+
+// 2-PRPs are odd, anything else is left to the scalar test
+static inline bool laneOK(uint64_t p){
+	return (p & 1) && p > 1;
+}
+
+
+// scalar verify() with the list for the factor's type
+static inline bool verifyOne(uint64_t p, uint32_t n, int32_t c, int32_t type,
+		uint32_t * primelist, size_t primelistsize, uint32_t * complist, size_t complistsize){
+	if(type == PRIMORIAL){
+		return verify(p, n, c, type, primelist, primelistsize);
+	}
+	return verify(p, n, c, type, complist, complistsize);
+}
+
+
+// isPrime() for count numbers, using SIMD lanes when available
+void isPrimeBatch(const uint64_t * p, bool * result, uint32_t count){
+
+	uint32_t i = 0;
+
+#ifdef SIMD_X86
+	uint32_t width = (simd_level == SIMD_IFMA) ? 8 : 4;
+
+	if(simd_level != SIMD_SCALAR){
+		for(; i<count; i+=width){
+			uint32_t lanes = (count - i < width) ? count - i : width;
+			uint64_t lp[VERIFY_BATCH];
+			bool lr[VERIFY_BATCH];
+			// unused or unsupported lanes get a dummy prime
+			for(uint32_t j=0; j<width; ++j){
+				lp[j] = (j < lanes && laneOK(p[i+j])) ? p[i+j] : 3;
+			}
+			if(simd_level == SIMD_IFMA){
+				isPrimeIFMA(lp, lr);
+			}
+			else{
+				isPrimeAVX2(lp, lr);
+			}
+			for(uint32_t j=0; j<lanes; ++j){
+				result[i+j] = laneOK(p[i+j]) ? lr[j] : isPrime(p[i+j]);
+			}
+		}
+		return;
+	}
+#endif
+
+	for(; i<count; ++i){
+		result[i] = isPrime(p[i]);
+	}
+}
+
+
+// verify() for count factors, using SIMD lanes when available
+void verifyBatch(const uint64_t * p, const uint32_t * n, const int32_t * c, const int32_t * type, uint32_t count,
+		uint32_t * primelist, size_t primelistsize, uint32_t * complist, size_t complistsize, bool * result){
+
+	uint32_t i = 0;
+
+#ifdef SIMD_X86
+	uint32_t width = (simd_level == SIMD_IFMA) ? 8 : 4;
+
+	if(simd_level != SIMD_SCALAR){
+		for(; i<count; i+=width){
+			uint32_t lanes = (count - i < width) ? count - i : width;
+			uint64_t lp[VERIFY_BATCH];
+			uint32_t ln[VERIFY_BATCH];
+			int32_t lc[VERIFY_BATCH], lt[VERIFY_BATCH];
+			bool lr[VERIFY_BATCH];
+			// unused or unsupported lanes get a dummy factor with no iterations
+			for(uint32_t j=0; j<width; ++j){
+				bool ok = j < lanes && laneOK(p[i+j]);
+				lp[j] = ok ? p[i+j] : 3;
+				ln[j] = ok ? n[i+j] : 0;
+				lc[j] = ok ? c[i+j] : 1;
+				lt[j] = ok ? type[i+j] : FACTORIAL;
+			}
+			if(simd_level == SIMD_IFMA){
+				verifyIFMA(lp, ln, lc, lt, primelist, primelistsize, complist, complistsize, lr);
+			}
+			else{
+				verifyAVX2(lp, ln, lc, lt, primelist, primelistsize, complist, complistsize, lr);
+			}
+			for(uint32_t j=0; j<lanes; ++j){
+				result[i+j] = laneOK(p[i+j]) ? lr[j] : verifyOne(p[i+j], n[i+j], c[i+j], type[i+j], primelist, primelistsize, complist, complistsize);
+			}
+		}
+		return;
+	}
+#endif
+
+	for(; i<count; ++i){
+		result[i] = verifyOne(p[i], n[i], c[i], type[i], primelist, primelistsize, complist, complistsize);
+	}
+}
@@ -0,0 +1,15 @@
+/*
+
+	verifysimd.h
+
+*/
+
+// largest batch, one factor per SIMD lane
+#define VERIFY_BATCH 8
+
+const char * simdName();
+
+void isPrimeBatch(const uint64_t * p, bool * result, uint32_t count);
+
+void verifyBatch(const uint64_t * p, const uint32_t * n, const int32_t * c, const int32_t * type, uint32_t count,
+		uint32_t * primelist, size_t primelistsize, uint32_t * complist, size_t complistsize, bool * result);